@@ -4,9 +4,16 @@
 #include "core/allocator.hpp"
 
 #include "dnn/tensor.hpp"
+#include "dnn/transform.hpp"
+#include "dnn/ops.hpp"
+#include "dnn/gemm.hpp"
 #include "dnn/net.hpp"
 #include "dnn/reg.hpp"
+#include "dnn/layers/layer.hpp"
 #include "dnn/group.hpp"
+#include "dnn/batching.hpp"
+#include "dnn/async.hpp"
+#include "dnn/executor_pool.hpp"
 #include "dnn/optimizer.hpp"
 
 #include "face/face_info.hpp"
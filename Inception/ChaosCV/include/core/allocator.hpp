@@ -5,11 +5,15 @@
 #include "core/core.hpp"
 
 #include <list>
+#include <vector>
+#include <map>
 #include <mutex>
+#include <atomic>
 
 #include <intrin.h>
 
 #define MALLOC_ALIGN 16
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
 
 // exchange-add operation for atomic operations on reference counters
 // Just for windows, reference to NCNN
@@ -63,17 +67,100 @@ namespace chaos
 		}
 	}
 
-	class Allocator
+	/// <summary>
+	/// <para>Tag the allocations of the current thread</para>
+	/// <para>All allocations made in the scope of an AllocationTag are attributed to the tag</para>
+	/// <para>by the allocators with stats enabled, e.g.</para>
+	/// <para>    AllocationTag tag("PNet");</para>
+	/// <para>    Tensor prob = Tensor(shape, F32, false, &amp;pool);</para>
+	/// <para>Tags can be nested, the innermost one wins. The tag must be a string literal.</para>
+	/// <para>A fallback tag only applies if the thread is not tagged yet, so that the default tags of the library, such as</para>
+	/// <para>"Tensor" or "MxNet output", do not hide the tag of the caller.</para>
+	/// </summary>
+	class CHAOS_API AllocationTag
+	{
+	public:
+		AllocationTag(const char* tag, bool fallback = false);
+		~AllocationTag();
+
+		/// <summary>Tag of the calling thread, nullptr if not tagged</summary>
+		static const char* Current();
+
+	private:
+		AllocationTag(const AllocationTag&) = delete;
+		AllocationTag& operator=(const AllocationTag&) = delete;
+
+		const char* previous;
+	};
+
+	/// <summary>Statistics of an allocator</summary>
+	class CHAOS_API AllocatorStats
+	{
+	public:
+		class CHAOS_API TagStats
+		{
+		public:
+			size_t live_bytes = 0;
+			size_t peak_bytes = 0;
+			size_t num_mallocs = 0;
+			size_t total_bytes = 0; // bytes allocated in total
+		};
+
+		/// <summary>Hits / (Hits + Misses)</summary>
+		double HitRate() const;
+		/// <summary>Bytes wasted by the size_compare_ratio slack</summary>
+		size_t SlackBytes() const;
+
+		std::string ToString() const;
+
+		size_t live_bytes = 0; // capacity of the blocks in use
+		size_t peak_bytes = 0; // max of live_bytes
+		size_t requested_bytes = 0; // bytes requested by the blocks in use
+		size_t num_budgets = 0; // free blocks held by the pool
+		size_t budget_bytes = 0;
+		size_t hits = 0; // reused a budget
+		size_t misses = 0; // went to the system allocator
+
+		std::map<std::string, TagStats> tags; // <tag, stats>
+	};
+
+	class CHAOS_API Allocator
 	{
 	public:
 		virtual ~Allocator();
 
 		virtual void* FastMalloc(size_t size) = 0;
 		virtual void FastFree(void* ptr) = 0;
+
+		/// <summary>
+		/// <para>Enable or disable the statistics, disabled by default</para>
+		/// <para>Stats take a lock per FastMalloc and FastFree when enabled</para>
+		/// </summary>
+		void EnableStats(bool enable = true);
+		virtual AllocatorStats GetStats() const;
+
+	protected:
+		/// <summary>A block in use</summary>
+		struct Payout
+		{
+			size_t size; // capacity
+			void* ptr;
+			size_t requested;
+			const char* tag;
+		};
+
+		void RecordMalloc(size_t size, size_t requested, const char* tag, bool hit);
+		void RecordFree(size_t size, size_t requested, const char* tag);
+
+		std::atomic<bool> stats_enabled = false; // read without the lock by every allocating thread
+
+	private:
+		mutable std::mutex stats_lock;
+		AllocatorStats stats;
 	};
 
 
-	class PoolAllocator : public Allocator
+	class CHAOS_API PoolAllocator : public Allocator
 	{
 	public:
 		PoolAllocator();
@@ -89,17 +176,19 @@ namespace chaos
 		virtual void* FastMalloc(size_t size);
 		virtual void FastFree(void* ptr);
 
+		AllocatorStats GetStats() const;
+
 	private:
-		std::mutex budgets_lock;
+		mutable std::mutex budgets_lock;
 		std::mutex payouts_lock;
 
 		unsigned int size_compare_ratio;// 0~256
 
 		std::list<std::pair<size_t, void*>> budgets;
-		std::list<std::pair<size_t, void*>> payouts;
+		std::list<Payout> payouts;
 	};
 
-	class UnlockedPoolAllocator : public Allocator
+	class CHAOS_API UnlockedPoolAllocator : public Allocator
 	{
 	public:
 		UnlockedPoolAllocator();
@@ -115,10 +204,198 @@ namespace chaos
 		virtual void* FastMalloc(size_t size);
 		virtual void FastFree(void* ptr);
 
+		AllocatorStats GetStats() const;
+
 	protected:
 		unsigned int size_compare_ratio;// 0~256
 
 		std::list<std::pair<size_t, void*>> budgets;
-		std::list<std::pair<size_t, void*>> payouts;
+		std::list<Payout> payouts;
+	};
+
+	/// <summary>
+	/// <para>Pool allocator with power-of-two size classes</para>
+	/// <para>Free budgets are bucketed by floor(log2(size)), each bucket is a std::multimap sorted by capacity,</para>
+	/// <para>and a non-empty mask is used to jump to the next bucket, so FastMalloc is a best-fit lookup in</para>
+	/// <para>O(log n) of the budgets of one bucket without walking all budgets. Every block carries a header of</para>
+	/// <para>2 * MALLOC_ALIGN (32) bytes before the returned pointer with its capacity, requested size, tag and</para>
+	/// <para>magic, so FastFree does not need to search payouts, it inserts the block back in O(log n).</para>
+	/// <para>The size_compare_ratio semantics are the same as PoolAllocator.</para>
+	/// </summary>
+	class CHAOS_API SizeClassPoolAllocator : public Allocator
+	{
+	public:
+		SizeClassPoolAllocator();
+		~SizeClassPoolAllocator();
+
+		// ratio range 0 ~ 1
+		// default cr = 0.75
+		void SetSizeCompareRatio(float scr);
+
+		// release all budgets immediately
+		void Clear();
+
+		virtual void* FastMalloc(size_t size);
+		virtual void FastFree(void* ptr);
+
+		/// <summary>Capacity of a block returned by SizeClassPoolAllocator::FastMalloc</summary>
+		static size_t BlockSize(const void* ptr);
+
+		AllocatorStats GetStats() const;
+
+	private:
+		mutable std::mutex budgets_lock;
+
+		unsigned int size_compare_ratio;// 0~256
+
+		unsigned long long nonempty; // bit k is set if buckets[k] is not empty
+		std::multimap<size_t, void*> buckets[64]; // <capacity, ptr>
+
+		std::atomic<size_t> num_payouts;
+	};
+
+	/// <summary>
+	/// <para>Thread caching allocator</para>
+	/// <para>Every thread keeps its own magazines of recently freed blocks per size class,</para>
+	/// <para>FastMalloc and FastFree only touch the calling thread's magazines and fall back to</para>
+	/// <para>a shared SizeClassPoolAllocator on a miss or when a magazine is full.</para>
+	/// <para>A block may be freed on any thread, it goes to the magazines of the freeing thread.</para>
+	/// <para>FastFree checks the block header as the pool does, a block freed twice or not from this allocator fails.</para>
+	/// </summary>
+	class CHAOS_API CachedAllocator : public Allocator
+	{
+	public:
+		/// <param name="depth">Max number of cached blocks per size class per thread</param>
+		CachedAllocator(int depth = 16);
+		~CachedAllocator();
+
+		// ratio range 0 ~ 1
+		// default cr = 0.75
+		void SetSizeCompareRatio(float scr);
+
+		// release the calling thread's magazines and all budgets of the shared pool
+		void Clear();
+
+		virtual void* FastMalloc(size_t size);
+		virtual void FastFree(void* ptr);
+
+		/// <summary>num_budgets only counts the shared pool, not the magazines</summary>
+		AllocatorStats GetStats() const;
+
+	private:
+		struct Registry;
+		struct Magazine;
+
+		Magazine* GetMagazine();
+
+		SizeClassPoolAllocator pool;
+		Ptr<Registry> registry;
+
+		size_t id; // unique id of this allocator, never reused
+		int depth;
+		unsigned int size_compare_ratio;// 0~256
+	};
+
+	/// <summary>
+	/// <para>Bump pointer arena allocator, NOT thread safe</para>
+	/// <para>FastMalloc just moves a pointer forward and FastFree does nothing but counting,</para>
+	/// <para>the memory is recycled by Reset once all blocks are freed.</para>
+	/// <para>If the arena had to grow, Reset merges all chunks into one chunk, so after the first</para>
+	/// <para>few rounds an arena reset per frame does not allocate from heap any more.</para>
+	/// </summary>
+	class CHAOS_API ArenaAllocator : public Allocator
+	{
+	public:
+		/// <param name="size">Size of the first chunk</param>
+		ArenaAllocator(size_t size = 4 * 1024 * 1024);
+		~ArenaAllocator();
+
+		/// <summary>Recycle all blocks, all of them must be freed before</summary>
+		void Reset();
+
+		virtual void* FastMalloc(size_t size);
+		virtual void FastFree(void* ptr);
+
+		/// <summary>Number of blocks served since the last Reset</summary>
+		size_t GetNumBlocks() const;
+		/// <summary>Number of chunks allocated from heap since the arena was created</summary>
+		size_t GetNumChunkAllocations() const;
+
+		/// <summary>
+		/// <para>Blocks are never reused before Reset, so live_bytes are all bytes handed out since the last Reset,</para>
+		/// <para>budgets are the chunks, and a miss is a FastMalloc which made the arena grow. With stats enabled, the tags</para>
+		/// <para>are counted too, their live bytes are the bytes handed out since the last Reset as well.</para>
+		/// </summary>
+		AllocatorStats GetStats() const;
+
+	private:
+		ArenaAllocator(const ArenaAllocator&) = delete;
+		ArenaAllocator& operator=(const ArenaAllocator&) = delete;
+
+		void Grow(size_t size);
+
+		std::vector<std::pair<size_t, uchar*>> chunks; // <size, ptr>, the last one is in use
+		size_t offset; // offset in the last chunk
+
+		size_t num_blocks;
+		size_t num_payouts;
+		size_t num_chunk_allocations;
+
+		size_t used_bytes; // in the chunks before the last one
+		size_t peak_bytes;
+		size_t num_hits;
+		size_t num_grows;
+
+		std::map<std::string, AllocatorStats::TagStats> tags; // <tag, stats>
+	};
+
+	/// <summary>
+	/// <para>Allocator for large tensors such as galleries and GCN adjacency matrices</para>
+	/// <para>Blocks not smaller than threshold are mapped in HUGE_PAGE_SIZE aligned regions.</para>
+	/// <para>On Linux the regions are advised with MADV_HUGEPAGE (transparent huge pages) and bound to</para>
+	/// <para>numa_node with mbind; on Windows they are allocated with MEM_LARGE_PAGES on numa_node,</para>
+	/// <para>which needs SeLockMemoryPrivilege, and fall back to normal pages otherwise, which are only</para>
+	/// <para>aligned to the allocation granularity (64 KB).</para>
+	/// <para>Smaller blocks go to FastMalloc. Mapping is slow, so reuse the tensors or put a pool in front.</para>
+	/// </summary>
+	class CHAOS_API LargePageAllocator : public Allocator
+	{
+	public:
+		/// <param name="numa_node">NUMA node to bind the memory to, -1 for the default policy</param>
+		/// <param name="threshold">Blocks not smaller than threshold are backed by huge pages</param>
+		LargePageAllocator(int numa_node = -1, size_t threshold = HUGE_PAGE_SIZE);
+		~LargePageAllocator();
+
+		virtual void* FastMalloc(size_t size);
+		virtual void FastFree(void* ptr);
+
+		/// <summary>
+		/// <para>Bytes of the live blocks which are really backed by huge pages</para>
+		/// <para>On Linux these are the AnonHugePages of the regions in /proc/self/smaps, only the pages touched so far</para>
+		/// <para>count and the kernel may split them later. On Windows these are the regions of MEM_LARGE_PAGES, which</para>
+		/// <para>are committed at once. Reads /proc on Linux, so it is not meant to be called per allocation.</para>
+		/// </summary>
+		size_t GetNumHugePageBytes() const;
+
+		/// <summary>Budgets are the live mapped regions, every FastMalloc is a miss</summary>
+		AllocatorStats GetStats() const;
+
+	private:
+		LargePageAllocator(const LargePageAllocator&) = delete;
+		LargePageAllocator& operator=(const LargePageAllocator&) = delete;
+
+		struct Region
+		{
+			size_t size; // mapped size, 0 for FastMalloc blocks
+			size_t requested;
+			const char* tag;
+			bool huge; // allocated with large pages on Windows, advised with MADV_HUGEPAGE on Linux
+		};
+
+		int numa_node;
+		size_t threshold;
+
+		mutable std::mutex regions_lock;
+		std::map<void*, Region> regions;
 	};
 }
\ No newline at end of file
@@ -25,34 +25,39 @@ namespace chaos
 	// cv::Range do not support float
 	using Range = cv::Vec2f; // <min, max>
 
+	/// <summary>
+	/// <para>Shape of tensors</para>
+	/// <para>Dims are stored inline (at most MAX_DIMS), so building and copying a shape never touches the heap</para>
+	/// </summary>
 	class CHAOS_API Shape
 	{
 	public:
+		static constexpr int MAX_DIMS = 8;
+
 		Shape();
 
 		template<class Type>
-		Shape(const std::vector<Type>& data)
+		Shape(const Type* data, size_t size) : Shape()
 		{
-			for (auto val : data)
+			CHECK_LE(size, MAX_DIMS) << "Shape supports at most " << MAX_DIMS << " dims";
+			for (size_t i = 0; i < size; i++)
 			{
-				shape.push_back((int)val);
+				shape[i] = (int)data[i];
 			}
+			num = (int)size;
 		}
 
 		template<class Type>
-		Shape(const std::initializer_list<Type>& list)
-		{
-			for (auto val : list)
-			{
-				shape.push_back((int)val);
-			}
-		}
+		Shape(const std::vector<Type>& data) : Shape(data.data(), data.size()) {}
+
+		template<class Type>
+		Shape(const std::initializer_list<Type>& list) : Shape(list.begin(), list.size()) {}
 
 		template<class Type>
 		operator std::vector<Type>() const
 		{
 			std::vector<Type> ret;
-			for (auto val : shape)
+			for (auto val : *this)
 			{
 				ret.push_back((Type)val);
 			}
@@ -66,7 +71,7 @@ namespace chaos
 
 		CHAOS_API friend inline bool operator==(const Shape& s1, const Shape& s2)
 		{
-			return s1.shape == s2.shape;
+			return s1.num == s2.num && std::equal(s1.begin(), s1.end(), s2.begin());
 		}
 		CHAOS_API friend inline std::ostream& operator<<(std::ostream& stream, const Shape& shape);
 
@@ -74,15 +79,16 @@ namespace chaos
 
 
 		const int* data() const;
-		std::vector<int>::const_iterator begin() const;
-		std::vector<int>::iterator begin();
-		std::vector<int>::const_iterator end() const;
-		std::vector<int>::iterator end();
+		const int* begin() const;
+		int* begin();
+		const int* end() const;
+		int* end();
 		int& back();
 		const int& back() const;
 
 	private:
-		std::vector<int> shape;
+		int shape[MAX_DIMS];
+		int num;
 	};
 
 	/// <summary>Base class for those which need indefinite parameters</summary>
@@ -25,6 +25,7 @@ namespace chaos
 		F16 = (2 << DEPTH_SHIFT),		/// <summary>Float 16 bit, 2 bytes</summary>
 		S16 = (2 << DEPTH_SHIFT) + 1,	/// <summary>Short 16 bit</summary>
 		U16 = (2 << DEPTH_SHIFT) + 2,	/// <summary>Unsigned Short 16 bit</summary>
+		BF16 = (2 << DEPTH_SHIFT) + 3,	/// <summary>BFloat 16 bit, the upper half of Float 32 bit</summary>
 		F32 = (4 << DEPTH_SHIFT),		/// <summary>Float 32 bit, 4 bytes</summary>
 		S32 = (4 << DEPTH_SHIFT) + 1,	/// <summary>Int 32 bit</summary>
 		F64 = (8 << DEPTH_SHIFT),		/// <summary>Double 64 bit, 8 bytes</summary>
@@ -56,6 +57,21 @@ using namespace chaos;
 #define CHECK_GE(val1, val2) CHECK(val1 >= val2)
 #define CHECK_GT(val1, val2) CHECK(val1 >  val2)
 
+// Checks only in debug builds, neither the condition nor the message is evaluated in release builds
+#ifdef _DEBUG
+#define DCHECK(condition) CHECK(condition)
+#else
+#define DCHECK(condition) true ? (void)0 :				\
+  LogMessageVoidify() & LOG(chaos::FATAL)
+#endif
+
+#define DCHECK_EQ(val1, val2) DCHECK(val1 == val2)
+#define DCHECK_NE(val1, val2) DCHECK(val1 != val2)
+#define DCHECK_LE(val1, val2) DCHECK(val1 <= val2)
+#define DCHECK_LT(val1, val2) DCHECK(val1 <  val2)
+#define DCHECK_GE(val1, val2) DCHECK(val1 >= val2)
+#define DCHECK_GT(val1, val2) DCHECK(val1 >  val2)
+
 #define DEFINE_FLAG(type, name, value, group, help)									\
   namespace flag_##type {															\
     static type flag_##name = value;												\
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "dnn/net.hpp"
+
+#include <deque>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+namespace chaos
+{
+	namespace dnn
+	{
+		/// <summary>
+		/// <para>Asynchronous forward of a net on a worker thread of its own</para>
+		/// <para>ForwardAsync queues the inputs and returns at once, the worker sets them, forwards and gets the outputs</para>
+		/// <para>in the order of the calls. So the caller prepares batch k + 1 while the net computes batch k. The net is</para>
+		/// <para>reshaped when the input shapes change. The net must be bound and must not be used by others while the</para>
+		/// <para>async net lives, use Net::Clone for more executors.</para>
+		/// </summary>
+		class CHAOS_API AsyncNet
+		{
+		public:
+			using Callback = std::function<void(std::vector<Tensor>& outputs)>;
+
+			/// <param name="inputs">Names of the input layers</param>
+			/// <param name="outputs">Names of the output layers</param>
+			AsyncNet(const Ptr<Net>& net, const std::vector<std::string>& inputs, const std::vector<std::string>& outputs);
+			/// <summary>Stop the worker after the queued forwards are done</summary>
+			~AsyncNet();
+
+			/// <summary>
+			/// <para>Queue a forward of inputs in the order of the input names, which must not be changed until it is done</para>
+			/// <para>The future gives the outputs in the order of the output names</para>
+			/// </summary>
+			std::future<std::vector<Tensor>> ForwardAsync(const std::vector<Tensor>& inputs);
+			/// <summary>Queue a forward, done is called on the worker thread with the outputs</summary>
+			void ForwardAsync(const std::vector<Tensor>& inputs, const Callback& done);
+
+			/// <summary>Wait until all queued forwards are done</summary>
+			void Wait();
+
+		private:
+			struct Request
+			{
+				std::vector<Tensor> inputs;
+				std::promise<std::vector<Tensor>> promise;
+				Callback done;
+			};
+
+			void Push(Request&& request);
+			void Run();
+
+			Ptr<Net> net;
+			std::vector<std::string> inputs;
+			std::vector<int> input_handles;
+			std::vector<int> output_handles;
+			std::vector<Shape> shapes; // input shapes the net is reshaped to
+
+			std::deque<Request> queue;
+			size_t pending; // queued and running
+			std::mutex queue_lock;
+			std::condition_variable queue_cond;
+			std::condition_variable done_cond;
+			bool stop;
+			std::thread worker;
+		};
+	}
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "dnn/net.hpp"
+
+#include <atomic>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+namespace chaos
+{
+	namespace dnn
+	{
+		/// <summary>
+		/// <para>Dynamic batching over a Net for concurrent single sample requests</para>
+		/// <para>A worker thread groups the queued samples of the same shape until max_batch of them are there or the oldest</para>
+		/// <para>one has waited max_delay_ms, then sets them as one batch, runs one Forward and hands each caller the slice</para>
+		/// <para>of its sample from the outputs. The net is reshaped only when the batch shape changes. The net must be bound</para>
+		/// <para>and must not be used by others while the batching net lives.</para>
+		/// </summary>
+		class CHAOS_API BatchingNet
+		{
+		public:
+			/// <param name="input">Name of the input layer</param>
+			/// <param name="outputs">Names of the output layers returned to the callers</param>
+			BatchingNet(const Ptr<Net>& net, const std::string& input, const std::vector<std::string>& outputs, int max_batch = 16, double max_delay_ms = 2.);
+			/// <summary>Stop the worker after the queued requests are forwarded</summary>
+			~BatchingNet();
+
+			/// <summary>
+			/// <para>Queue one sample, C x H x W or 1 x C x H x W, which can be called from any thread</para>
+			/// <para>The future gives the outputs in the order of outputs, each a view with batch 1</para>
+			/// </summary>
+			std::future<std::vector<Tensor>> Forward(const Tensor& sample);
+
+			/// <summary>Number of requests and batches forwarded so far</summary>
+			size_t GetNumRequests() const;
+			size_t GetNumBatches() const;
+			__declspec(property(get = GetNumRequests)) size_t NumRequests;
+			__declspec(property(get = GetNumBatches)) size_t NumBatches;
+
+		private:
+			struct Request
+			{
+				Tensor sample;
+				std::promise<std::vector<Tensor>> promise;
+				std::chrono::steady_clock::time_point arrival;
+			};
+
+			void Run();
+			void Process(std::vector<Request>& batch);
+
+			Ptr<Net> net;
+			std::string input;
+			std::vector<std::string> outputs;
+			int input_handle;
+			std::vector<int> output_handles;
+			int max_batch;
+			std::chrono::microseconds max_delay;
+
+			Shape bound; // batch shape the net is reshaped to
+			std::atomic<size_t> num_requests;
+			std::atomic<size_t> num_batches;
+
+			std::deque<Request> queue;
+			std::mutex queue_lock;
+			std::condition_variable queue_cond;
+			bool stop;
+			std::thread worker;
+		};
+	}
+}
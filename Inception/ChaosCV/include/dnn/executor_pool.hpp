@@ -0,0 +1,45 @@
+#pragma once
+
+#include "dnn/net.hpp"
+
+#include <mutex>
+#include <condition_variable>
+
+namespace chaos
+{
+	namespace dnn
+	{
+		/// <summary>
+		/// <para>Executors of one net for multi-threaded inference</para>
+		/// <para>The executors are clones of a bound net, they share its weights and only own their activations.</para>
+		/// <para>Each thread acquires a free executor, uses it as a net of its own and drops it to give it back.</para>
+		/// </summary>
+		class CHAOS_API ExecutorPool
+		{
+		public:
+			/// <param name="net">A bound net, which is the first executor</param>
+			/// <param name="size">Number of executors, 0 for the number of threads of cv::getNumThreads</param>
+			ExecutorPool(const Ptr<Net>& net, int size = 0);
+			~ExecutorPool();
+
+			/// <summary>
+			/// <para>Wait for a free executor</para>
+			/// <para>It goes back to the pool when the last copy of the returned pointer is released, which must be</para>
+			/// <para>before the pool is destroyed</para>
+			/// </summary>
+			Ptr<Net> Acquire();
+
+			/// <summary>Number of executors</summary>
+			int GetSize() const;
+			__declspec(property(get = GetSize)) int Size;
+
+		private:
+			void Release(Net* net);
+
+			std::vector<Ptr<Net>> executors;
+			std::vector<Net*> free_executors;
+			std::mutex lock;
+			std::condition_variable cond;
+		};
+	}
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "core/core.hpp"
+
+namespace chaos
+{
+	namespace dnn
+	{
+		/// <summary>
+		/// <para>C = A * B + bias, or A * B^T + bias if trans_b, all matrices are row major float</para>
+		/// <para>A is M x K, B is K x N (N x K if trans_b), C is M x N and bias has one value per row of C, or is null.</para>
+		/// <para>A and B are packed into panels which the AVX2, SSE4.1 or scalar micro kernel runs on, column tiles</para>
+		/// <para>of C are computed in parallel.</para>
+		/// </summary>
+		CHAOS_API void Gemm(int M, int N, int K, const float* A, int lda, const float* B, int ldb, bool trans_b,
+			float* C, int ldc, const float* bias = nullptr);
+
+		/// <summary>
+		/// <para>Quantized C = (A * B^T - offset) * scale + bias by row of A, A is M x K signed bytes and B is N x K unsigned</para>
+		/// <para>bytes within [0, 127]. C is M x N, or N x M if trans_c. scale, offset and bias have one value per row of A,</para>
+		/// <para>offset and bias may be null. Blocks of A and B rows are computed in parallel.</para>
+		/// </summary>
+		CHAOS_API void GemmU8S8(int M, int N, int K, const int8_t* A, int lda, const uint8_t* B, int ldb,
+			float* C, int ldc, bool trans_c, const float* scale, const int32_t* offset = nullptr, const float* bias = nullptr);
+
+		/// <summary>
+		/// <para>Symmetric quantization of each row, q = round(x / scale) within [-127, 127] where scale = max |x| / 127</para>
+		/// <para>sums are the sums of q of each row, which the zero point of the inputs is multiplied by, and may be null.</para>
+		/// </summary>
+		CHAOS_API void QuantizeRows(const float* src, int rows, int cols, int8_t* dst, float* scales, int32_t* sums = nullptr);
+
+		/// <summary>Input of GemmU8S8, round(x / scale) + zero within [0, 127]</summary>
+		inline uint8_t QuantizeU8(float x, float inv_scale, int zero)
+		{
+			return (uint8_t)std::min(127, std::max(0, (int)std::floor(x * inv_scale + 0.5f) + zero));
+		}
+	}
+}
@@ -2,13 +2,38 @@
 
 #include "dnn/net.hpp"
 
+#include <atomic>
+#include <future>
+#include <mutex>
+
 namespace chaos
 {
 	namespace dnn
 	{
+		/// <summary>Queue metrics of a stage of the GroupNet pipeline</summary>
+		struct CHAOS_API StageStats
+		{
+			std::string name;
+			size_t capacity = 0; // frames the queue holds at most
+			size_t depth = 0; // frames queued now
+			double mean_depth = 0.; // frames queued ahead of a pushed frame on average
+			double occupancy = 0.; // fraction of the time the worker was running the stage since the pipeline started
+			size_t frames = 0; // frames done by the stage
+		};
+
+		/// <summary>
+		/// <para>Named nets with the forward of each, e.g. the cascade of MTCNN</para>
+		/// <para>Forward runs the forward of a net on the calling thread. In the stage pipeline mode, each stage has a worker</para>
+		/// <para>and a bounded queue of its own, and a pushed frame goes through the stages in order. So the first stage</para>
+		/// <para>runs on frame t + 1 while the later ones run on frame t, and frames come out in the order they were pushed.</para>
+		/// </summary>
 		class CHAOS_API GroupNet
 		{
 		public:
+			/// <summary>Stage of the pipeline, which runs on the frame pushed and passes it on to the next stage</summary>
+			using StageFunction = std::function<void(std::any& frame)>;
+			using Callback = std::function<void(std::any& frame)>;
+
 			class CHAOS_API Load
 			{
 			public:
@@ -23,15 +48,52 @@ namespace chaos
 			};
 
 			GroupNet();
+			/// <summary>Stop the pipeline after the pushed frames are done</summary>
+			~GroupNet();
 
 			GroupNet& Add(const std::string& name, const Model& model, const Context& ctx = Context());
 			GroupNet& Forward(const std::string& name);
 			GroupNet& SetForward(const std::string& name, const std::function<void()>& func);
+			/// <summary>Set the executor cache of the net, see Net::SetExecutorCache</summary>
+			GroupNet& SetExecutorCache(const std::string& name, int capacity, bool bucketing = false);
+
+			/// <summary>Set the stage of the net for the pipeline, which may only use the net and the frame</summary>
+			GroupNet& SetStage(const std::string& name, const StageFunction& func);
+			/// <summary>
+			/// <para>Start the workers of the stages, in the order frames go through them</para>
+			/// <para>Starting and stopping are serialized and a started pipeline is kept as it is, so that the callers racing</para>
+			/// <para>to start it on first use start it once.</para>
+			/// </summary>
+			/// <param name="queue_depth">Frames a stage queues at most, a full queue blocks the stage before it or Push</param>
+			GroupNet& StartPipeline(const std::vector<std::string>& stages, size_t queue_depth = 2);
+			/// <summary>Stop the workers after the pushed frames are done, the stages may be started again. No Push may run meanwhile</summary>
+			void StopPipeline();
+			/// <summary>Whether the pipeline is started, which any thread may ask</summary>
+			bool IsPipelined() const;
+			/// <summary>
+			/// <para>Push a frame into the pipeline, which blocks while the queue of the first stage is full</para>
+			/// <para>The future gives the frame after the last stage</para>
+			/// </summary>
+			std::future<std::any> Push(std::any frame);
+			/// <summary>Push a frame, done is called on the worker of the last stage with the frame</summary>
+			void Push(std::any frame, const Callback& done);
+			/// <summary>Queue metrics of the stages in order</summary>
+			std::vector<StageStats> GetStageStats() const;
+
+			/// <summary>Executor cache hit rates of the nets, one line per net, and the queue metrics of the stages</summary>
+			std::string Report() const;
 
 			Ptr<Net>& operator[](const std::string& name);
 		private:
+			struct Stage;
+
 			std::map<std::string, std::function<void()>> forward_func; // <name, func>
+			std::map<std::string, StageFunction> stage_func; // <name, func>
 			std::map<std::string, Ptr<Net>> nets;
+
+			std::vector<Ptr<Stage>> pipeline;
+			std::atomic<bool> pipelined = false; // pipeline is started, read without the lock
+			std::mutex pipeline_lock; // of starting and stopping
 		};
 	}
 }
\ No newline at end of file
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "core/core.hpp"
+#include "dnn/tensor.hpp"
+
+namespace chaos
+{
+	namespace dnn
+	{
+		/// <summary>
+		/// <para>Operator of the native inference engine</para>
+		/// <para>A layer is created from the op name and the attributes of a node of the MxNet symbol, then gets the</para>
+		/// <para>weights of the node once. The shapes and buffers of the activations belong to the net, so that a</para>
+		/// <para>layer can be shared by the clones of a net and Forward may be called from several threads.</para>
+		/// </summary>
+		class CHAOS_API Layer
+		{
+		public:
+			using Attrs = std::map<std::string, std::string>;
+			using Creator = std::function<Ptr<Layer>(const Attrs&)>;
+
+			virtual ~Layer();
+
+			/// <summary>Weights of the node, which are its inputs loaded from the params, in the order of the inputs</summary>
+			virtual void SetWeights(const std::vector<Tensor>& weights);
+			/// <summary>Output shapes of the input shapes</summary>
+			virtual std::vector<Shape> Reshape(const std::vector<Shape>& inputs) = 0;
+			/// <summary>
+			/// <para>Compute the outputs, which the net has allocated with the shapes of Reshape</para>
+			/// <para>If InPlace, outputs[0] may share the buffer of inputs[0]</para>
+			/// </summary>
+			virtual void Forward(const std::vector<Tensor>& inputs, std::vector<Tensor>& outputs) = 0;
+			/// <summary>Whether outputs[0] can be written over inputs[0], e.g. activations and reshapes</summary>
+			virtual bool InPlace() const;
+
+			/// <summary>Create the layer of op, null if the op is unknown</summary>
+			static Ptr<Layer> Create(const std::string& op, const Attrs& attrs);
+			/// <summary>Register the creator of op, see REGISTER_LAYER</summary>
+			static bool Register(const std::string& op, const Creator& creator);
+
+			// Attributes in the MxNet formats, e.g. "True", "(3, 3)", with a default value for the missing ones
+			static bool GetBool(const Attrs& attrs, const std::string& key, bool value);
+			static int GetInt(const Attrs& attrs, const std::string& key, int value);
+			static float GetFloat(const Attrs& attrs, const std::string& key, float value);
+			static std::string GetString(const Attrs& attrs, const std::string& key, const std::string& value);
+			static std::vector<int> GetTuple(const Attrs& attrs, const std::string& key, const std::vector<int>& value);
+		};
+	}
+}
+
+#define LAYER_REGISTERER_CONCAT(a, b) a##b
+#define LAYER_REGISTERER(line) LAYER_REGISTERER_CONCAT(_layer_registerer_, line)
+
+/// <summary>
+/// <para>Register a layer class for an op of the MxNet symbol</para>
+/// <para>@param op: Op name, e.g. "Convolution"</para>
+/// <para>@param type: Layer class with a constructor of Layer::Attrs</para>
+/// </summary>
+#define REGISTER_LAYER(op, type)																	\
+  static bool LAYER_REGISTERER(__LINE__) = chaos::dnn::Layer::Register(op,							\
+    [](const chaos::dnn::Layer::Attrs& attrs) { return chaos::Ptr<chaos::dnn::Layer>(new type(attrs)); });
+
+/// <summary>
+/// <para>Register a layer class serving several ops, e.g. the elementwise ops</para>
+/// <para>@param op: Op name, e.g. "elemwise_add"</para>
+/// <para>@param type: Layer class with a constructor of the op name and Layer::Attrs</para>
+/// </summary>
+#define REGISTER_OP_LAYER(op, type)																\
+  static bool LAYER_REGISTERER(__LINE__) = chaos::dnn::Layer::Register(op,							\
+    [](const chaos::dnn::Layer::Attrs& attrs) { return chaos::Ptr<chaos::dnn::Layer>(new type(op, attrs)); });
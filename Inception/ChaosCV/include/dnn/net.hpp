@@ -3,6 +3,8 @@
 #include "dnn/tensor.hpp"
 #include "dnn/layers/data_layer.hpp"
 
+#include <mutex>
+
 namespace chaos
 {
 	namespace dnn
@@ -17,10 +19,13 @@ namespace chaos
 		{
 		public:
 			Context();
-			Context(const DeviceType& type, int id = 0);
+			/// <param name="framework">Name of the registered framework to load the net by, e.g. "Native", or empty to pick
+			/// the first one of the file types, where Native comes after the others such as MxNet</param>
+			Context(const DeviceType& type, int id = 0, const std::string& framework = "");
 
 			DeviceType type = CPU;
 			int id = 0;
+			std::string framework;
 		};
 
 		class CHAOS_API Model
@@ -36,6 +41,83 @@ namespace chaos
 			bool from_file = true;
 		};
 
+		/// <summary>Counters of the executor cache of a net</summary>
+		struct CHAOS_API CacheStats
+		{
+			size_t hits = 0; // Reshape to a cached shape
+			size_t misses = 0; // Reshape which bound a new executor
+			size_t evictions = 0; // executors freed over the capacity
+			int capacity = 1; // executors kept at most
+			bool bucketing = false;
+
+			double HitRate() const;
+		};
+
+		/// <summary>Time of a layer in the last profiled forward</summary>
+		struct CHAOS_API LayerTime
+		{
+			std::string name; // Layer name, or the operator for frameworks which only time the operators
+			std::string op;
+			double ms = 0.;
+		};
+
+		/// <summary>Percentiles of the latencies of the last forwards in milliseconds</summary>
+		struct CHAOS_API LatencyStats
+		{
+			size_t count = 0; // forwards timed in total
+			size_t window = 0; // forwards the percentiles are taken over
+			double mean = 0.;
+			double p50 = 0.;
+			double p95 = 0.;
+			double p99 = 0.;
+			double max = 0.;
+		};
+
+		/// <summary>
+		/// <para>Rolling window of the latencies of Forward, which the nets keep to report their percentiles</para>
+		/// <para>Add is called by the forwarding thread and GetStats may be called by any other one.</para>
+		/// </summary>
+		class CHAOS_API LatencyWindow
+		{
+		public:
+			LatencyWindow(size_t capacity = 1024);
+
+			void Add(double ms);
+			LatencyStats GetStats() const;
+
+		private:
+			std::vector<double> latencies;
+			size_t capacity;
+			size_t next = 0;
+			size_t count = 0;
+			mutable std::mutex lock;
+		};
+
+		/// <summary>Settings of the forward of a net, which the auto tuning picks for each input shape</summary>
+		struct CHAOS_API ForwardSettings
+		{
+			int threads = 0; // threads a forward runs on, 0 for the default
+			int grain = 0; // elements a parallel loop shares at least, 0 for the default, native net only
+
+			std::string ToString() const;
+		};
+
+		/// <summary>Options of BindExecutor</summary>
+		struct CHAOS_API BindOptions
+		{
+			/// <summary>More inputs to warm up and tune, e.g. the batch sizes the executor cache keeps</summary>
+			std::vector<std::vector<DataLayer>> shapes;
+			/// <summary>Forwards of dummy data of each inputs, so that the lazy planning and kernel selection are done by then</summary>
+			int warmup = 0;
+			/// <summary>
+			/// <para>File of the tuned settings of the shapes, see Net::TuneFile, empty for no tuning</para>
+			/// <para>The shapes not in the file are tuned by timing each settings of GetTuningSpace and the file is updated.</para>
+			/// </summary>
+			std::string tune_file;
+			/// <summary>Timed forwards of each settings, the median is compared</summary>
+			int tune_forwards = 10;
+		};
+
 		// Pre-declaration
 		class Framework;
 		/// <summary>Net just for inference</summary>
@@ -47,28 +129,108 @@ namespace chaos
 			/// <summary>Bind the executor</summary>
 			/// <param name="inputs">Inputs info</param>
 			virtual void BindExecutor(const std::vector<DataLayer>& inputs) = 0;
+			/// <summary>
+			/// <para>Bind the executor, then tune and warm up the inputs and the more shapes of the options</para>
+			/// <para>The executor cache is raised to keep all the shapes, so that none of the warmed executors is evicted, and the</para>
+			/// <para>net is reshaped back to inputs at the end. With tuning, Bind and Reshape apply the tuned settings of the</para>
+			/// <para>inputs from then on, or the default settings for the shapes which are not tuned.</para>
+			/// <para>Nets derived from Net bring it into their scope with using Net::BindExecutor.</para>
+			/// </summary>
+			void BindExecutor(const std::vector<DataLayer>& inputs, const BindOptions& options);
 			/// <summary>Forward the newtork</summary>
 			virtual void Forward() = 0;
 			/// <summary>Set the layer data</summary>
 			/// <param name="name">Layer name</param>
 			/// <param name="data">Tensor data</param>
 			virtual void SetLayerData(const std::string& name, const Tensor& data) = 0;
-			/// <summary>Get the layer data</summary>
+			/// <summary>
+			/// <para>Get the layer data</para>
+			/// <para>The output is written into data if it is already a continue NCHW F32 tensor of the output shape, which</para>
+			/// <para>owns its buffer alone: not a view such as Slice, not user data and not shared by a copy of the tensor.</para>
+			/// <para>Otherwise data is created by data.allocator, and the tensors which shared it keep the last output.</para>
+			/// </summary>
 			/// <param name="name">Layer name</param>
 			/// <param name="data">Tensor data</param>
 			virtual void GetLayerData(const std::string& name, Tensor& data) = 0;
+
+			/// <summary>
+			/// <para>Handle of an input or output layer for the overloads below, so that the name is looked up once</para>
+			/// <para>out of the forward loop. Handles stay valid until the executor is bound again.</para>
+			/// </summary>
+			virtual int GetInputHandle(const std::string& name) = 0;
+			virtual int GetOutputHandle(const std::string& name) = 0;
+			/// <summary>Set the data of the input layer by its handle</summary>
+			virtual void SetLayerData(int handle, const Tensor& data) = 0;
+			/// <summary>Get the data of the output layer by its handle, data is reused as by name</summary>
+			virtual void GetLayerData(int handle, Tensor& data) = 0;
 			/// <summary>Reshape the network if supported</summary>
 			/// <param name="inputs">New inputs info</param>
 			virtual void Reshape(const std::vector<DataLayer>& new_inputs) = 0;
+			/// <summary>
+			/// <para>Create another executor of the bound network with the same inputs</para>
+			/// <para>The clone shares the weights and only allocates its own activations, so that each thread can</para>
+			/// <para>forward its own clone. See ExecutorPool.</para>
+			/// </summary>
+			virtual Ptr<Net> Clone() = 0;
+
+			/// <summary>
+			/// <para>Keep the bound executors of up to capacity input shapes, 1 for default</para>
+			/// <para>Reshape to a cached shape reuses its executor instead of binding a new one. With bucketing, the batch</para>
+			/// <para>size is rounded up to 1, 2, 4, 8, 16, 32 or a multiple of 32, inputs are padded with zeros and the outputs</para>
+			/// <para>of the bucketed batch are cut back, so that close batch sizes share an executor.</para>
+			/// <para>Frameworks which reshape cheaply ignore it.</para>
+			/// </summary>
+			virtual void SetExecutorCache(int capacity, bool bucketing = false);
+			/// <summary>Hits and misses of the executor cache</summary>
+			virtual CacheStats GetCacheStats() const;
+
+			/// <summary>
+			/// <para>Time each layer of the following forwards, off for default</para>
+			/// <para>The native net times its layers. MxNet times its operators by its profiler, which is shared by the process,</para>
+			/// <para>so that the times are of an operator type and include the other nets profiled at the same time.</para>
+			/// </summary>
+			virtual void SetProfiling(bool enable);
+			/// <summary>Times of the layers in the last profiled forward, in the order they ran or by operator</summary>
+			virtual std::vector<LayerTime> GetLayerTimes() const;
+			/// <summary>Rolling p50, p95 and p99 latencies of Forward, which are kept whether profiling or not</summary>
+			virtual LatencyStats GetLatencyStats() const;
+			/// <summary>The latency stats and the layer times as JSON</summary>
+			/// <param name="file">JSON file written too if not empty</param>
+			std::string DumpProfile(const std::string& file = "");
+
+			/// <summary>Settings of the following forwards, frameworks ignore what they do not support</summary>
+			virtual void SetForwardSettings(const ForwardSettings& settings);
+			virtual ForwardSettings GetForwardSettings() const;
+			/// <summary>Settings the auto tuning times, only the default settings if the framework has none</summary>
+			virtual std::vector<ForwardSettings> GetTuningSpace() const;
 
 			/// <summary>Get the framework</summary>
 			virtual dnn::Framework& GetFramework() = 0;
 			__declspec(property(get = GetFramework)) dnn::Framework& Framework;
 
 			static Ptr<Net> Load(const dnn::Model& model, const Context& ctx = Context());
+			/// <summary>File of the tuned settings next to the weight of the model</summary>
+			static std::string TuneFile(const dnn::Model& model);
+
+		protected:
+			/// <summary>Set the tuned settings of the inputs, nets call it after binding and reshaping</summary>
+			void ApplyTunedSettings(const std::vector<DataLayer>& inputs);
+
+			std::map<std::string, ForwardSettings> tuned_settings; // by the framework and the inputs, shared by the clones
 		};
 
 		CHAOS_API Ptr<Net> LoadMxNet(const Model& model, const Context& ctx = Context());
+		/// <summary>Load the MxNet symbol and params into the native CPU net of ChaosCV, see dnn/layers</summary>
+		CHAOS_API Ptr<Net> LoadNative(const Model& model, const Context& ctx = Context());
+		/// <summary>
+		/// <para>Load the compiled net of CompileNative into the native CPU net</para>
+		/// <para>model.weight is the .cnet file, which is mapped read only so that its weights are used in place and shared</para>
+		/// <para>by the processes, or its bytes if not from file.</para>
+		/// </summary>
+		CHAOS_API Ptr<Net> LoadCompiled(const Model& model, const Context& ctx = Context());
+		/// <summary>Compile the MxNet symbol and params into a single .cnet file for LoadCompiled</summary>
+		/// <param name="file">File of the compiled net</param>
+		CHAOS_API void CompileNative(const Model& model, const std::string& file);
 		//CHAOS_API Ptr<Net> LoadVINO(const Model& model, const Context& ctx = Context());
 
 
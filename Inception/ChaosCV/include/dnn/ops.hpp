@@ -0,0 +1,54 @@
+#pragma once
+
+#include "core/core.hpp"
+#include "dnn/tensor.hpp"
+
+namespace chaos
+{
+	namespace dnn
+	{
+		// Math on float tensors without going through cv::Mat
+		// Rows are the elements of the last dim. Inputs may be views, F16 or BF16, they are flattened to F32 first.
+		// An empty dst is created by dst.allocator, otherwise dst must be a continue tensor of the result shape and
+		// depth, which is written in place, so dst can be src for in-place ops or a view such as a Slice.
+		// Each call runs the AVX2, SSE4.1 or scalar kernels, the widest the CPU supports, and large tensors are
+		// processed in parallel.
+
+		/// <summary>Instruction set of the kernels, "AVX2", "SSE4.1" or "Scalar"</summary>
+		CHAOS_API std::string GetOpsISA();
+
+		/// <summary>Softmax along axis, the last dim by default, e.g. axis 1 for the channels of NCHW</summary>
+		CHAOS_API void Softmax(const Tensor& src, Tensor& dst, int axis = -1);
+		/// <summary>Divide each row by its L2 norm, zero rows stay zero</summary>
+		CHAOS_API void L2Normalize(const Tensor& src, Tensor& dst);
+
+		/// <summary>
+		/// <para>Dot products of the rows of a and b, dst has one element per row of a</para>
+		/// <para>b has the same rows as a, or one row which is broadcasted, e.g. a gallery against a query</para>
+		/// </summary>
+		CHAOS_API void Dot(const Tensor& a, const Tensor& b, Tensor& dst);
+		/// <summary>Cosine similarities of the rows of a and b, b is broadcasted as Dot</summary>
+		CHAOS_API void Cosine(const Tensor& a, const Tensor& b, Tensor& dst);
+
+		/// <summary>
+		/// <para>dst = a + b, a - b, a * b or a / b elementwise</para>
+		/// <para>b has the size of a, or of the trailing dims of a and is repeated, e.g. one row subtracted from all rows</para>
+		/// </summary>
+		CHAOS_API void Add(const Tensor& a, const Tensor& b, Tensor& dst);
+		CHAOS_API void Sub(const Tensor& a, const Tensor& b, Tensor& dst);
+		CHAOS_API void Mul(const Tensor& a, const Tensor& b, Tensor& dst);
+		CHAOS_API void Div(const Tensor& a, const Tensor& b, Tensor& dst);
+		/// <summary>dst = src * alpha + beta</summary>
+		CHAOS_API void Scale(const Tensor& src, float alpha, float beta, Tensor& dst);
+		/// <summary>y += alpha * x in place, y must be a continue F32 tensor with the size of x</summary>
+		CHAOS_API void Axpy(float alpha, const Tensor& x, Tensor& y);
+
+		/// <summary>Index of the max element of each row, dst is S64 with one element per row</summary>
+		CHAOS_API void ArgMax(const Tensor& src, Tensor& dst);
+		/// <summary>
+		/// <para>The k largest (or smallest) elements of each row in order, ties in the order of the indices</para>
+		/// <para>values is F32 and indices is S64, both rows x k. The rows are partially sorted.</para>
+		/// </summary>
+		CHAOS_API void TopK(const Tensor& src, int k, Tensor& values, Tensor& indices, bool largest = true);
+	}
+}
@@ -2,20 +2,58 @@
 
 #include "dnn/tensor.hpp"
 #include "dnn/net.hpp"
+#include "test/test_data.hpp"
 
 namespace chaos
 {
 	namespace dnn
 	{
+		enum ExportFormat
+		{
+			EXPORT_MXNET, // .json and .params
+			EXPORT_COMPILED, // .json and .params, and the .cnet of CompileNative
+		};
+
 		class CHAOS_API Optimizer
 		{
 		public:
-			//virtual void Optimize() = 0;
 			virtual ~Optimizer() {}
 
+			/// <summary>Run all the passes below</summary>
+			virtual void Optimize() = 0;
+			/// <summary>Fold BatchNorm into the weight and bias of the Convolution or FullyConnected before it</summary>
 			virtual void MergeBatchNorm() = 0;
+			/// <summary>Remove Dropout, identity, _copy and BlockGrad, which do nothing for inference</summary>
+			virtual void RemoveIdentity() = 0;
+			/// <summary>
+			/// <para>Fold the scalar ops and the per channel broadcast ops of a param after Convolution or FullyConnected</para>
+			/// <para>into its weight and bias, and merge chained scalar multiplies or adds into one op</para>
+			/// </summary>
+			virtual void MergeScale() = 0;
+
+			/// <summary>
+			/// <para>INT8 post training quantization of Convolution and FullyConnected for the native net, run it last</para>
+			/// <para>Each image of the calibration samples is forwarded to collect the range of the input of each layer, which</para>
+			/// <para>gives its __int8_scale__ and __int8_zero__ attributes. The weights are snapped to the INT8 grid of each output</para>
+			/// <para>channel, so that the exported model still runs in F32 by MxNet and in INT8 by the native net.</para>
+			/// <para>Grouped convolutions and layers of rows shorter than 32 stay in F32.</para>
+			/// </summary>
+			/// <param name="calibration">Calibration samples</param>
+			/// <param name="transform">Input tensor of an image</param>
+			/// <param name="max_samples">Samples used at most, 0 for all</param>
+			virtual void Quantize(const Ptr<test::DataLoader>& calibration, const std::function<Tensor(const Mat&)>& transform, size_t max_samples = 0) = 0;
+			/// <summary>
+			/// <para>Accuracy drift of the quantized net, by a VTest run of the F32 and the INT8 native nets on the pair list</para>
+			/// <para>The report gives the max ACC and the AUC of both and the cosine of their features, and is logged too.</para>
+			/// </summary>
+			/// <param name="output">Output layer of the features</param>
+			/// <param name="db">New folder of the two VTest databases, db/float and db/int8</param>
+			virtual std::string ReportDrift(const Ptr<test::DataLoader>& pair_list, const std::function<Tensor(const Mat&)>& transform,
+				const std::string& output, const std::string& db) = 0;
 
-			virtual void Export(const std::string& name) = 0;
+			/// <summary>Export the optimized net</summary>
+			/// <param name="name">Files name without the extension</param>
+			virtual void Export(const std::string& name, const ExportFormat& format = EXPORT_MXNET) = 0;
 
 			static Ptr<Optimizer> LoadMxNet(const Model& model);
 		};
@@ -9,7 +9,8 @@ namespace chaos
 		class CHAOS_API Registered
 		{
 		public:
-			static std::vector<Framework> frameworks;
+			/// <summary>Frameworks in the order they were registered, by the statics of any module</summary>
+			static std::vector<Framework>& Frameworks();
 			static Framework& Have(const std::string& name);
 		};
 
@@ -34,7 +35,7 @@ namespace chaos
 #define REGISTER_FRAMEWORK(name, stype, wtype, func)	\
   namespace _register_##name {							\
     static auto _##name = chaos::dnn::Register(#name)	\
-      .With(##stype, ##wtype, func);					\
+      .With(stype, wtype, func);									\
   }
 
 #ifdef USE_MXNET
@@ -0,0 +1,207 @@
+#pragma once
+
+#include "core/core.hpp"
+
+#include <intrin.h>
+
+namespace chaos
+{
+	namespace dnn
+	{
+		// Integer vectors of the quantized kernels. Dot adds the products of N unsigned and N signed bytes to the
+		// 32 bit sums, through the 16 bit pair sums of maddubs, which can not saturate while the unsigned bytes
+		// stay within [0, 127].
+		struct Int8x1
+		{
+			using Type = int32_t;
+			using Bytes = int32_t;
+			static constexpr int N = 1;
+			static inline Bytes LoadU8(const uint8_t* ptr) { return *ptr; }
+			static inline Bytes LoadS8(const int8_t* ptr) { return *ptr; }
+			static inline Type Zero() { return 0; }
+			static inline Type Dot(Type sum, Bytes u, Bytes s) { return sum + u * s; }
+			static inline int32_t ReduceSum(Type v) { return v; }
+		};
+
+		struct Int8x16
+		{
+			using Type = __m128i;
+			using Bytes = __m128i;
+			static constexpr int N = 16;
+			static inline Bytes LoadU8(const uint8_t* ptr) { return _mm_loadu_si128((const __m128i*)ptr); }
+			static inline Bytes LoadS8(const int8_t* ptr) { return _mm_loadu_si128((const __m128i*)ptr); }
+			static inline Type Zero() { return _mm_setzero_si128(); }
+			static inline Type Dot(Type sum, Bytes u, Bytes s) { return _mm_add_epi32(sum, _mm_madd_epi16(_mm_maddubs_epi16(u, s), _mm_set1_epi16(1))); }
+			static inline int32_t ReduceSum(Type v)
+			{
+				v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+				return _mm_cvtsi128_si32(_mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1))));
+			}
+		};
+
+		struct Int8x32
+		{
+			using Type = __m256i;
+			using Bytes = __m256i;
+			static constexpr int N = 32;
+			static inline Bytes LoadU8(const uint8_t* ptr) { return _mm256_loadu_si256((const __m256i*)ptr); }
+			static inline Bytes LoadS8(const int8_t* ptr) { return _mm256_loadu_si256((const __m256i*)ptr); }
+			static inline Type Zero() { return _mm256_setzero_si256(); }
+			static inline Type Dot(Type sum, Bytes u, Bytes s) { return _mm256_add_epi32(sum, _mm256_madd_epi16(_mm256_maddubs_epi16(u, s), _mm256_set1_epi16(1))); }
+			static inline int32_t ReduceSum(Type v) { return Int8x16::ReduceSum(_mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1))); }
+		};
+
+		// Vector types of the kernels of ops and layers, each kernel is written once for all of them.
+		// Floor and Pow2 only serve Exp, which follows the cephes expf as NCNN does.
+		// Fma(a, b, c) is a * b + c, fused on AVX2 which comes with FMA3 here. Int8 is the integer vector of the same ISA.
+		struct Float1
+		{
+			using Type = float;
+			using Int8 = Int8x1;
+			static constexpr int N = 1;
+			static inline Type Load(const float* ptr) { return *ptr; }
+			static inline void Store(float* ptr, Type v) { *ptr = v; }
+			static inline Type Set(float v) { return v; }
+			static inline Type Add(Type a, Type b) { return a + b; }
+			static inline Type Sub(Type a, Type b) { return a - b; }
+			static inline Type Mul(Type a, Type b) { return a * b; }
+			static inline Type Div(Type a, Type b) { return a / b; }
+			static inline Type Max(Type a, Type b) { return a > b ? a : b; }
+			static inline Type Min(Type a, Type b) { return a < b ? a : b; }
+			static inline Type Fma(Type a, Type b, Type c) { return a * b + c; }
+			static inline Type Exp(Type v) { return std::exp(v); }
+			static inline float ReduceSum(Type v) { return v; }
+			static inline float ReduceMax(Type v) { return v; }
+		};
+
+		struct Float4
+		{
+			using Type = __m128;
+			using Int8 = Int8x16;
+			static constexpr int N = 4;
+			static inline Type Load(const float* ptr) { return _mm_loadu_ps(ptr); }
+			static inline void Store(float* ptr, Type v) { _mm_storeu_ps(ptr, v); }
+			static inline Type Set(float v) { return _mm_set1_ps(v); }
+			static inline Type Add(Type a, Type b) { return _mm_add_ps(a, b); }
+			static inline Type Sub(Type a, Type b) { return _mm_sub_ps(a, b); }
+			static inline Type Mul(Type a, Type b) { return _mm_mul_ps(a, b); }
+			static inline Type Div(Type a, Type b) { return _mm_div_ps(a, b); }
+			static inline Type Max(Type a, Type b) { return _mm_max_ps(a, b); }
+			static inline Type Min(Type a, Type b) { return _mm_min_ps(a, b); }
+			static inline Type Fma(Type a, Type b, Type c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+			static inline Type Floor(Type v) { return _mm_floor_ps(v); }
+			static inline Type Pow2(Type n) { return _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(_mm_cvtps_epi32(n), _mm_set1_epi32(127)), 23)); }
+			static inline Type Exp(Type v);
+			static inline float ReduceSum(Type v)
+			{
+				v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+				return _mm_cvtss_f32(_mm_add_ss(v, _mm_shuffle_ps(v, v, 1)));
+			}
+			static inline float ReduceMax(Type v)
+			{
+				v = _mm_max_ps(v, _mm_movehl_ps(v, v));
+				return _mm_cvtss_f32(_mm_max_ss(v, _mm_shuffle_ps(v, v, 1)));
+			}
+		};
+
+		struct Float8
+		{
+			using Type = __m256;
+			using Int8 = Int8x32;
+			static constexpr int N = 8;
+			static inline Type Load(const float* ptr) { return _mm256_loadu_ps(ptr); }
+			static inline void Store(float* ptr, Type v) { _mm256_storeu_ps(ptr, v); }
+			static inline Type Set(float v) { return _mm256_set1_ps(v); }
+			static inline Type Add(Type a, Type b) { return _mm256_add_ps(a, b); }
+			static inline Type Sub(Type a, Type b) { return _mm256_sub_ps(a, b); }
+			static inline Type Mul(Type a, Type b) { return _mm256_mul_ps(a, b); }
+			static inline Type Div(Type a, Type b) { return _mm256_div_ps(a, b); }
+			static inline Type Max(Type a, Type b) { return _mm256_max_ps(a, b); }
+			static inline Type Min(Type a, Type b) { return _mm256_min_ps(a, b); }
+			static inline Type Fma(Type a, Type b, Type c) { return _mm256_fmadd_ps(a, b, c); }
+			static inline Type Floor(Type v) { return _mm256_floor_ps(v); }
+			static inline Type Pow2(Type n) { return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23)); }
+			static inline Type Exp(Type v);
+			static inline float ReduceSum(Type v) { return Float4::ReduceSum(_mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1))); }
+			static inline float ReduceMax(Type v) { return Float4::ReduceMax(_mm_max_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1))); }
+		};
+
+		template<class V>
+		inline typename V::Type ExpPoly(typename V::Type x)
+		{
+			x = V::Min(V::Max(x, V::Set(-88.3762626647949f)), V::Set(88.3762626647949f));
+
+			// exp(x) = 2^n * exp(r), n = floor(x * log2(e) + 0.5), r = x - n * ln(2)
+			typename V::Type n = V::Floor(V::Add(V::Mul(x, V::Set(1.44269504088896341f)), V::Set(0.5f)));
+			x = V::Sub(x, V::Mul(n, V::Set(0.693359375f)));
+			x = V::Sub(x, V::Mul(n, V::Set(-2.12194440e-4f)));
+
+			typename V::Type y = V::Set(1.9875691500E-4f);
+			y = V::Add(V::Mul(y, x), V::Set(1.3981999507E-3f));
+			y = V::Add(V::Mul(y, x), V::Set(8.3334519073E-3f));
+			y = V::Add(V::Mul(y, x), V::Set(4.1665795894E-2f));
+			y = V::Add(V::Mul(y, x), V::Set(1.6666665459E-1f));
+			y = V::Add(V::Mul(y, x), V::Set(5.0000001201E-1f));
+			y = V::Add(V::Add(V::Mul(y, V::Mul(x, x)), x), V::Set(1.f));
+			return V::Mul(y, V::Pow2(n));
+		}
+		inline Float4::Type Float4::Exp(Type v) { return ExpPoly<Float4>(v); }
+		inline Float8::Type Float8::Exp(Type v) { return ExpPoly<Float8>(v); }
+
+		enum ISA { SCALAR, SSE41, AVX2 };
+		inline ISA GetISA()
+		{
+			static const ISA isa = cv::checkHardwareSupport(CV_CPU_AVX2) && cv::checkHardwareSupport(CV_CPU_FMA3) ? AVX2 : cv::checkHardwareSupport(CV_CPU_SSE4_1) ? SSE41 : SCALAR;
+			return isa;
+		}
+
+		// Call func with the widest vector type
+		template<class Func>
+		inline void Dispatch(Func&& func)
+		{
+			switch (GetISA())
+			{
+			case AVX2:
+				func(Float8());
+				break;
+			case SSE41:
+				func(Float4());
+				break;
+			default:
+				func(Float1());
+				break;
+			}
+		}
+
+		// Parallelism of ForEach on the calling thread, which the native net sets to its forward settings while forwarding
+		struct Parallelism
+		{
+			int threads = 0; // 0 for all the threads of cv::parallel_for_
+			size_t grain = 64 * 1024; // elements a loop shares at least
+		};
+		inline Parallelism& ThreadParallelism()
+		{
+			thread_local Parallelism parallelism;
+			return parallelism;
+		}
+
+		// Run func on [0, num) in parallel if there are enough elements to share
+		// func is taken as is, so that a loop too small to share does not wrap it into a std::function on the heap
+		template<class Func>
+		inline void ForEach(size_t num, size_t elems_per_item, const Func& func)
+		{
+			const Parallelism& parallelism = ThreadParallelism();
+			if (num > 1 && num * elems_per_item >= parallelism.grain && parallelism.threads != 1)
+			{
+				// As many stripes as threads so that at most that many threads run them
+				cv::parallel_for_(cv::Range(0, (int)num), [&](const cv::Range& range) {
+					for (int i = range.start; i < range.end; i++) func(i);
+				}, parallelism.threads > 0 ? parallelism.threads : -1.);
+			}
+			else
+			{
+				for (size_t i = 0; i < num; i++) func(i);
+			}
+		}
+	}
+}
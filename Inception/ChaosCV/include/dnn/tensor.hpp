@@ -7,6 +7,18 @@ namespace chaos
 {
 	namespace dnn
 	{
+		/// <summary>
+		/// <para>Memory layout of a 4 dims tensor, the shape is always N x C x H x W</para>
+		/// <para>NC4HW4 / NC8HW8 pack 4 / 8 channels into one pixel, channels are padded with zeros to a</para>
+		/// <para>multiple of the pack. The value of a packed layout is its pack.</para>
+		/// </summary>
+		enum Layout
+		{
+			NCHW = 0,	/// <summary>Planar, the default</summary>
+			NHWC = 1,	/// <summary>Interleaved as OpenCV images</summary>
+			NC4HW4 = 4,	/// <summary>Blocks of 4 channels</summary>
+			NC8HW8 = 8,	/// <summary>Blocks of 8 channels</summary>
+		};
 
 		/// <summary>
 		/// <para>Tensor</para>
@@ -16,59 +28,80 @@ namespace chaos
 		{
 		public:
 			Tensor();
-			Tensor(const Shape& shape, const Depth& depth, bool aligned = false, Allocator* allocator = nullptr);
-			Tensor(const Shape& shape, const Depth& depth, void* data, bool aligned = false, Allocator* allocator = nullptr);
+			Tensor(const Shape& shape, const Depth& depth, bool aligned = false, Allocator* allocator = nullptr, const Layout& layout = NCHW);
+			Tensor(const Shape& shape, const Depth& depth, void* data, bool aligned = false, Allocator* allocator = nullptr, const Layout& layout = NCHW);
 
 			Tensor(const Tensor& tensor);
+			/// <summary>Take over the data of tensor without touching the reference counter, tensor is left empty</summary>
+			Tensor(Tensor&& tensor) noexcept;
 
 			~Tensor();
 
 			Tensor& operator=(const Tensor& tensor);
+			Tensor& operator=(Tensor&& tensor) noexcept;
 
-			static Tensor Unroll(const std::vector<Mat>& vdata, bool rechannel = false, bool aligned = false, Allocator* allocator = nullptr);
+			static Tensor Unroll(const std::vector<Mat>& vdata, bool rechannel = false, bool aligned = false, Allocator* allocator = nullptr, const Layout& layout = NCHW);
 			std::vector<Mat> Rollup(bool rechannel = false) const;
 
-			// Return a Mat which data pointer is to Tensor.data
+			/// <summary>
+			/// <para>Return a Mat which data pointer is to Tensor.data</para>
+			/// <para>NHWC gives N x H x W with C channels, NC4HW4 / NC8HW8 give N x C/pack x H x W with pack channels</para>
+			/// </summary>
 			operator Mat() const;
 
 			/// <summary>
 			/// <para>Create a tensor</para>
 			/// <para>The buffer size is aligned to 4 bytes</para>
 			/// </summary>
-			void Create(const Shape& shape, const Depth& depth, bool aligned, Allocator* allocator);
+			void Create(const Shape& shape, const Depth& depth, bool aligned, Allocator* allocator, const Layout& layout = NCHW);
 
 			void Release();
 
 			template<class Type>
-			inline Type At(const std::vector<int>& position) const
+			inline Type At(const Shape& position) const
 			{
-				CHECK_EQ(dims, position.size());
+				CHECK_EQ(dims, position.Size());
 				for (int i = 0; i < dims; i++)
 				{
-					CHECK_LT(position[i], shape[i]);
-				}
-
-				std::vector<int> steps(dims, 1);
-				if (dims > 1) steps[dims - 2LL] = shape.back();
-				if (dims > 2) steps[dims - 3LL] = (int)cstep;
-				if (dims > 3)
-				{
-					for (int i = dims - 4; i >= 0; i--)
-					{
-						steps[i] = steps[i + 1LL] * shape[i + 1LL];
-					}
+					CHECK(position[i] >= 0 && position[i] < shape[i]) << "Index " << position[i] << " out of range " << shape[i] << " at dim " << i;
 				}
 
+				// Channel c of a packed layout is lane c % pack of block c / pack
+				const int pack = Pack();
 				size_t offset = 0;
 				for (int i = 0; i < dims; i++)
 				{
-					offset += (size_t)steps[i] * position[i];
+					offset += i == 1 && pack > 1 ? steps[1] * (position[1] / pack) + position[1] % pack : steps[i] * position[i];
 				}
 				return *((Type*)data + offset);
 			}
 
+			/// <summary>Channels in one block, 1 if the layout is not packed</summary>
+			inline int Pack() const { return layout >= NC4HW4 ? (int)layout : 1; }
+
+			/// <summary>Return itself if continue, otherwise a continue NCHW copy</summary>
 			Tensor Flatten() const;
-			Tensor Reshape(const Shape& new_shape);
+			/// <summary>
+			/// <para>Return itself if already in new_layout, otherwise a copy in new_layout</para>
+			/// <para>Float tensors are repacked by SSE 4x4 transposes</para>
+			/// </summary>
+			Tensor ToLayout(const Layout& new_layout, bool aligned = false, Allocator* new_allocator = nullptr) const;
+			/// <summary>
+			/// <para>Reshape to new_shape with the same number of elements</para>
+			/// <para>The result is a view sharing the buffer, a not continue tensor is flattened first</para>
+			/// </summary>
+			Tensor Reshape(const Shape& new_shape) const;
+			/// <summary>
+			/// <para>View of [begin, end) along axis, sharing the buffer</para>
+			/// <para>Slice(0, ...) gives batch sub-ranges, Slice(1, ...) channel sub-views of NCHW</para>
+			/// <para>Channel slices of packed layouts must begin at a block</para>
+			/// </summary>
+			Tensor Slice(int axis, int begin, int end) const;
+			/// <summary>
+			/// <para>Convert the elements to new_depth, F32 &lt;-&gt; F16 / BF16 only</para>
+			/// <para>Return itself if the depth is the same, otherwise a continue tensor</para>
+			/// </summary>
+			Tensor ConvertTo(const Depth& new_depth, Allocator* new_allocator = nullptr) const;
 
 			size_t Total() const;
 			size_t Size() const;
@@ -80,6 +113,7 @@ namespace chaos
 			CHAOS_API friend inline std::ostream& operator<<(std::ostream& stream, const Tensor& tensor);
 
 			void* data; // pointer to the data
+			void* buffer; // pointer to the allocated buffer, views have data inside it
 			Allocator* allocator; // the allocator
 
 			// pointer to the reference counter
@@ -90,9 +124,72 @@ namespace chaos
 			int dims; // dims;
 
 			Depth depth;
+			Layout layout;
 
 			bool aligned;
-			size_t cstep; // channel step;
+			size_t cstep; // channel step, the step of a block in packed layouts and of an image in NHWC
+			size_t steps[Shape::MAX_DIMS]; // step of each dim in elements
+
+		private:
+			// Step of a channel, or of a block / an image, by shape, layout and aligned
+			void UpdateCStep();
+			// Steps of a tensor laid out by shape, layout and cstep
+			void UpdateSteps();
+		};
+
+		/// <summary>
+		/// <para>Typed view of a tensor with N dims, e.g. TensorView&lt;float, 4&gt; for NCHW outputs</para>
+		/// <para>Shape and steps are cached when the view is created, so an access is just a dot product of the</para>
+		/// <para>position and the steps. Bounds are checked in debug builds only. The tensor must outlive the view.</para>
+		/// </summary>
+		template<class Type, int N>
+		class TensorView
+		{
+		public:
+			TensorView(const Tensor& tensor) : data((Type*)tensor.data)
+			{
+				CHECK_EQ(N, tensor.dims);
+				CHECK_EQ(1, tensor.Pack()) << "Packed layouts can not be viewed by steps";
+				CHECK_EQ(sizeof(Type), (size_t)(tensor.depth >> DEPTH_SHIFT));
+				for (int i = 0; i < N; i++)
+				{
+					shape[i] = tensor.shape[i];
+					steps[i] = tensor.steps[i];
+				}
+			}
+
+			/// <summary>Element at position (index...)</summary>
+			template<class ... Index>
+			inline Type& operator()(Index ... index) const
+			{
+				static_assert(sizeof...(Index) == N, "TensorView needs N indices");
+				return data[Offset<N>({ (int)index... })];
+			}
+
+			/// <summary>Pointer to the row of the last dim at (index...), elements in the row are steps[N - 1] apart</summary>
+			template<class ... Index>
+			inline Type* Row(Index ... index) const
+			{
+				static_assert(sizeof...(Index) == N - 1, "TensorView::Row needs N - 1 indices");
+				return data + Offset<N - 1>({ (int)index... });
+			}
+
+			Type* data;
+			int shape[N];
+			size_t steps[N]; // in elements
+
+		private:
+			template<int M>
+			inline size_t Offset(const int(&position)[M]) const
+			{
+				size_t offset = 0;
+				for (int i = 0; i < M; i++)
+				{
+					DCHECK(position[i] >= 0 && position[i] < shape[i]) << "Index " << position[i] << " out of range " << shape[i] << " at dim " << i;
+					offset += steps[i] * position[i];
+				}
+				return offset;
+			}
 		};
 	}
 }
\ No newline at end of file
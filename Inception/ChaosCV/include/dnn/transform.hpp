@@ -0,0 +1,44 @@
+#pragma once
+
+#include "core/core.hpp"
+#include "dnn/tensor.hpp"
+
+namespace chaos
+{
+	namespace dnn
+	{
+		/// <summary>
+		/// <para>Convert 8-bit interleaved images to a NCHW float tensor in one pass</para>
+		/// <para>tensor(n, c) = (images[n](c) - mean[c]) * scale[c], c is the channel of the tensor (after swap_rb)</para>
+		/// <para>Replaces convertTo, transpose and the cv::split in Unroll. SSSE3 is used if the CPU supports it,</para>
+		/// <para>and the images are converted in parallel.</para>
+		/// </summary>
+		/// <param name="images">CV_8UC1 ~ CV_8UC4 images with the same size and type</param>
+		/// <param name="swap_rb">Reverse the channel order, e.g. BGR to RGB</param>
+		/// <param name="transpose">Transpose the images, the tensor is N x C x W x H</param>
+		CHAOS_API Tensor ImagesToTensor(const std::vector<Mat>& images, const Scalar& mean = Scalar(), const Scalar& scale = Scalar::all(1),
+			bool swap_rb = false, bool transpose = false, bool aligned = false, Allocator* allocator = nullptr);
+
+		/// <summary>
+		/// <para>Convert a NCHW float tensor (at most 4 channels) to interleaved float images</para>
+		/// <para>The images are allocated by OpenCV, SSE is used to interleave the channels</para>
+		/// </summary>
+		/// <param name="swap_rb">Reverse the channel order, e.g. RGB to BGR</param>
+		CHAOS_API std::vector<Mat> TensorToImages(const Tensor& tensor, bool swap_rb = false);
+
+		/// <summary>
+		/// <para>Convert n floats to IEEE half floats, rounded to nearest even</para>
+		/// <para>F16C is used if the CPU supports it</para>
+		/// </summary>
+		CHAOS_API void FloatToHalf(const float* src, uint16_t* dst, size_t n);
+		/// <summary>Convert n IEEE half floats to floats, F16C is used if the CPU supports it</summary>
+		CHAOS_API void HalfToFloat(const uint16_t* src, float* dst, size_t n);
+		/// <summary>
+		/// <para>Convert n floats to bfloat16, rounded to nearest even and NaN kept quiet</para>
+		/// <para>AVX2 is used if the CPU supports it</para>
+		/// </summary>
+		CHAOS_API void FloatToBFloat(const float* src, uint16_t* dst, size_t n);
+		/// <summary>Convert n bfloat16 to floats, AVX2 is used if the CPU supports it</summary>
+		CHAOS_API void BFloatToFloat(const uint16_t* src, float* dst, size_t n);
+	}
+}
@@ -12,6 +12,7 @@ namespace chaos
 		public:
 			virtual ~Clusterer() {};
 
+			/// <summary>Add one feature (1 x dims) or a batch of features (n x dims)</summary>
 			virtual void Add(const dnn::Tensor& feat) = 0;
 			virtual dnn::Tensor Cluster() = 0;
 
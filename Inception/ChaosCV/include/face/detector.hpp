@@ -3,6 +3,8 @@
 #include "face/face_info.hpp"
 #include "dnn/net.hpp"
 
+#include <future>
+
 namespace chaos
 {
 	namespace face
@@ -14,6 +16,20 @@ namespace chaos
 
 			virtual std::vector<FaceInfo> Detect(const Mat& image) = 0;
 			virtual void Detect(const Mat& image, FaceInfo& info) = 0;
+			/// <summary>
+			/// <para>Queue the detection of a frame of a stream, the futures are ready in the order of the calls</para>
+			/// <para>Detectors of several stages run them on a pipeline, so that the frames overlap, see GroupNet. The image</para>
+			/// <para>must not be changed until its future is ready. Detects at once for default.</para>
+			/// </summary>
+			virtual std::future<std::vector<FaceInfo>> DetectAsync(const Mat& image)
+			{
+				std::promise<std::vector<FaceInfo>> promise;
+				promise.set_value(Detect(image));
+				return promise.get_future();
+			}
+
+			/// <summary>Statistics of the nets of the detector, e.g. executor cache hit rates</summary>
+			virtual std::string Report() const { return std::string(); }
 
 			/// <summary>
 			/// <para>Load Mutil-Task CNN models for face detection</para>
@@ -26,6 +42,8 @@ namespace chaos
 			/// <para>@ NMS: nms threshold, 0.5 for default</para>
 			/// <para>@ DoLandmark: return landmark if true, true for default</para>
 			/// <para>@ Confidence: confidence vector for pnet, rnet and onet, [0.5,0.7,0.7] for default</para>
+			/// <para>@ QueueDepth: frames queued at most by each net of DetectAsync, 2 for default</para>
+			/// <para>@ PNetThreads: PNet executors evaluating the levels of the image pyramid concurrently, 0 for default as cv::getNumThreads()</para>
 			/// </summary>
 			/// <param name="folder">Models folder, include 3 models must be named PNet, RNet and ONet</param>
 			/// <param name="ctx">Device type and id</param>
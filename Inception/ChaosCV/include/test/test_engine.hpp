@@ -21,8 +21,21 @@ namespace chaos
 
 			void SetForward(const std::function<dnn::Tensor(const Mat&)>& func) { forward = func; }
 			__declspec(property(put = SetForward)) std::function<Mat(const Mat&)> Forward;
+
+			/// <summary>
+			/// <para>Depth of the features kept in the database, F32 (default), F16 or BF16</para>
+			/// <para>Half precision features halve the database and the reading of it</para>
+			/// </summary>
+			void SetFeatureDepth(const Depth& depth);
+			__declspec(property(put = SetFeatureDepth)) Depth FeatureDepth;
 		protected:
+			// Feature in feature_depth as a database value
+			std::string Encode(const dnn::Tensor& feat) const;
+			// Float feature of a database value, refers to buffer if feature_depth is F32
+			Mat Decode(const std::string& buffer) const;
+
 			std::function<dnn::Tensor(const Mat&)> forward;
+			Depth feature_depth = F32;
 
 			std::string folder;
 		};
@@ -75,11 +88,8 @@ namespace chaos
 			Ptr<DataLoader> gallery;
 			Ptr<DataLoader> genuine;
 
-			// Default measure method is COS distance
-			std::function<double(const Mat&, const Mat&)> measure = [](const Mat& f1, const Mat& f2) {
-				auto dis = f1.dot(f2) / sqrt(f1.dot(f1)) / sqrt(f2.dot(f2));
-				return (dis + 1.) / 2.;
-			};
+			// Empty measure is COS distance mapped to [0, 1], computed by the dnn ops
+			std::function<double(const Mat&, const Mat&)> measure;
 
 			CumulativeTabel cumulative;
 			ConfusionMat confusion;
@@ -102,11 +112,8 @@ namespace chaos
 			static Ptr<VTest> Load(const std::string& db);
 		protected:
 			Ptr<DataLoader> pair_list;
-			// Default measure method is COS distance
-			std::function<double(const Mat&, const Mat&)> measure = [](const Mat& f1, const Mat& f2) {
-				auto dis = f1.dot(f2) / sqrt(f1.dot(f1)) / sqrt(f2.dot(f2));
-				return (dis + 1.) / 2.;
-			};
+			// Empty measure is COS distance mapped to [0, 1], computed by the dnn ops
+			std::function<double(const Mat&, const Mat&)> measure;
 			ConfusionTable confusion;
 		};
 	}
@@ -19,10 +19,21 @@ namespace chaos
 			//LP,	///<summary> L_p distance, p is given by metric_arg</summary>
 		};
 
+		/// <summary>Add N x dims vectors in F32, F16 or BF16</summary>
 		virtual void Add(const dnn::Tensor& data) = 0;
 
 		virtual void Search(const dnn::Tensor& data, int k, dnn::Tensor& distances, dnn::Tensor& labels) = 0;
 
 		static Ptr<FastSearcher> CreateFlat(int dims, const Method& method = L2);
+		/// <summary>
+		/// <para>Flat searcher keeps the gallery in memory from allocator, e.g. LargePageAllocator</para>
+		/// <para>for huge page backed galleries. Only IP and L2 are supported.</para>
+		/// </summary>
+		static Ptr<FastSearcher> CreateFlat(int dims, Allocator* allocator, const Method& method = L2);
+		/// <summary>
+		/// <para>Flat searcher keeps the gallery in half floats, half of the memory of CreateFlat</para>
+		/// <para>Queries stay in float. Only IP and L2 are supported.</para>
+		/// </summary>
+		static Ptr<FastSearcher> CreateHalf(int dims, const Method& method = L2);
 	};
 }
\ No newline at end of file
@@ -30,9 +30,15 @@ namespace chaos
 	/// <summary>Refer to happynear</summary>
 	CHAOS_API std::vector<int> SoftNMS(std::vector<ObjectRect>& objects, double overlap_rate, double min_confidence,
 		IoUType iou_type = IOU_UNION, WeightType weight_type = WEIGHT_LINEAR);
+	/// <summary>SoftNMS into picked, whose capacity is reused, so that a loop over frames does not allocate</summary>
+	CHAOS_API void SoftNMS(std::vector<ObjectRect>& objects, std::vector<int>& picked, double overlap_rate, double min_confidence,
+		IoUType iou_type = IOU_UNION, WeightType weight_type = WEIGHT_LINEAR);
 
 	CHAOS_API Mat Crop(const Mat& src, const Rect& roi, const Size& size,
 		int flags = cv::INTER_LINEAR, int border_type = cv::BORDER_CONSTANT, const Scalar& border_value = 0);
+	/// <summary>Crop into dst, the buffer of dst is reused if its size and type already match</summary>
+	CHAOS_API void Crop(const Mat& src, Mat& dst, const Rect& roi, const Size& size,
+		int flags = cv::INTER_LINEAR, int border_type = cv::BORDER_CONSTANT, const Scalar& border_value = 0);
 
 	CHAOS_API void MakeRectSquare(Rect& rect);
 
@@ -1,9 +1,102 @@
 #include "core/allocator.hpp"
 
+#include <set>
+
 namespace chaos
 {
+	static thread_local const char* current_tag = nullptr;
+
+	AllocationTag::AllocationTag(const char* tag, bool fallback) : previous(current_tag)
+	{
+		if (!fallback || !current_tag) current_tag = tag;
+	}
+	AllocationTag::~AllocationTag()
+	{
+		current_tag = previous;
+	}
+	const char* AllocationTag::Current()
+	{
+		return current_tag;
+	}
+
+
+	double AllocatorStats::HitRate() const
+	{
+		return hits + misses > 0 ? (double)hits / (hits + misses) : 0.;
+	}
+
+	size_t AllocatorStats::SlackBytes() const
+	{
+		return live_bytes - std::min(live_bytes, requested_bytes);
+	}
+
+	std::string AllocatorStats::ToString() const
+	{
+		std::stringstream stream;
+		stream << "Live: " << live_bytes << " bytes, Peak: " << peak_bytes << " bytes, Slack: " << SlackBytes() << " bytes" << std::endl
+			<< "Budgets: " << num_budgets << " (" << budget_bytes << " bytes)" << std::endl
+			<< "Hits: " << hits << ", Misses: " << misses << ", Hit rate: " << HitRate();
+		for (const auto& tag : tags)
+		{
+			stream << std::endl << "  [" << tag.first << "] Live: " << tag.second.live_bytes
+				<< " bytes, Peak: " << tag.second.peak_bytes
+				<< " bytes, Mallocs: " << tag.second.num_mallocs
+				<< ", Total: " << tag.second.total_bytes << " bytes";
+		}
+		return stream.str();
+	}
+
+
 	Allocator::~Allocator() {}
 
+	void Allocator::EnableStats(bool enable)
+	{
+		std::lock_guard<std::mutex> guard(stats_lock);
+		stats_enabled = enable;
+	}
+
+	AllocatorStats Allocator::GetStats() const
+	{
+		std::lock_guard<std::mutex> guard(stats_lock);
+		return stats;
+	}
+
+	void Allocator::RecordMalloc(size_t size, size_t requested, const char* tag, bool hit)
+	{
+		if (!stats_enabled) return;
+
+		std::lock_guard<std::mutex> guard(stats_lock);
+		stats.live_bytes += size;
+		stats.peak_bytes = std::max(stats.peak_bytes, stats.live_bytes);
+		stats.requested_bytes += requested;
+		hit ? stats.hits++ : stats.misses++;
+
+		if (tag)
+		{
+			auto& tag_stats = stats.tags[tag];
+			tag_stats.live_bytes += size;
+			tag_stats.peak_bytes = std::max(tag_stats.peak_bytes, tag_stats.live_bytes);
+			tag_stats.num_mallocs++;
+			tag_stats.total_bytes += size;
+		}
+	}
+
+	void Allocator::RecordFree(size_t size, size_t requested, const char* tag)
+	{
+		if (!stats_enabled) return;
+
+		// Blocks allocated before the stats were enabled are not counted
+		std::lock_guard<std::mutex> guard(stats_lock);
+		stats.live_bytes -= std::min(stats.live_bytes, size);
+		stats.requested_bytes -= std::min(stats.requested_bytes, requested);
+
+		if (tag)
+		{
+			auto& tag_stats = stats.tags[tag];
+			tag_stats.live_bytes -= std::min(tag_stats.live_bytes, size);
+		}
+	}
+
 	PoolAllocator::PoolAllocator()
 	{
 		size_compare_ratio = 192;// 0.75f * 256
@@ -17,11 +110,11 @@ namespace chaos
 		{
 			LOG(ERROR) << "Pool allocator destroyed too early";
 
-			std::list<std::pair<size_t, void*>>::iterator it = payouts.begin();
+			std::list<Payout>::iterator it = payouts.begin();
 			for (; it != payouts.end(); it++)
 			{
-				void* ptr = it->second;
-				LOG(ERROR) << ptr << " still in use";
+				void* ptr = it->ptr;
+				LOG(ERROR) << ptr << " still in use" << (it->tag ? std::string(", tag ") + it->tag : "");
 				//fprintf(stderr, "%p still in use\n", ptr);
 			}
 
@@ -52,6 +145,8 @@ namespace chaos
 
 	void* PoolAllocator::FastMalloc(size_t size)
 	{
+		const char* tag = AllocationTag::Current();
+
 		budgets_lock.lock();
 
 		// find free budget
@@ -67,8 +162,9 @@ namespace chaos
 				budgets.erase(it);
 				budgets_lock.unlock();
 				payouts_lock.lock();
-				payouts.push_back(std::make_pair(bs, ptr));
+				payouts.push_back({ bs, ptr, size, tag });
 				payouts_lock.unlock();
+				RecordMalloc(bs, size, tag, true);
 				return ptr;
 			}
 		}
@@ -77,8 +173,9 @@ namespace chaos
 		// new
 		void* ptr = chaos::FastMalloc(size);
 		payouts_lock.lock();
-		payouts.push_back(std::make_pair(size, ptr));
+		payouts.push_back({ size, ptr, size, tag });
 		payouts_lock.unlock();
+		RecordMalloc(size, size, tag, false);
 		return ptr;
 	}
 
@@ -87,14 +184,16 @@ namespace chaos
 		payouts_lock.lock();
 
 		// return to budgets
-		std::list< std::pair<size_t, void*>>::iterator it = payouts.begin();
+		std::list<Payout>::iterator it = payouts.begin();
 		for (; it != payouts.end(); it++)
 		{
-			if (it->second == ptr)
+			if (it->ptr == ptr)
 			{
-				size_t size = it->first;
+				Payout payout = *it;
+				size_t size = it->size;
 				payouts.erase(it);
 				payouts_lock.unlock();
+				RecordFree(payout.size, payout.requested, payout.tag);
 				budgets_lock.lock();
 				budgets.push_back(std::make_pair(size, ptr));
 				budgets_lock.unlock();
@@ -108,6 +207,19 @@ namespace chaos
 		LOG(FATAL) << "Pool allocator get wild " << ptr;
 	}
 
+	AllocatorStats PoolAllocator::GetStats() const
+	{
+		AllocatorStats stats = Allocator::GetStats();
+
+		std::lock_guard<std::mutex> guard(budgets_lock);
+		stats.num_budgets = budgets.size();
+		for (const auto& budget : budgets)
+		{
+			stats.budget_bytes += budget.first;
+		}
+		return stats;
+	}
+
 
 	UnlockedPoolAllocator::UnlockedPoolAllocator()
 	{
@@ -122,11 +234,11 @@ namespace chaos
 		{
 			LOG(ERROR) << "Unlocked pool allocator destroyed too early";
 
-			std::list< std::pair<size_t, void*> >::iterator it = payouts.begin();
+			std::list<Payout>::iterator it = payouts.begin();
 			for (; it != payouts.end(); it++)
 			{
-				void* ptr = it->second;
-				LOG(ERROR) << ptr << " still in use";
+				void* ptr = it->ptr;
+				LOG(ERROR) << ptr << " still in use" << (it->tag ? std::string(", tag ") + it->tag : "");
 			}
 			LOG(FATAL) << "Pool allocator destroyed too early";
 		}
@@ -152,6 +264,8 @@ namespace chaos
 
 	void* UnlockedPoolAllocator::FastMalloc(size_t size)
 	{
+		const char* tag = AllocationTag::Current();
+
 		// find free budget
 		std::list<std::pair<size_t, void*>>::iterator it = budgets.begin();
 		for (; it != budgets.end(); it++)
@@ -163,26 +277,29 @@ namespace chaos
 			{
 				void* ptr = it->second;
 				budgets.erase(it);
-				payouts.push_back(std::make_pair(bs, ptr));
+				payouts.push_back({ bs, ptr, size, tag });
+				RecordMalloc(bs, size, tag, true);
 				return ptr;
 			}
 		}
 
 		// new
 		void* ptr = chaos::FastMalloc(size);
-		payouts.push_back(std::make_pair(size, ptr));
+		payouts.push_back({ size, ptr, size, tag });
+		RecordMalloc(size, size, tag, false);
 		return ptr;
 	}
 
 	void UnlockedPoolAllocator::FastFree(void* ptr)
 	{
 		// return to budgets
-		std::list<std::pair<size_t, void*>>::iterator it = payouts.begin();
+		std::list<Payout>::iterator it = payouts.begin();
 		for (; it != payouts.end(); it++)
 		{
-			if (it->second == ptr)
+			if (it->ptr == ptr)
 			{
-				size_t size = it->first;
+				RecordFree(it->size, it->requested, it->tag);
+				size_t size = it->size;
 				payouts.erase(it);
 				budgets.push_back(std::make_pair(size, ptr));
 				return;
@@ -193,4 +310,681 @@ namespace chaos
 		chaos::FastFree(ptr);
 		LOG(FATAL) << "Pool allocator get wild " << ptr;
 	}
+
+	AllocatorStats UnlockedPoolAllocator::GetStats() const
+	{
+		AllocatorStats stats = Allocator::GetStats();
+		stats.num_budgets = budgets.size();
+		for (const auto& budget : budgets)
+		{
+			stats.budget_bytes += budget.first;
+		}
+		return stats;
+	}
+
+
+	// Header in front of every block from SizeClassPoolAllocator, 32 bytes
+	// The header size keeps the returned pointer aligned to MALLOC_ALIGN
+	struct BlockHeader
+	{
+		size_t capacity;
+		size_t requested;
+		const char* tag;
+		unsigned int magic;
+		unsigned int reserved;
+	};
+	constexpr size_t BLOCK_HEADER_SIZE = 2 * MALLOC_ALIGN;
+	static_assert(sizeof(BlockHeader) <= BLOCK_HEADER_SIZE, "Block header must fit in BLOCK_HEADER_SIZE bytes");
+
+	constexpr unsigned int PAYOUT_MAGIC = 0xC4A05B1Cu;
+	constexpr unsigned int BUDGET_MAGIC = 0xC4A05F8Eu;
+	constexpr unsigned int CACHED_MAGIC = 0xC4A05C2Du; // in a magazine of CachedAllocator, still a payout of its pool
+
+	static inline BlockHeader* GetHeader(const void* ptr)
+	{
+		return (BlockHeader*)((uchar*)ptr - BLOCK_HEADER_SIZE);
+	}
+
+	// floor(log2(size))
+	static inline int SizeClass(size_t size)
+	{
+		unsigned long idx = 0;
+		_BitScanReverse64(&idx, size | 1);
+		return (int)idx;
+	}
+
+	SizeClassPoolAllocator::SizeClassPoolAllocator() : nonempty(0), num_payouts(0)
+	{
+		size_compare_ratio = 192;// 0.75f * 256
+	}
+
+	SizeClassPoolAllocator::~SizeClassPoolAllocator()
+	{
+		Clear();
+
+		if (num_payouts != 0)
+		{
+			LOG(FATAL) << "Size class pool allocator destroyed too early, " << num_payouts << " blocks still in use";
+		}
+	}
+
+	void SizeClassPoolAllocator::Clear()
+	{
+		budgets_lock.lock();
+
+		for (auto& bucket : buckets)
+		{
+			for (auto& budget : bucket)
+			{
+				chaos::FastFree(GetHeader(budget.second));
+			}
+			bucket.clear();
+		}
+		nonempty = 0;
+
+		budgets_lock.unlock();
+	}
+
+	void SizeClassPoolAllocator::SetSizeCompareRatio(float scr)
+	{
+		CHECK(0.f < scr && scr < 1.f) << "Invalid size compare ratio " << scr;
+		size_compare_ratio = (unsigned int)(scr * 256);
+	}
+
+	size_t SizeClassPoolAllocator::BlockSize(const void* ptr)
+	{
+		return GetHeader(ptr)->capacity;
+	}
+
+	void* SizeClassPoolAllocator::FastMalloc(size_t size)
+	{
+		const char* tag = AllocationTag::Current();
+		int k = SizeClass(size);
+
+		budgets_lock.lock();
+
+		// The smallest budget >= size is either in bucket k,
+		// or the first one of the next non-empty bucket
+		auto bucket = &buckets[k];
+		auto it = bucket->lower_bound(size);
+		if (it == bucket->end())
+		{
+			unsigned long long higher = k < 63 ? nonempty & ~((2ull << k) - 1) : 0;
+			unsigned long j = 0;
+			if (_BitScanForward64(&j, higher))
+			{
+				bucket = &buckets[j];
+				it = bucket->begin();
+			}
+		}
+
+		// size_compare_ratio ~ 100%
+		if (it != bucket->end() && ((it->first * size_compare_ratio) >> 8) <= size)
+		{
+			void* ptr = it->second;
+			bucket->erase(it);
+			if (bucket->empty())
+			{
+				nonempty &= ~(1ull << (bucket - buckets));
+			}
+			budgets_lock.unlock();
+
+			BlockHeader* header = GetHeader(ptr);
+			header->requested = size;
+			header->tag = tag;
+			header->magic = PAYOUT_MAGIC;
+			num_payouts++;
+			RecordMalloc(header->capacity, size, tag, true);
+			return ptr;
+		}
+		budgets_lock.unlock();
+
+		// new
+		BlockHeader* header = (BlockHeader*)chaos::FastMalloc(size + BLOCK_HEADER_SIZE);
+		header->capacity = size;
+		header->requested = size;
+		header->tag = tag;
+		header->magic = PAYOUT_MAGIC;
+		num_payouts++;
+		RecordMalloc(size, size, tag, false);
+		return (uchar*)header + BLOCK_HEADER_SIZE;
+	}
+
+	void SizeClassPoolAllocator::FastFree(void* ptr)
+	{
+		BlockHeader* header = GetHeader(ptr);
+		if (header->magic != PAYOUT_MAGIC)
+		{
+			LOG(FATAL) << "Size class pool allocator get wild " << ptr;
+		}
+		header->magic = BUDGET_MAGIC;
+		num_payouts--;
+		RecordFree(header->capacity, header->requested, header->tag);
+
+		int k = SizeClass(header->capacity);
+
+		// return to budgets
+		budgets_lock.lock();
+		buckets[k].insert(std::make_pair(header->capacity, ptr));
+		nonempty |= 1ull << k;
+		budgets_lock.unlock();
+	}
+
+	AllocatorStats SizeClassPoolAllocator::GetStats() const
+	{
+		AllocatorStats stats = Allocator::GetStats();
+
+		std::lock_guard<std::mutex> guard(budgets_lock);
+		for (const auto& bucket : buckets)
+		{
+			stats.num_budgets += bucket.size();
+			for (const auto& budget : bucket)
+			{
+				stats.budget_bytes += budget.first;
+			}
+		}
+		return stats;
+	}
+
+
+	struct CachedAllocator::Registry
+	{
+		std::mutex lock;
+		std::set<Magazine*> magazines;
+		SizeClassPoolAllocator* pool; // nullptr after the allocator is destroyed
+	};
+
+	// Give a cached block back to the pool, which only takes payouts
+	static inline void ReturnCached(SizeClassPoolAllocator* pool, void* ptr)
+	{
+		GetHeader(ptr)->magic = PAYOUT_MAGIC;
+		pool->FastFree(ptr);
+	}
+
+	struct CachedAllocator::Magazine
+	{
+		Magazine(const Ptr<Registry>& registry, int depth) : registry(registry)
+		{
+			for (auto& slot : slots) slot.reserve(depth);
+
+			std::lock_guard<std::mutex> guard(registry->lock);
+			registry->magazines.insert(this);
+		}
+
+		// Called at thread exit
+		~Magazine()
+		{
+			std::lock_guard<std::mutex> guard(registry->lock);
+			if (registry->pool) Drain(registry->pool);
+			registry->magazines.erase(this);
+		}
+
+		void Drain(SizeClassPoolAllocator* pool)
+		{
+			for (auto& slot : slots)
+			{
+				for (auto ptr : slot) ReturnCached(pool, ptr);
+				slot.clear();
+			}
+		}
+
+		Ptr<Registry> registry;
+		std::vector<void*> slots[64]; // cached blocks of each size class
+	};
+
+	static std::atomic<size_t> num_cached_allocators(0);
+
+	CachedAllocator::CachedAllocator(int depth) : registry(new Registry()), id(++num_cached_allocators), depth(depth)
+	{
+		CHECK_GT(depth, 0);
+		size_compare_ratio = 192;// 0.75f * 256
+		registry->pool = &pool;
+	}
+
+	CachedAllocator::~CachedAllocator()
+	{
+		// No thread should use the allocator any more, so all magazines can be drained here
+		std::lock_guard<std::mutex> guard(registry->lock);
+		for (auto magazine : registry->magazines)
+		{
+			magazine->Drain(&pool);
+		}
+		registry->pool = nullptr;
+	}
+
+	void CachedAllocator::SetSizeCompareRatio(float scr)
+	{
+		CHECK(0.f < scr && scr < 1.f) << "Invalid size compare ratio " << scr;
+		size_compare_ratio = (unsigned int)(scr * 256);
+		pool.SetSizeCompareRatio(scr);
+	}
+
+	void CachedAllocator::Clear()
+	{
+		GetMagazine()->Drain(&pool);
+		pool.Clear();
+	}
+
+	CachedAllocator::Magazine* CachedAllocator::GetMagazine()
+	{
+		// <allocator id, magazine>, freed at thread exit
+		static thread_local std::map<size_t, std::unique_ptr<Magazine>> magazines;
+		static thread_local size_t last_id = 0;
+		static thread_local Magazine* last = nullptr;
+
+		if (last_id == id) return last;
+
+		auto it = magazines.find(id);
+		if (it == magazines.end())
+		{
+			// Drop the magazines of destroyed allocators
+			for (auto m = magazines.begin(); m != magazines.end();)
+			{
+				std::unique_lock<std::mutex> guard(m->second->registry->lock);
+				bool dead = m->second->registry->pool == nullptr;
+				guard.unlock();
+				m = dead ? magazines.erase(m) : std::next(m);
+			}
+			it = magazines.insert(std::make_pair(id, std::make_unique<Magazine>(registry, depth))).first;
+		}
+
+		last_id = id;
+		last = it->second.get();
+		return last;
+	}
+
+	void* CachedAllocator::FastMalloc(size_t size)
+	{
+		Magazine* magazine = GetMagazine();
+		const char* tag = AllocationTag::Current();
+
+		// Blocks accepted by size_compare_ratio are in [size, size * 256 / scr]
+		int first = SizeClass(size);
+		int last = std::min(63, SizeClass(((size << 8) + size_compare_ratio - 1) / size_compare_ratio));
+		for (int k = first; k <= last; k++)
+		{
+			auto& slot = magazine->slots[k];
+			// Latest freed first, it is likely still in cache
+			for (int i = (int)slot.size() - 1; i >= 0; i--)
+			{
+				size_t bs = SizeClassPoolAllocator::BlockSize(slot[i]);
+				if (bs >= size && ((bs * size_compare_ratio) >> 8) <= size)
+				{
+					void* ptr = slot[i];
+					slot[i] = slot.back();
+					slot.pop_back();
+
+					BlockHeader* header = GetHeader(ptr);
+					header->requested = size;
+					header->tag = tag;
+					header->magic = PAYOUT_MAGIC;
+					RecordMalloc(bs, size, tag, true);
+					return ptr;
+				}
+			}
+		}
+
+		void* ptr = pool.FastMalloc(size);
+		RecordMalloc(SizeClassPoolAllocator::BlockSize(ptr), size, tag, false);
+		return ptr;
+	}
+
+	void CachedAllocator::FastFree(void* ptr)
+	{
+		Magazine* magazine = GetMagazine();
+
+		// Same checks as the pool, a cached block keeps its header until it is handed out again,
+		// so a block freed twice or not from this allocator would be handed out to two callers
+		BlockHeader* header = GetHeader(ptr);
+		CHECK_EQ(PAYOUT_MAGIC, header->magic) << "Cached allocator get wild " << ptr;
+		CHECK_LE(header->requested, header->capacity) << "Cached allocator get a broken header " << ptr;
+		header->magic = CACHED_MAGIC;
+		RecordFree(header->capacity, header->requested, header->tag);
+
+		auto& slot = magazine->slots[SizeClass(header->capacity)];
+		if ((int)slot.size() >= depth)
+		{
+			// Return the older half to the shared pool
+			int half = std::max(1, depth / 2);
+			for (int i = 0; i < half; i++)
+			{
+				ReturnCached(&pool, slot[i]);
+			}
+			slot.erase(slot.begin(), slot.begin() + half);
+		}
+		slot.push_back(ptr);
+	}
+
+	AllocatorStats CachedAllocator::GetStats() const
+	{
+		AllocatorStats stats = Allocator::GetStats();
+		AllocatorStats pool_stats = pool.GetStats();
+		stats.num_budgets = pool_stats.num_budgets;
+		stats.budget_bytes = pool_stats.budget_bytes;
+		return stats;
+	}
+
+
+	ArenaAllocator::ArenaAllocator(size_t size) : offset(0), num_blocks(0), num_payouts(0), num_chunk_allocations(0),
+		used_bytes(0), peak_bytes(0), num_hits(0), num_grows(0)
+	{
+		Grow(size);
+	}
+
+	ArenaAllocator::~ArenaAllocator()
+	{
+		if (num_payouts != 0)
+		{
+			LOG(ERROR) << "Arena allocator destroyed too early, " << num_payouts << " blocks still in use";
+		}
+
+		for (auto& chunk : chunks)
+		{
+			chaos::FastFree(chunk.second);
+		}
+		chunks.clear();
+
+		if (num_payouts != 0)
+		{
+			LOG(FATAL) << "Arena allocator destroyed too early";
+		}
+	}
+
+	void ArenaAllocator::Reset()
+	{
+		CHECK_EQ(0, num_payouts) << "Arena allocator reset with blocks still in use";
+
+		peak_bytes = std::max(peak_bytes, used_bytes + offset);
+		used_bytes = 0;
+
+		// Merge all chunks into a single one which can hold everything of last round
+		if (chunks.size() > 1)
+		{
+			size_t total = 0;
+			for (auto& chunk : chunks)
+			{
+				total += chunk.first;
+				chaos::FastFree(chunk.second);
+			}
+			chunks.clear();
+			Grow(total);
+		}
+
+		offset = 0;
+		num_blocks = 0;
+		for (auto& tag : tags)
+		{
+			tag.second.live_bytes = 0;
+		}
+	}
+
+	void ArenaAllocator::Grow(size_t size)
+	{
+		size = AlignSize(std::max(size, (size_t)4096), 4096);
+		chunks.push_back(std::make_pair(size, (uchar*)chaos::FastMalloc(size)));
+		offset = 0;
+		num_chunk_allocations++;
+	}
+
+	void* ArenaAllocator::FastMalloc(size_t size)
+	{
+		size = AlignSize(size, MALLOC_ALIGN);
+		if (offset + size > chunks.back().first)
+		{
+			// Double the arena at least
+			size_t total = 0;
+			for (auto& chunk : chunks) total += chunk.first;
+			used_bytes += offset;
+			Grow(std::max(size, total));
+			num_grows++;
+		}
+		else
+		{
+			num_hits++;
+		}
+
+		void* ptr = chunks.back().second + offset;
+		offset += size;
+
+		const char* tag = AllocationTag::Current();
+		if (stats_enabled && tag)
+		{
+			auto& tag_stats = tags[tag];
+			tag_stats.live_bytes += size;
+			tag_stats.peak_bytes = std::max(tag_stats.peak_bytes, tag_stats.live_bytes);
+			tag_stats.num_mallocs++;
+			tag_stats.total_bytes += size;
+		}
+
+		num_blocks++;
+		num_payouts++;
+		return ptr;
+	}
+
+	void ArenaAllocator::FastFree(void* ptr)
+	{
+		CHECK_GT(num_payouts, 0) << "Arena allocator get wild " << ptr;
+		num_payouts--;
+	}
+
+	size_t ArenaAllocator::GetNumBlocks() const { return num_blocks; }
+	size_t ArenaAllocator::GetNumChunkAllocations() const { return num_chunk_allocations; }
+
+	AllocatorStats ArenaAllocator::GetStats() const
+	{
+		AllocatorStats stats;
+		stats.live_bytes = used_bytes + offset;
+		stats.peak_bytes = std::max(peak_bytes, stats.live_bytes);
+		stats.requested_bytes = stats.live_bytes;
+		stats.num_budgets = chunks.size();
+		for (const auto& chunk : chunks)
+		{
+			stats.budget_bytes += chunk.first;
+		}
+		stats.hits = num_hits;
+		stats.misses = num_grows;
+		stats.tags = tags;
+		return stats;
+	}
+}
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <fstream>
+
+#define MPOL_BIND 2
+#endif
+
+namespace chaos
+{
+#ifdef _WIN32
+	// Returns nullptr if failed, huge is true if the region is backed by large pages
+	static void* MapRegion(size_t size, int numa_node, bool& huge)
+	{
+		DWORD type = MEM_RESERVE | MEM_COMMIT;
+		size_t large_page = GetLargePageMinimum();
+		if (large_page)
+		{
+			size_t bytes = AlignSize(size, (int)large_page);
+			void* ptr = numa_node >= 0 ?
+				VirtualAllocExNuma(GetCurrentProcess(), NULL, bytes, type | MEM_LARGE_PAGES, PAGE_READWRITE, numa_node) :
+				VirtualAlloc(NULL, bytes, type | MEM_LARGE_PAGES, PAGE_READWRITE);
+			if (ptr)
+			{
+				huge = true;
+				return ptr;
+			}
+		}
+
+		// Normal pages are only aligned to the allocation granularity (64 KB), they gain nothing from a huge page alignment
+		huge = false;
+		return numa_node >= 0 ?
+			VirtualAllocExNuma(GetCurrentProcess(), NULL, size, type, PAGE_READWRITE, numa_node) :
+			VirtualAlloc(NULL, size, type, PAGE_READWRITE);
+	}
+
+	static void UnmapRegion(void* ptr, size_t size)
+	{
+		VirtualFree(ptr, 0, MEM_RELEASE);
+	}
+#else
+	static void* MapRegion(size_t size, int numa_node, bool& huge)
+	{
+		// Map one more huge page and trim it to get a HUGE_PAGE_SIZE aligned region
+		size_t mapped = size + HUGE_PAGE_SIZE;
+		uchar* base = (uchar*)mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (base == MAP_FAILED) return nullptr;
+
+		uchar* ptr = AlignPtr(base, HUGE_PAGE_SIZE);
+		if (ptr > base) munmap(base, ptr - base);
+		if (base + mapped > ptr + size) munmap(ptr + size, base + mapped - ptr - size);
+
+		huge = madvise(ptr, size, MADV_HUGEPAGE) == 0;
+		if (numa_node >= 0)
+		{
+			// Not faulted in yet, so all pages will come from numa_node
+			unsigned long mask[16] = { 0 };
+			CHECK_LT(numa_node, (int)sizeof(mask) * 8) << "Invalid NUMA node " << numa_node;
+			mask[numa_node / (sizeof(unsigned long) * 8)] |= 1ul << (numa_node % (sizeof(unsigned long) * 8));
+			if (syscall(SYS_mbind, ptr, size, MPOL_BIND, mask, sizeof(mask) * 8, 0) != 0)
+			{
+				LOG(WARNING) << "Failed to bind " << size << " bytes to NUMA node " << numa_node;
+			}
+		}
+		return ptr;
+	}
+
+	static void UnmapRegion(void* ptr, size_t size)
+	{
+		munmap(ptr, size);
+	}
+
+	// AnonHugePages of the mappings in /proc/self/smaps which overlap the ranges
+	// The kernel merges adjacent regions into one mapping, so the pages of a mapping are counted up to the bytes of the ranges in it
+	static size_t ReadAnonHugePages(const std::vector<std::pair<uintptr_t, uintptr_t>>& ranges)
+	{
+		std::ifstream smaps("/proc/self/smaps");
+		std::string line;
+		size_t bytes = 0, overlap = 0;
+		while (std::getline(smaps, line))
+		{
+			unsigned long long begin, end, kb;
+			if (sscanf(line.c_str(), "%llx-%llx ", &begin, &end) == 2)
+			{
+				overlap = 0;
+				for (const auto& range : ranges)
+				{
+					if (range.first < end && begin < range.second) overlap += std::min<uintptr_t>(end, range.second) - std::max<uintptr_t>(begin, range.first);
+				}
+			}
+			else if (overlap && sscanf(line.c_str(), "AnonHugePages: %llu kB", &kb) == 1)
+			{
+				bytes += std::min<size_t>(kb * 1024, overlap);
+			}
+		}
+		return bytes;
+	}
+#endif
+
+	LargePageAllocator::LargePageAllocator(int numa_node, size_t threshold) : numa_node(numa_node), threshold(threshold) {}
+
+	LargePageAllocator::~LargePageAllocator()
+	{
+		if (!regions.empty())
+		{
+			LOG(ERROR) << "Large page allocator destroyed too early";
+			for (auto& region : regions)
+			{
+				LOG(ERROR) << region.first << " still in use" << (region.second.tag ? std::string(", tag ") + region.second.tag : "");
+				region.second.size ? UnmapRegion(region.first, region.second.size) : chaos::FastFree(region.first);
+			}
+			LOG(FATAL) << "Large page allocator destroyed too early";
+		}
+	}
+
+	void* LargePageAllocator::FastMalloc(size_t size)
+	{
+		const char* tag = AllocationTag::Current();
+
+		Region region = { 0, size, tag, false };
+		void* ptr = nullptr;
+		if (size >= threshold)
+		{
+			region.size = AlignSize(size, HUGE_PAGE_SIZE);
+			ptr = MapRegion(region.size, numa_node, region.huge);
+			CHECK_NE(nullptr, ptr) << "Failed to map " << region.size << " bytes";
+		}
+		else
+		{
+			ptr = chaos::FastMalloc(size);
+		}
+
+		regions_lock.lock();
+		regions[ptr] = region;
+		regions_lock.unlock();
+
+		RecordMalloc(region.size ? region.size : size, size, tag, false);
+		return ptr;
+	}
+
+	void LargePageAllocator::FastFree(void* ptr)
+	{
+		regions_lock.lock();
+		auto it = regions.find(ptr);
+		if (it == regions.end())
+		{
+			regions_lock.unlock();
+			LOG(FATAL) << "Large page allocator get wild " << ptr;
+		}
+		Region region = it->second;
+		regions.erase(it);
+		regions_lock.unlock();
+
+		RecordFree(region.size ? region.size : region.requested, region.requested, region.tag);
+		region.size ? UnmapRegion(ptr, region.size) : chaos::FastFree(ptr);
+	}
+
+	size_t LargePageAllocator::GetNumHugePageBytes() const
+	{
+#ifdef _WIN32
+		// Large pages are committed and locked when they are allocated
+		std::lock_guard<std::mutex> guard(regions_lock);
+		size_t bytes = 0;
+		for (const auto& region : regions)
+		{
+			if (region.second.huge) bytes += region.second.size;
+		}
+		return bytes;
+#else
+		// madvise only allows huge pages, whether the kernel backs a region with them is known from smaps
+		std::vector<std::pair<uintptr_t, uintptr_t>> ranges;
+		regions_lock.lock();
+		for (const auto& region : regions)
+		{
+			if (region.second.size) ranges.push_back(std::make_pair((uintptr_t)region.first, (uintptr_t)region.first + region.second.size));
+		}
+		regions_lock.unlock();
+		return ranges.empty() ? 0 : ReadAnonHugePages(ranges);
+#endif
+	}
+
+	AllocatorStats LargePageAllocator::GetStats() const
+	{
+		AllocatorStats stats = Allocator::GetStats();
+
+		std::lock_guard<std::mutex> guard(regions_lock);
+		for (const auto& region : regions)
+		{
+			if (region.second.size)
+			{
+				stats.num_budgets++;
+				stats.budget_bytes += region.second.size;
+			}
+		}
+		return stats;
+	}
 }
\ No newline at end of file
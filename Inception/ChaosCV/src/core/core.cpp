@@ -5,13 +5,14 @@
 
 namespace chaos
 {
-	Shape::Shape() : shape(std::vector<int>()) {}
+	Shape::Shape() : shape{ 0 }, num(0) {}
 
 	void Shape::Swap(Shape& _shape)
 	{
-		shape.swap(_shape.shape);
+		std::swap(shape, _shape.shape);
+		std::swap(num, _shape.num);
 	}
-	size_t Shape::Size() const { return shape.size(); }
+	size_t Shape::Size() const { return num; }
 	const int& Shape::operator[](size_t idx) const { return shape[idx]; }
 	int& Shape::operator[](size_t idx) { return shape[idx]; }
 	inline std::ostream& operator<<(std::ostream& stream, const Shape& shape)
@@ -31,31 +32,31 @@ namespace chaos
 	}
 	const int* Shape::data() const
 	{
-		return shape.data();
+		return shape;
 	}
-	std::vector<int>::const_iterator Shape::begin() const
+	const int* Shape::begin() const
 	{
-		return shape.begin();
+		return shape;
 	}
-	std::vector<int>::iterator Shape::begin()
+	int* Shape::begin()
 	{
-		return shape.begin();
+		return shape;
 	}
-	std::vector<int>::const_iterator Shape::end() const
+	const int* Shape::end() const
 	{
-		return shape.end();
+		return shape + num;
 	}
-	std::vector<int>::iterator Shape::end()
+	int* Shape::end()
 	{
-		return shape.end();
+		return shape + num;
 	}
 	const int& Shape::back() const
 	{
-		return shape.back();
+		return shape[num - 1];
 	}
 	int& Shape::back()
 	{
-		return shape.back();
+		return shape[num - 1];
 	}
 
 
@@ -0,0 +1,130 @@
+#include "dnn/async.hpp"
+
+namespace chaos
+{
+	namespace dnn
+	{
+		AsyncNet::AsyncNet(const Ptr<Net>& net, const std::vector<std::string>& inputs, const std::vector<std::string>& outputs)
+			: net(net), inputs(inputs), shapes(inputs.size()), pending(0), stop(false)
+		{
+			CHECK(net) << "Empty net";
+			CHECK(!inputs.empty()) << "No input layer";
+			CHECK(!outputs.empty()) << "No output layer";
+
+			for (const auto& input : inputs)
+			{
+				input_handles.push_back(net->GetInputHandle(input));
+			}
+			for (const auto& output : outputs)
+			{
+				output_handles.push_back(net->GetOutputHandle(output));
+			}
+
+			worker = std::thread(&AsyncNet::Run, this);
+		}
+
+		AsyncNet::~AsyncNet()
+		{
+			{
+				std::lock_guard<std::mutex> lock(queue_lock);
+				stop = true;
+			}
+			queue_cond.notify_all();
+			worker.join();
+		}
+
+		std::future<std::vector<Tensor>> AsyncNet::ForwardAsync(const std::vector<Tensor>& inputs)
+		{
+			Request request;
+			request.inputs = inputs;
+			auto future = request.promise.get_future();
+			Push(std::move(request));
+			return future;
+		}
+
+		void AsyncNet::ForwardAsync(const std::vector<Tensor>& inputs, const Callback& done)
+		{
+			CHECK(done) << "Empty callback";
+
+			Request request;
+			request.inputs = inputs;
+			request.done = done;
+			Push(std::move(request));
+		}
+
+		void AsyncNet::Wait()
+		{
+			std::unique_lock<std::mutex> lock(queue_lock);
+			done_cond.wait(lock, [&]() { return pending == 0; });
+		}
+
+		void AsyncNet::Push(Request&& request)
+		{
+			CHECK_EQ(inputs.size(), request.inputs.size());
+			{
+				std::lock_guard<std::mutex> lock(queue_lock);
+				CHECK(!stop) << "Async net is stopped";
+				queue.push_back(std::move(request));
+				pending++;
+			}
+			queue_cond.notify_one();
+		}
+
+		void AsyncNet::Run()
+		{
+			while (true)
+			{
+				Request request;
+				{
+					std::unique_lock<std::mutex> lock(queue_lock);
+					queue_cond.wait(lock, [&]() { return stop || !queue.empty(); });
+					if (queue.empty()) return; // Stopped and drained
+
+					request = std::move(queue.front());
+					queue.pop_front();
+				}
+
+				// Reshape only the inputs which changed
+				std::vector<DataLayer> new_inputs;
+				for (size_t i = 0; i < inputs.size(); i++)
+				{
+					if (!(request.inputs[i].shape == shapes[i]))
+					{
+						new_inputs.push_back(DataLayer(inputs[i], request.inputs[i].shape));
+						shapes[i] = request.inputs[i].shape;
+					}
+				}
+				if (!new_inputs.empty()) net->Reshape(new_inputs);
+
+				for (size_t i = 0; i < inputs.size(); i++)
+				{
+					net->SetLayerData(input_handles[i], request.inputs[i]);
+				}
+				net->Forward();
+
+				// New outputs for each forward, the caller may still hold the last ones
+				std::vector<Tensor> outputs(output_handles.size());
+				for (size_t i = 0; i < output_handles.size(); i++)
+				{
+					net->GetLayerData(output_handles[i], outputs[i]);
+				}
+				request.inputs.clear();
+
+				if (request.done)
+				{
+					request.done(outputs);
+				}
+				else
+				{
+					request.promise.set_value(std::move(outputs));
+				}
+
+				{
+					std::lock_guard<std::mutex> lock(queue_lock);
+					pending--;
+				}
+				done_cond.notify_all();
+			}
+		}
+	}
+}
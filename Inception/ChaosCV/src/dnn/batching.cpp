@@ -0,0 +1,125 @@
+#include "dnn/batching.hpp"
+
+namespace chaos
+{
+	namespace dnn
+	{
+		BatchingNet::BatchingNet(const Ptr<Net>& net, const std::string& input, const std::vector<std::string>& outputs, int max_batch, double max_delay_ms)
+			: net(net), input(input), outputs(outputs), max_batch(max_batch), max_delay((int64)(max_delay_ms * 1000)), num_requests(0), num_batches(0), stop(false)
+		{
+			CHECK(net) << "Empty net";
+			CHECK_LT(0, max_batch);
+			CHECK(!outputs.empty()) << "No output layer";
+
+			input_handle = net->GetInputHandle(input);
+			for (const auto& output : outputs)
+			{
+				output_handles.push_back(net->GetOutputHandle(output));
+			}
+
+			worker = std::thread(&BatchingNet::Run, this);
+		}
+
+		BatchingNet::~BatchingNet()
+		{
+			{
+				std::lock_guard<std::mutex> lock(queue_lock);
+				stop = true;
+			}
+			queue_cond.notify_all();
+			worker.join();
+		}
+
+		std::future<std::vector<Tensor>> BatchingNet::Forward(const Tensor& sample)
+		{
+			CHECK(sample.dims == 3 || (sample.dims == 4 && sample.shape[0] == 1)) << "One sample of C x H x W, but got " << sample.shape;
+
+			Request request;
+			request.sample = sample;
+			request.arrival = std::chrono::steady_clock::now();
+			auto future = request.promise.get_future();
+			{
+				std::lock_guard<std::mutex> lock(queue_lock);
+				CHECK(!stop) << "Batching net is stopped";
+				queue.push_back(std::move(request));
+			}
+			queue_cond.notify_one();
+			return future;
+		}
+
+		size_t BatchingNet::GetNumRequests() const { return num_requests; }
+		size_t BatchingNet::GetNumBatches() const { return num_batches; }
+
+		void BatchingNet::Run()
+		{
+			std::vector<Request> batch;
+			while (true)
+			{
+				{
+					std::unique_lock<std::mutex> lock(queue_lock);
+					queue_cond.wait(lock, [&]() { return stop || !queue.empty(); });
+					if (queue.empty()) return; // Stopped and drained
+
+					// Wait for more samples until the batch is full or the oldest one is due
+					queue_cond.wait_until(lock, queue.front().arrival + max_delay, [&]() { return stop || (int)queue.size() >= max_batch; });
+
+					// Samples of another shape wait for the next batch
+					const Shape shape = queue.front().sample.shape;
+					while (!queue.empty() && (int)batch.size() < max_batch && queue.front().sample.shape == shape)
+					{
+						batch.push_back(std::move(queue.front()));
+						queue.pop_front();
+					}
+				}
+
+				Process(batch);
+				batch.clear();
+			}
+		}
+
+		void BatchingNet::Process(std::vector<Request>& batch)
+		{
+			const int num = (int)batch.size();
+			const Shape& sample = batch[0].sample.shape;
+
+			// N x C x H x W from C x H x W or 1 x C x H x W
+			Shape shape = { num, sample[sample.Size() - 3], sample[sample.Size() - 2], sample[sample.Size() - 1] };
+			if (!(shape == bound))
+			{
+				net->Reshape({ {input, shape} });
+				bound = shape;
+			}
+
+			Tensor data = Tensor(shape, F32);
+			const size_t sample_size = data.Size() / num;
+			for (int i = 0; i < num; i++)
+			{
+				const Tensor flattened = batch[i].sample.ConvertTo(F32).Flatten();
+				memcpy((float*)data.data + i * sample_size, flattened.data, sample_size * sizeof(float));
+			}
+
+			net->SetLayerData(input_handle, data);
+			net->Forward();
+
+			// Each caller gets views of its sample, the outputs of a batch share one buffer
+			std::vector<std::vector<Tensor>> results(num);
+			for (size_t o = 0; o < outputs.size(); o++)
+			{
+				Tensor output;
+				net->GetLayerData(output_handles[o], output);
+				CHECK_EQ(num, output.shape[0]) << "Output " << outputs[o] << " is not batched";
+				for (int i = 0; i < num; i++)
+				{
+					results[i].push_back(output.Slice(0, i, i + 1));
+				}
+			}
+
+			num_requests += num;
+			num_batches++;
+			for (int i = 0; i < num; i++)
+			{
+				batch[i].promise.set_value(std::move(results[i]));
+			}
+		}
+	}
+}
@@ -0,0 +1,52 @@
+#include "dnn/executor_pool.hpp"
+
+namespace chaos
+{
+	namespace dnn
+	{
+		ExecutorPool::ExecutorPool(const Ptr<Net>& net, int size)
+		{
+			CHECK(net) << "Empty net";
+			if (size <= 0) size = std::max(1, cv::getNumThreads());
+
+			executors.push_back(net);
+			for (int i = 1; i < size; i++)
+			{
+				executors.push_back(net->Clone());
+			}
+
+			for (const auto& executor : executors)
+			{
+				free_executors.push_back(executor.get());
+			}
+		}
+
+		ExecutorPool::~ExecutorPool()
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			CHECK_EQ(executors.size(), free_executors.size()) << "Executors are still in use when the pool is destroyed";
+		}
+
+		Ptr<Net> ExecutorPool::Acquire()
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			cond.wait(guard, [&]() { return !free_executors.empty(); });
+
+			Net* net = free_executors.back();
+			free_executors.pop_back();
+			// The deleter does not free the executor but returns it to the pool
+			return Ptr<Net>(net, [this](Net* net) { Release(net); });
+		}
+
+		int ExecutorPool::GetSize() const { return (int)executors.size(); }
+
+		void ExecutorPool::Release(Net* net)
+		{
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				free_executors.push_back(net);
+			}
+			cond.notify_one();
+		}
+	}
+}
@@ -0,0 +1,280 @@
+#include "dnn/gemm.hpp"
+#include "dnn/simd.hpp"
+
+namespace chaos
+{
+	namespace dnn
+	{
+		// Panels of A are MR rows and panels of B are NR columns, both in the order of k,
+		// so that the micro kernel reads them straight. K is blocked by KC to keep the panels in cache
+		// and N is cut into tiles of NC columns, one task each.
+		template<class V>
+		struct GemmKernel
+		{
+			static constexpr int MR = 4;
+			static constexpr int NR = 2 * V::N;
+			static constexpr int KC = 256;
+			static constexpr int NC = 32 * NR;
+
+			// Rows [0, m) of A, padded with zeros to a multiple of MR
+			static void PackA(const float* A, int lda, int m, int kc, float* packed)
+			{
+				for (int i = 0; i < m; i += MR)
+				{
+					for (int k = 0; k < kc; k++)
+					{
+						for (int r = 0; r < MR; r++)
+						{
+							*packed++ = i + r < m ? A[(size_t)(i + r) * lda + k] : 0.f;
+						}
+					}
+				}
+			}
+
+			// Columns [0, n) of B, padded with zeros to a multiple of NR
+			static void PackB(const float* B, int ldb, bool trans_b, int n, int kc, float* packed)
+			{
+				for (int j = 0; j < n; j += NR)
+				{
+					const int cols = std::min(NR, n - j);
+					for (int k = 0; k < kc; k++)
+					{
+						int c = 0;
+						if (trans_b)
+						{
+							for (; c < cols; c++) packed[c] = B[(size_t)(j + c) * ldb + k];
+						}
+						else
+						{
+							const float* row = B + (size_t)k * ldb + j;
+							for (; c < cols; c++) packed[c] = row[c];
+						}
+						for (; c < NR; c++) packed[c] = 0.f;
+						packed += NR;
+					}
+				}
+			}
+
+			// MR x NR tile of C, the first block of K starts from the bias, the others accumulate
+			static void Micro(int kc, const float* pa, const float* pb, float* C, int ldc, int m, int n, bool accumulate, const float* bias)
+			{
+				typename V::Type c[MR][2];
+				for (int r = 0; r < MR; r++)
+				{
+					c[r][0] = c[r][1] = V::Set(0.f);
+				}
+
+				for (int k = 0; k < kc; k++, pa += MR, pb += NR)
+				{
+					typename V::Type b0 = V::Load(pb);
+					typename V::Type b1 = V::Load(pb + V::N);
+					for (int r = 0; r < MR; r++)
+					{
+						typename V::Type a = V::Set(pa[r]);
+						c[r][0] = V::Fma(a, b0, c[r][0]);
+						c[r][1] = V::Fma(a, b1, c[r][1]);
+					}
+				}
+
+				if (m == MR && n == NR)
+				{
+					for (int r = 0; r < MR; r++)
+					{
+						float* row = C + (size_t)r * ldc;
+						typename V::Type base0 = accumulate ? V::Load(row) : V::Set(bias ? bias[r] : 0.f);
+						typename V::Type base1 = accumulate ? V::Load(row + V::N) : V::Set(bias ? bias[r] : 0.f);
+						V::Store(row, V::Add(c[r][0], base0));
+						V::Store(row + V::N, V::Add(c[r][1], base1));
+					}
+				}
+				else
+				{
+					float tile[MR * NR];
+					for (int r = 0; r < MR; r++)
+					{
+						V::Store(tile + r * NR, c[r][0]);
+						V::Store(tile + r * NR + V::N, c[r][1]);
+					}
+					for (int r = 0; r < m; r++)
+					{
+						float* row = C + (size_t)r * ldc;
+						const float base = bias ? bias[r] : 0.f;
+						for (int j = 0; j < n; j++)
+						{
+							row[j] = tile[r * NR + j] + (accumulate ? row[j] : base);
+						}
+					}
+				}
+			}
+
+			static void Run(int M, int N, int K, const float* A, int lda, const float* B, int ldb, bool trans_b, float* C, int ldc, const float* bias)
+			{
+				const int padded_m = (M + MR - 1) / MR * MR;
+				// Reused by the following calls on the thread, the workers get the pointer
+				thread_local std::vector<float> packing;
+				packing.resize((size_t)padded_m * std::min(K, KC));
+				float* packed_a = packing.data();
+				const int tiles = (N + NC - 1) / NC;
+
+				for (int k0 = 0; k0 < K; k0 += KC)
+				{
+					const int kc = std::min(KC, K - k0);
+					const bool accumulate = k0 > 0;
+					PackA(A + k0, lda, M, kc, packed_a);
+
+					ForEach(tiles, (size_t)M * NC * kc / 64, [&](size_t t) {
+						const int j0 = (int)t * NC;
+						const int n = std::min(NC, N - j0);
+
+						thread_local std::vector<float> packed_b;
+						packed_b.resize((size_t)(n + NR - 1) / NR * NR * kc);
+						PackB(trans_b ? B + (size_t)j0 * ldb + k0 : B + (size_t)k0 * ldb + j0, ldb, trans_b, n, kc, packed_b.data());
+
+						for (int i = 0; i < M; i += MR)
+						{
+							for (int j = 0; j < n; j += NR)
+							{
+								Micro(kc, packed_a + (size_t)i * kc, packed_b.data() + (size_t)j * kc, C + (size_t)i * ldc + j0 + j, ldc,
+									std::min(MR, M - i), std::min(NR, n - j), accumulate, bias ? bias + i : nullptr);
+							}
+						}
+					});
+				}
+			}
+		};
+
+		// Rows of A and rows of B both run along K, so that the micro kernel dots MR rows of A with NR rows of B
+		// straight from memory. Tasks are blocks of MC rows of A and NC rows of B.
+		template<class I>
+		struct GemmU8S8Kernel
+		{
+			static constexpr int MR = 4;
+			static constexpr int NR = 2;
+			static constexpr int MC = 64;
+			static constexpr int NC = 64;
+
+			static void Micro(int K, const int8_t* A, int lda, const uint8_t* B, int ldb, int m, int n, int32_t sums[MR][NR])
+			{
+				// Rows past m and n repeat the last row and are dropped
+				const int8_t* a[MR];
+				const uint8_t* b[NR];
+				for (int r = 0; r < MR; r++) a[r] = A + (size_t)std::min(r, m - 1) * lda;
+				for (int c = 0; c < NR; c++) b[c] = B + (size_t)std::min(c, n - 1) * ldb;
+
+				typename I::Type acc[MR][NR];
+				for (int r = 0; r < MR; r++)
+				{
+					acc[r][0] = acc[r][1] = I::Zero();
+				}
+
+				int k = 0;
+				for (; k + I::N <= K; k += I::N)
+				{
+					typename I::Bytes b0 = I::LoadU8(b[0] + k);
+					typename I::Bytes b1 = I::LoadU8(b[1] + k);
+					for (int r = 0; r < MR; r++)
+					{
+						typename I::Bytes v = I::LoadS8(a[r] + k);
+						acc[r][0] = I::Dot(acc[r][0], b0, v);
+						acc[r][1] = I::Dot(acc[r][1], b1, v);
+					}
+				}
+
+				for (int r = 0; r < MR; r++)
+				{
+					for (int c = 0; c < NR; c++)
+					{
+						int32_t sum = I::ReduceSum(acc[r][c]);
+						for (int t = k; t < K; t++) sum += (int32_t)b[c][t] * a[r][t];
+						sums[r][c] = sum;
+					}
+				}
+			}
+
+			static void Run(int M, int N, int K, const int8_t* A, int lda, const uint8_t* B, int ldb, float* C, int ldc, bool trans_c,
+				const float* scale, const int32_t* offset, const float* bias)
+			{
+				const int row_blocks = (M + MC - 1) / MC;
+				const int col_blocks = (N + NC - 1) / NC;
+				ForEach((size_t)row_blocks * col_blocks, (size_t)MC * NC * K / 64, [&](size_t t) {
+					const int i0 = (int)(t / col_blocks) * MC;
+					const int j0 = (int)(t % col_blocks) * NC;
+					const int i1 = std::min(M, i0 + MC);
+					const int j1 = std::min(N, j0 + NC);
+
+					for (int i = i0; i < i1; i += MR)
+					{
+						for (int j = j0; j < j1; j += NR)
+						{
+							const int m = std::min(MR, i1 - i);
+							const int n = std::min(NR, j1 - j);
+							int32_t sums[MR][NR];
+							Micro(K, A + (size_t)i * lda, lda, B + (size_t)j * ldb, ldb, m, n, sums);
+
+							for (int r = 0; r < m; r++)
+							{
+								const int row = i + r;
+								for (int c = 0; c < n; c++)
+								{
+									const float value = (sums[r][c] - (offset ? offset[row] : 0)) * scale[row] + (bias ? bias[row] : 0.f);
+									if (trans_c) C[(size_t)(j + c) * ldc + row] = value;
+									else C[(size_t)row * ldc + j + c] = value;
+								}
+							}
+						}
+					}
+				});
+			}
+		};
+
+		void GemmU8S8(int M, int N, int K, const int8_t* A, int lda, const uint8_t* B, int ldb, float* C, int ldc, bool trans_c,
+			const float* scale, const int32_t* offset, const float* bias)
+		{
+			CHECK(M >= 0 && N >= 0 && K >= 0) << "Negative size " << M << " x " << N << " x " << K;
+			if (M == 0 || N == 0) return;
+
+			Dispatch([&](auto v) {
+				GemmU8S8Kernel<typename decltype(v)::Int8>::Run(M, N, K, A, lda, B, ldb, C, ldc, trans_c, scale, offset, bias);
+			});
+		}
+
+		void QuantizeRows(const float* src, int rows, int cols, int8_t* dst, float* scales, int32_t* sums)
+		{
+			for (int i = 0; i < rows; i++)
+			{
+				const float* row = src + (size_t)i * cols;
+				float max = 0.f;
+				for (int k = 0; k < cols; k++) max = std::max(max, std::abs(row[k]));
+
+				scales[i] = max / 127.f;
+				const float inv = max > 0.f ? 127.f / max : 0.f;
+				int32_t sum = 0;
+				for (int k = 0; k < cols; k++)
+				{
+					const int q = std::min(127, std::max(-127, (int)std::floor(row[k] * inv + 0.5f)));
+					dst[(size_t)i * cols + k] = (int8_t)q;
+					sum += q;
+				}
+				if (sums) sums[i] = sum;
+			}
+		}
+
+		void Gemm(int M, int N, int K, const float* A, int lda, const float* B, int ldb, bool trans_b, float* C, int ldc, const float* bias)
+		{
+			CHECK(M >= 0 && N >= 0 && K >= 0) << "Negative size " << M << " x " << N << " x " << K;
+			if (M == 0 || N == 0) return;
+			if (K == 0)
+			{
+				for (int i = 0; i < M; i++)
+				{
+					std::fill(C + (size_t)i * ldc, C + (size_t)i * ldc + N, bias ? bias[i] : 0.f);
+				}
+				return;
+			}
+
+			Dispatch([&](auto v) {
+				GemmKernel<decltype(v)>::Run(M, N, K, A, lda, B, ldb, trans_b, C, ldc, bias);
+			});
+		}
+	}
+}
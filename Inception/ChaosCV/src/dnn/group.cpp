@@ -1,9 +1,126 @@
 #include "dnn/group.hpp"
 
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <iomanip>
+#include <mutex>
+#include <thread>
+
 namespace chaos
 {
 	namespace dnn
 	{
+		/// <summary>Worker of a stage, which takes the frames from its queue and pushes them to the next stage</summary>
+		struct GroupNet::Stage
+		{
+			struct Frame
+			{
+				std::any frame;
+				std::promise<std::any> promise;
+				Callback done;
+			};
+
+			Stage(const std::string& name, const StageFunction& func, size_t capacity) : name(name), func(func), capacity(capacity)
+			{
+				start = std::chrono::steady_clock::now();
+				worker = std::thread(&Stage::Run, this);
+			}
+
+			// Stop after the queued frames are done, the next stage is stopped after this one
+			void Stop()
+			{
+				{
+					std::lock_guard<std::mutex> lock(queue_lock);
+					stop = true;
+				}
+				not_empty.notify_all();
+				worker.join();
+			}
+
+			void Push(Frame&& frame)
+			{
+				{
+					std::unique_lock<std::mutex> lock(queue_lock);
+					not_full.wait(lock, [&]() { return queue.size() < capacity; });
+					depth_sum += queue.size();
+					pushes++;
+					queue.push_back(std::move(frame));
+				}
+				not_empty.notify_one();
+			}
+
+			void Run()
+			{
+				while (true)
+				{
+					Frame frame;
+					{
+						std::unique_lock<std::mutex> lock(queue_lock);
+						not_empty.wait(lock, [&]() { return stop || !queue.empty(); });
+						if (queue.empty()) return; // Stopped and drained
+
+						frame = std::move(queue.front());
+						queue.pop_front();
+					}
+					not_full.notify_one();
+
+					const auto begin = std::chrono::steady_clock::now();
+					func(frame.frame);
+					const double during = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+					{
+						std::lock_guard<std::mutex> lock(queue_lock);
+						busy += during;
+						frames++;
+					}
+
+					if (next)
+					{
+						next->Push(std::move(frame));
+					}
+					else if (frame.done)
+					{
+						frame.done(frame.frame);
+					}
+					else
+					{
+						frame.promise.set_value(std::move(frame.frame));
+					}
+				}
+			}
+
+			StageStats GetStats()
+			{
+				std::lock_guard<std::mutex> lock(queue_lock);
+				StageStats stats;
+				stats.name = name;
+				stats.capacity = capacity;
+				stats.depth = queue.size();
+				stats.mean_depth = pushes ? (double)depth_sum / pushes : 0.;
+				stats.occupancy = busy / std::max(1e-9, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+				stats.frames = frames;
+				return stats;
+			}
+
+			std::string name;
+			StageFunction func;
+			size_t capacity;
+			Stage* next = nullptr;
+
+			std::deque<Frame> queue;
+			std::mutex queue_lock;
+			std::condition_variable not_empty;
+			std::condition_variable not_full;
+			bool stop = false;
+			std::thread worker;
+
+			std::chrono::steady_clock::time_point start;
+			double busy = 0.; // seconds
+			size_t frames = 0;
+			size_t pushes = 0;
+			size_t depth_sum = 0;
+		};
+
 		GroupNet::Load::Load(const Model& model, const Context& ctx) : model(model), ctx(ctx) {}
 		GroupNet::Load& GroupNet::Load::As(const std::string& _name)
 		{
@@ -16,6 +133,10 @@ namespace chaos
 		}
 
 		GroupNet::GroupNet() {}
+		GroupNet::~GroupNet()
+		{
+			StopPipeline();
+		}
 		GroupNet& GroupNet::Add(const std::string& name, const Model& model, const Context& ctx)
 		{
 			nets[name] = Net::Load(model, ctx);
@@ -32,6 +153,95 @@ namespace chaos
 			forward_func[name] = func;
 			return *this;
 		}
+		GroupNet& GroupNet::SetExecutorCache(const std::string& name, int capacity, bool bucketing)
+		{
+			CHECK(nets.find(name) != nets.end()) << "Unknown net " << name;
+			nets[name]->SetExecutorCache(capacity, bucketing);
+			return *this;
+		}
+
+		GroupNet& GroupNet::SetStage(const std::string& name, const StageFunction& func)
+		{
+			stage_func[name] = func;
+			return *this;
+		}
+		GroupNet& GroupNet::StartPipeline(const std::vector<std::string>& stages, size_t queue_depth)
+		{
+			std::lock_guard<std::mutex> guard(pipeline_lock);
+			if (pipelined) return *this;
+			CHECK(!stages.empty()) << "No stage";
+			CHECK_LT(0, queue_depth);
+
+			for (const auto& name : stages)
+			{
+				CHECK(stage_func.find(name) != stage_func.end()) << "No stage of " << name;
+				pipeline.push_back(std::make_shared<Stage>(name, stage_func[name], queue_depth));
+				if (pipeline.size() > 1) pipeline[pipeline.size() - 2]->next = pipeline.back().get();
+			}
+			pipelined = true;
+			return *this;
+		}
+		void GroupNet::StopPipeline()
+		{
+			std::lock_guard<std::mutex> guard(pipeline_lock);
+			pipelined = false;
+			for (auto& stage : pipeline)
+			{
+				stage->Stop();
+			}
+			pipeline.clear();
+		}
+		bool GroupNet::IsPipelined() const
+		{
+			return pipelined;
+		}
+		std::future<std::any> GroupNet::Push(std::any frame)
+		{
+			CHECK(!pipeline.empty()) << "Pipeline is not started";
+
+			Stage::Frame item;
+			item.frame = std::move(frame);
+			auto future = item.promise.get_future();
+			pipeline.front()->Push(std::move(item));
+			return future;
+		}
+		void GroupNet::Push(std::any frame, const Callback& done)
+		{
+			CHECK(!pipeline.empty()) << "Pipeline is not started";
+			CHECK(done) << "Empty callback";
+
+			Stage::Frame item;
+			item.frame = std::move(frame);
+			item.done = done;
+			pipeline.front()->Push(std::move(item));
+		}
+		std::vector<StageStats> GroupNet::GetStageStats() const
+		{
+			std::vector<StageStats> stats;
+			for (const auto& stage : pipeline)
+			{
+				stats.push_back(stage->GetStats());
+			}
+			return stats;
+		}
+
+		std::string GroupNet::Report() const
+		{
+			std::stringstream report;
+			for (const auto& net : nets)
+			{
+				CacheStats stats = net.second->GetCacheStats();
+				report << net.first << ": executor cache hit rate " << std::fixed << std::setprecision(2) << stats.HitRate() * 100 << "% ("
+					<< stats.hits << " hits, " << stats.misses << " misses, " << stats.evictions << " evictions)" << std::endl;
+			}
+			for (const auto& stats : GetStageStats())
+			{
+				report << stats.name << " stage: occupancy " << std::fixed << std::setprecision(2) << stats.occupancy * 100 << "%, mean queue depth "
+					<< stats.mean_depth << " of " << stats.capacity << ", " << stats.depth << " queued, " << stats.frames << " frames" << std::endl;
+			}
+			return report.str();
+		}
+
 		Ptr<Net>& GroupNet::operator[](const std::string& name)
 		{
 			return nets[name];
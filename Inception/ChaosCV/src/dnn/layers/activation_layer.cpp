@@ -0,0 +1,152 @@
+#include "dnn/layers/layer.hpp"
+#include "dnn/simd.hpp"
+
+namespace chaos
+{
+	namespace dnn
+	{
+		// Apply func to n elements, vector by vector then the tail
+		template<class V, class Func, class Tail>
+		static inline void Map(const float* src, float* dst, size_t n, Func&& func, Tail&& tail)
+		{
+			size_t i = 0;
+			for (; i + V::N <= n; i += V::N) V::Store(dst + i, func(V::Load(src + i)));
+			for (; i < n; i++) dst[i] = tail(src[i]);
+		}
+
+		/// <summary>Activation of MxNet, relu, sigmoid, tanh or softrelu elementwise</summary>
+		class ActivationLayer : public Layer
+		{
+		public:
+			ActivationLayer(const Attrs& attrs)
+			{
+				act_type = GetString(attrs, "act_type", "relu");
+				CHECK(act_type == "relu" || act_type == "sigmoid" || act_type == "tanh" || act_type == "softrelu") << "Unsupported act_type " << act_type;
+			}
+
+			std::vector<Shape> Reshape(const std::vector<Shape>& inputs) override { return { inputs[0] }; }
+			bool InPlace() const override { return true; }
+
+			void Forward(const std::vector<Tensor>& inputs, std::vector<Tensor>& outputs) override
+			{
+				const float* src = (const float*)inputs[0].data;
+				float* dst = (float*)outputs[0].data;
+				const size_t size = inputs[0].Size();
+				const size_t chunk = 16 * 1024;
+
+				Dispatch([&](auto v) {
+					using V = decltype(v);
+					using T = typename V::Type;
+					ForEach((size + chunk - 1) / chunk, chunk, [&](size_t c) {
+						const float* s = src + c * chunk;
+						float* d = dst + c * chunk;
+						const size_t n = std::min(chunk, size - c * chunk);
+						if (act_type == "relu")
+						{
+							Map<V>(s, d, n, [](T x) { return V::Max(x, V::Set(0.f)); }, [](float x) { return std::max(x, 0.f); });
+						}
+						else if (act_type == "sigmoid")
+						{
+							Map<V>(s, d, n, [](T x) { return V::Div(V::Set(1.f), V::Add(V::Set(1.f), V::Exp(V::Sub(V::Set(0.f), x)))); },
+								[](float x) { return 1.f / (1.f + std::exp(-x)); });
+						}
+						else if (act_type == "tanh")
+						{
+							// tanh(x) = 2 / (1 + exp(-2x)) - 1
+							Map<V>(s, d, n, [](T x) { return V::Sub(V::Div(V::Set(2.f), V::Add(V::Set(1.f), V::Exp(V::Mul(x, V::Set(-2.f))))), V::Set(1.f)); },
+								[](float x) { return std::tanh(x); });
+						}
+						else
+						{
+							for (size_t i = 0; i < n; i++) d[i] = s[i] > 20.f ? s[i] : std::log1p(std::exp(s[i]));
+						}
+					});
+				});
+			}
+
+		private:
+			std::string act_type;
+		};
+
+		/// <summary>
+		/// <para>LeakyReLU of MxNet, y = x if x &gt; 0, otherwise slope * x for leaky or slope * (exp(x) - 1) for elu</para>
+		/// <para>prelu learns one slope per channel, which is the weight gamma</para>
+		/// </summary>
+		class LeakyReLULayer : public Layer
+		{
+		public:
+			LeakyReLULayer(const Attrs& attrs)
+			{
+				act_type = GetString(attrs, "act_type", "leaky");
+				CHECK(act_type == "leaky" || act_type == "prelu" || act_type == "elu") << "Unsupported act_type " << act_type;
+				slope = GetFloat(attrs, "slope", 0.25f);
+			}
+
+			void SetWeights(const std::vector<Tensor>& weights) override
+			{
+				if (act_type != "prelu")
+				{
+					Layer::SetWeights(weights);
+					return;
+				}
+				CHECK_EQ(1, weights.size()) << "prelu takes gamma";
+				gamma = weights[0].ConvertTo(F32).Flatten();
+			}
+
+			std::vector<Shape> Reshape(const std::vector<Shape>& inputs) override
+			{
+				const Shape& input = inputs[0];
+				if (act_type == "prelu")
+				{
+					CHECK_LE(2, input.Size());
+					CHECK(gamma.Size() == 1 || (int)gamma.Size() == input[1]) << "gamma of " << gamma.shape << " mismatches the channels of " << input;
+				}
+				return { input };
+			}
+			bool InPlace() const override { return true; }
+
+			void Forward(const std::vector<Tensor>& inputs, std::vector<Tensor>& outputs) override
+			{
+				const Tensor& input = inputs[0];
+				const float* src = (const float*)input.data;
+				float* dst = (float*)outputs[0].data;
+
+				// Planes of one slope, the channels of prelu or chunks of the whole tensor
+				const bool per_channel = act_type == "prelu" && gamma.Size() > 1;
+				const size_t channels = per_channel ? input.shape[1] : 1;
+				const size_t plane = per_channel ? input.Size() / input.shape[0] / channels : 16 * 1024;
+				const size_t num = (input.Size() + plane - 1) / plane;
+
+				Dispatch([&](auto v) {
+					using V = decltype(v);
+					using T = typename V::Type;
+					ForEach(num, plane, [&](size_t p) {
+						const float* s = src + p * plane;
+						float* d = dst + p * plane;
+						const size_t n = std::min(plane, input.Size() - p * plane);
+						const float a = act_type == "prelu" ? ((const float*)gamma.data)[per_channel ? p % channels : 0] : slope;
+						const T va = V::Set(a);
+						if (act_type == "elu")
+						{
+							for (size_t i = 0; i < n; i++) d[i] = s[i] > 0.f ? s[i] : a * (std::exp(s[i]) - 1.f);
+						}
+						else
+						{
+							// max(x, 0) + a * min(x, 0)
+							Map<V>(s, d, n, [&](T x) { return V::Fma(va, V::Min(x, V::Set(0.f)), V::Max(x, V::Set(0.f))); },
+								[&](float x) { return x > 0.f ? x : a * x; });
+						}
+					});
+				});
+			}
+
+		private:
+			std::string act_type;
+			float slope;
+			Tensor gamma; // slopes of prelu
+		};
+
+		REGISTER_LAYER("Activation", ActivationLayer);
+		REGISTER_LAYER("LeakyReLU", LeakyReLULayer);
+	}
+}
@@ -0,0 +1,85 @@
+#include "dnn/layers/layer.hpp"
+#include "dnn/simd.hpp"
+
+namespace chaos
+{
+	namespace dnn
+	{
+		/// <summary>
+		/// <para>BatchNorm of MxNet in inference, normalized by the moving mean and variance</para>
+		/// <para>gamma, beta, mean and variance are folded into one scale and shift per channel when the weights are set</para>
+		/// </summary>
+		class BatchNormLayer : public Layer
+		{
+		public:
+			BatchNormLayer(const Attrs& attrs)
+			{
+				eps = GetFloat(attrs, "eps", 1e-3f);
+				fix_gamma = GetBool(attrs, "fix_gamma", true);
+				axis = GetInt(attrs, "axis", 1);
+			}
+
+			void SetWeights(const std::vector<Tensor>& weights) override
+			{
+				CHECK_EQ(4, weights.size()) << "BatchNorm takes gamma, beta, moving_mean and moving_var";
+				const Tensor gamma = weights[0].ConvertTo(F32).Flatten();
+				const Tensor beta = weights[1].ConvertTo(F32).Flatten();
+				const Tensor mean = weights[2].ConvertTo(F32).Flatten();
+				const Tensor var = weights[3].ConvertTo(F32).Flatten();
+
+				const size_t channels = mean.Size();
+				CHECK(gamma.Size() == channels && beta.Size() == channels && var.Size() == channels) << "Sizes of the BatchNorm weights mismatch";
+				scale.resize(channels);
+				shift.resize(channels);
+				for (size_t c = 0; c < channels; c++)
+				{
+					scale[c] = (fix_gamma ? 1.f : ((const float*)gamma.data)[c]) / std::sqrt(((const float*)var.data)[c] + eps);
+					shift[c] = ((const float*)beta.data)[c] - ((const float*)mean.data)[c] * scale[c];
+				}
+			}
+
+			std::vector<Shape> Reshape(const std::vector<Shape>& inputs) override
+			{
+				const Shape& input = inputs[0];
+				CHECK(axis >= 0 && axis < (int)input.Size()) << "Axis " << axis << " out of range of " << input;
+				CHECK_EQ(scale.size(), input[axis]) << "Input of " << input << " mismatches the channels of BatchNorm";
+				return { input };
+			}
+			bool InPlace() const override { return true; }
+
+			void Forward(const std::vector<Tensor>& inputs, std::vector<Tensor>& outputs) override
+			{
+				const Tensor& input = inputs[0];
+				const float* src = (const float*)input.data;
+				float* dst = (float*)outputs[0].data;
+
+				size_t inner = 1;
+				for (int i = axis + 1; i < input.dims; i++) inner *= input.shape[i];
+				const size_t channels = scale.size();
+
+				Dispatch([&](auto v) {
+					using V = decltype(v);
+					ForEach(input.Size() / inner, inner, [&](size_t p) {
+						const float* s = src + p * inner;
+						float* d = dst + p * inner;
+						const float a = scale[p % channels], b = shift[p % channels];
+						const typename V::Type va = V::Set(a), vb = V::Set(b);
+						size_t i = 0;
+						for (; i + V::N <= inner; i += V::N) V::Store(d + i, V::Fma(V::Load(s + i), va, vb));
+						for (; i < inner; i++) d[i] = s[i] * a + b;
+					});
+				});
+			}
+
+		private:
+			float eps;
+			bool fix_gamma;
+			int axis;
+
+			std::vector<float> scale;
+			std::vector<float> shift;
+		};
+
+		REGISTER_LAYER("BatchNorm", BatchNormLayer);
+	}
+}
@@ -0,0 +1,314 @@
+#include "dnn/layers/layer.hpp"
+#include "dnn/gemm.hpp"
+#include "dnn/simd.hpp"
+
+namespace chaos
+{
+	namespace dnn
+	{
+		// Depthwise convolution of one channel, the kernel taps are accumulated over the output plane one by one.
+		// Rows of a tap read the input at stride_w, which is a vector load when stride_w is 1.
+		template<class V>
+		static void DepthwiseChannel(const float* src, int H, int W, const float* weight, float bias, float* dst, int OH, int OW,
+			int kernel_h, int kernel_w, int stride_h, int stride_w, int pad_h, int pad_w, int dilate_h, int dilate_w)
+		{
+			for (int i = 0; i < OH * OW; i++) dst[i] = bias;
+
+			for (int ky = 0; ky < kernel_h; ky++)
+			{
+				for (int kx = 0; kx < kernel_w; kx++)
+				{
+					const float w = weight[ky * kernel_w + kx];
+					const typename V::Type vw = V::Set(w);
+
+					// Outputs [ox0, ox1) read inside the row
+					const int offset = kx * dilate_w - pad_w;
+					const int ox0 = offset >= 0 ? 0 : (-offset + stride_w - 1) / stride_w;
+					const int ox1 = std::min(OW, W - offset <= 0 ? 0 : (W - offset - 1) / stride_w + 1);
+					if (ox0 >= ox1) continue;
+
+					for (int oy = 0; oy < OH; oy++)
+					{
+						const int iy = oy * stride_h - pad_h + ky * dilate_h;
+						if (iy < 0 || iy >= H) continue;
+
+						const float* in = src + (size_t)iy * W + offset;
+						float* out = dst + (size_t)oy * OW;
+						int ox = ox0;
+						if (stride_w == 1)
+						{
+							for (; ox + V::N <= ox1; ox += V::N)
+							{
+								V::Store(out + ox, V::Fma(V::Load(in + ox), vw, V::Load(out + ox)));
+							}
+						}
+						for (; ox < ox1; ox++)
+						{
+							out[ox] += in[ox * stride_w] * w;
+						}
+					}
+				}
+			}
+		}
+
+		// Unfold channels x H x W to (channels x kernel_h x kernel_w) x (OH x OW) for the GEMM
+		static void Im2Col(const float* src, int channels, int H, int W, float* col, int OH, int OW,
+			int kernel_h, int kernel_w, int stride_h, int stride_w, int pad_h, int pad_w, int dilate_h, int dilate_w)
+		{
+			ForEach(channels, (size_t)kernel_h * kernel_w * OH * OW, [&](size_t c) {
+				const float* plane = src + c * H * W;
+				float* row = col + c * kernel_h * kernel_w * OH * OW;
+				for (int ky = 0; ky < kernel_h; ky++)
+				{
+					for (int kx = 0; kx < kernel_w; kx++)
+					{
+						const int offset = kx * dilate_w - pad_w;
+						const int ox0 = std::min(OW, offset >= 0 ? 0 : (-offset + stride_w - 1) / stride_w);
+						const int ox1 = std::max(ox0, std::min(OW, W - offset <= 0 ? 0 : (W - offset - 1) / stride_w + 1));
+						for (int oy = 0; oy < OH; oy++, row += OW)
+						{
+							const int iy = oy * stride_h - pad_h + ky * dilate_h;
+							if (iy < 0 || iy >= H)
+							{
+								memset(row, 0, OW * sizeof(float));
+								continue;
+							}
+
+							const float* in = plane + (size_t)iy * W + offset;
+							memset(row, 0, ox0 * sizeof(float));
+							if (stride_w == 1)
+							{
+								memcpy(row + ox0, in + ox0, (ox1 - ox0) * sizeof(float));
+							}
+							else
+							{
+								for (int ox = ox0; ox < ox1; ox++) row[ox] = in[ox * stride_w];
+							}
+							memset(row + ox1, 0, (OW - ox1) * sizeof(float));
+						}
+					}
+				}
+			});
+		}
+
+		/// <summary>
+		/// <para>2D convolution, grouped and depthwise included</para>
+		/// <para>Each group of each image is a GEMM of the weight and the im2col of the input, 1 x 1 kernels of stride 1</para>
+		/// <para>and no padding use the input as is. Depthwise convolutions run the direct kernel instead.</para>
+		/// <para>Ungrouped convolutions with the __int8_scale__ and __int8_zero__ attributes of Optimizer::Quantize run in INT8:</para>
+		/// <para>the input is quantized to H x W x C bytes, unfolded to a row of taps by output pixel, and dotted with the</para>
+		/// <para>weight quantized by filter in GemmU8S8.</para>
+		/// </summary>
+		class ConvolutionLayer : public Layer
+		{
+		public:
+			ConvolutionLayer(const Attrs& attrs)
+			{
+				std::vector<int> kernel = GetTuple(attrs, "kernel", {});
+				std::vector<int> stride = GetTuple(attrs, "stride", { 1, 1 });
+				std::vector<int> pad = GetTuple(attrs, "pad", { 0, 0 });
+				std::vector<int> dilate = GetTuple(attrs, "dilate", { 1, 1 });
+				CHECK(kernel.size() == 2 && stride.size() == 2 && pad.size() == 2 && dilate.size() == 2) << "Only 2D convolution is supported";
+
+				kernel_h = kernel[0]; kernel_w = kernel[1];
+				stride_h = stride[0]; stride_w = stride[1];
+				pad_h = pad[0]; pad_w = pad[1];
+				dilate_h = dilate[0]; dilate_w = dilate[1];
+				num_filter = GetInt(attrs, "num_filter", 0);
+				num_group = GetInt(attrs, "num_group", 1);
+				no_bias = GetBool(attrs, "no_bias", false);
+				CHECK_LT(0, num_filter);
+				CHECK_EQ(0, num_filter % num_group);
+
+				in_scale = GetFloat(attrs, "__int8_scale__", 0.f);
+				in_zero = GetInt(attrs, "__int8_zero__", 0);
+				quantized = in_scale > 0.f && num_group == 1;
+			}
+
+			void SetWeights(const std::vector<Tensor>& weights) override
+			{
+				CHECK_EQ((no_bias ? 1 : 2), weights.size()) << "Convolution takes weight" << (no_bias ? "" : " and bias");
+				weight = weights[0].ConvertTo(F32).Flatten();
+				CHECK(weight.dims == 4 && weight.shape[0] == num_filter && weight.shape[2] == kernel_h && weight.shape[3] == kernel_w)
+					<< "Weight of " << weight.shape << " mismatches the kernel";
+				if (!no_bias)
+				{
+					bias = weights[1].ConvertTo(F32).Flatten();
+					CHECK_EQ(num_filter, bias.Size());
+				}
+
+				if (quantized)
+				{
+					// Taps in the order of ky, kx and c as the unfolded input
+					const int C = weight.shape[1];
+					const int K = C * kernel_h * kernel_w;
+					std::vector<float> reordered((size_t)num_filter * K);
+					const float* w = (const float*)weight.data;
+					for (int f = 0; f < num_filter; f++)
+					{
+						for (int c = 0; c < C; c++)
+						{
+							for (int t = 0; t < kernel_h * kernel_w; t++)
+							{
+								reordered[(size_t)f * K + t * C + c] = w[((size_t)f * C + c) * kernel_h * kernel_w + t];
+							}
+						}
+					}
+
+					weight_q.resize(reordered.size());
+					out_scale.resize(num_filter);
+					offset.resize(num_filter);
+					QuantizeRows(reordered.data(), num_filter, K, weight_q.data(), out_scale.data(), offset.data());
+					for (int f = 0; f < num_filter; f++)
+					{
+						out_scale[f] *= in_scale;
+						offset[f] *= in_zero;
+					}
+				}
+			}
+
+			std::vector<Shape> Reshape(const std::vector<Shape>& inputs) override
+			{
+				const Shape& input = inputs[0];
+				CHECK_EQ(4, input.Size()) << "Convolution input must be N x C x H x W";
+				CHECK_EQ(input[1], weight.shape[1] * num_group) << "Input of " << input << " mismatches the weight of " << weight.shape;
+
+				const int OH = (input[2] + 2 * pad_h - dilate_h * (kernel_h - 1) - 1) / stride_h + 1;
+				const int OW = (input[3] + 2 * pad_w - dilate_w * (kernel_w - 1) - 1) / stride_w + 1;
+				CHECK(OH > 0 && OW > 0) << "Input of " << input << " is smaller than the kernel";
+				return { { input[0], num_filter, OH, OW } };
+			}
+
+			void Forward(const std::vector<Tensor>& inputs, std::vector<Tensor>& outputs) override
+			{
+				const Tensor& input = inputs[0];
+				Tensor& output = outputs[0];
+				const int N = input.shape[0], C = input.shape[1], H = input.shape[2], W = input.shape[3];
+				const int OH = output.shape[2], OW = output.shape[3];
+				const float* src = (const float*)input.data;
+				float* dst = (float*)output.data;
+				const float* w = (const float*)weight.data;
+				const float* b = no_bias ? nullptr : (const float*)bias.data;
+
+				if (quantized)
+				{
+					ForwardInt8(input, output);
+					return;
+				}
+
+				if (num_group == C && num_group == num_filter)
+				{
+					Dispatch([&](auto v) {
+						using V = decltype(v);
+						ForEach((size_t)N * C, (size_t)OH * OW * kernel_h * kernel_w, [&](size_t i) {
+							const size_t c = i % C;
+							DepthwiseChannel<V>(src + i * H * W, H, W, w + c * kernel_h * kernel_w, b ? b[c] : 0.f, dst + i * OH * OW, OH, OW,
+								kernel_h, kernel_w, stride_h, stride_w, pad_h, pad_w, dilate_h, dilate_w);
+						});
+					});
+					return;
+				}
+
+				const int group_channels = C / num_group;
+				const int group_filters = num_filter / num_group;
+				const int K = group_channels * kernel_h * kernel_w;
+				const bool pointwise = kernel_h == 1 && kernel_w == 1 && stride_h == 1 && stride_w == 1 && pad_h == 0 && pad_w == 0;
+
+				// Reused by the following calls on the thread
+				thread_local std::vector<float> col;
+				if (!pointwise) col.resize((size_t)K * OH * OW);
+
+				for (int n = 0; n < N; n++)
+				{
+					for (int g = 0; g < num_group; g++)
+					{
+						const float* in = src + ((size_t)n * C + (size_t)g * group_channels) * H * W;
+						if (!pointwise)
+						{
+							Im2Col(in, group_channels, H, W, col.data(), OH, OW, kernel_h, kernel_w, stride_h, stride_w, pad_h, pad_w, dilate_h, dilate_w);
+							in = col.data();
+						}
+						Gemm(group_filters, OH * OW, K, w + (size_t)g * group_filters * K, K, in, OH * OW, false,
+							dst + ((size_t)n * num_filter + (size_t)g * group_filters) * OH * OW, OH * OW, b ? b + g * group_filters : nullptr);
+					}
+				}
+			}
+
+		private:
+			void ForwardInt8(const Tensor& input, Tensor& output)
+			{
+				const int N = input.shape[0], C = input.shape[1], H = input.shape[2], W = input.shape[3];
+				const int OH = output.shape[2], OW = output.shape[3];
+				const int K = C * kernel_h * kernel_w;
+				const bool pointwise = kernel_h == 1 && kernel_w == 1 && stride_h == 1 && stride_w == 1 && pad_h == 0 && pad_w == 0;
+				const float inv_scale = 1.f / in_scale;
+				const int zero = in_zero;
+
+				// Reused by the following calls on the thread, the workers get the pointers
+				thread_local std::vector<uint8_t> image, rows;
+				image.resize((size_t)H * W * C);
+				if (!pointwise) rows.resize((size_t)OH * OW * K);
+				uint8_t* hwc = image.data();
+				uint8_t* taps = rows.data();
+
+				for (int n = 0; n < N; n++)
+				{
+					const float* src = (const float*)input.data + (size_t)n * C * H * W;
+					ForEach(H, (size_t)W * C, [&](size_t y) {
+						for (int x = 0; x < W; x++)
+						{
+							uint8_t* pixel = hwc + (y * W + x) * C;
+							for (int c = 0; c < C; c++) pixel[c] = QuantizeU8(src[((size_t)c * H + y) * W + x], inv_scale, zero);
+						}
+					});
+
+					// Row of the taps of each output pixel, the padding is the zero point
+					if (!pointwise)
+					{
+						ForEach(OH, (size_t)OW * K, [&](size_t oy) {
+							uint8_t* row = taps + oy * OW * K;
+							for (int ox = 0; ox < OW; ox++)
+							{
+								for (int ky = 0; ky < kernel_h; ky++)
+								{
+									const int iy = (int)oy * stride_h - pad_h + ky * dilate_h;
+									for (int kx = 0; kx < kernel_w; kx++, row += C)
+									{
+										const int ix = ox * stride_w - pad_w + kx * dilate_w;
+										if (iy < 0 || iy >= H || ix < 0 || ix >= W) memset(row, zero, C);
+										else memcpy(row, hwc + ((size_t)iy * W + ix) * C, C);
+									}
+								}
+							}
+						});
+					}
+
+					GemmU8S8(num_filter, OH * OW, K, weight_q.data(), K, pointwise ? hwc : taps, K,
+						(float*)output.data + (size_t)n * num_filter * OH * OW, OH * OW, false,
+						out_scale.data(), offset.data(), no_bias ? nullptr : (const float*)bias.data);
+				}
+			}
+
+			int kernel_h, kernel_w;
+			int stride_h, stride_w;
+			int pad_h, pad_w;
+			int dilate_h, dilate_w;
+			int num_filter;
+			int num_group;
+			bool no_bias;
+
+			Tensor weight; // num_filter x C / num_group x kernel_h x kernel_w
+			Tensor bias;
+
+			// INT8
+			bool quantized;
+			float in_scale;
+			int in_zero;
+			std::vector<int8_t> weight_q; // num_filter x kernel_h x kernel_w x C
+			std::vector<float> out_scale; // of the input and each filter
+			std::vector<int32_t> offset; // zero point of the input times the sum of each filter
+		};
+
+		REGISTER_LAYER("Convolution", ConvolutionLayer);
+	}
+}
@@ -0,0 +1,178 @@
+#include "dnn/layers/layer.hpp"
+#include "dnn/ops.hpp"
+
+namespace chaos
+{
+	namespace dnn
+	{
+		enum EltwiseType { ADD, SUB, MUL, DIV };
+
+		static EltwiseType GetEltwiseType(std::string op)
+		{
+			std::transform(op.begin(), op.end(), op.begin(), ::tolower);
+			if (op.find("add") != std::string::npos || op.find("plus") != std::string::npos) return ADD;
+			if (op.find("sub") != std::string::npos || op.find("minus") != std::string::npos) return SUB;
+			if (op.find("mul") != std::string::npos) return MUL;
+			return DIV;
+		}
+
+		/// <summary>
+		/// <para>Elementwise add, sub, mul and div of two inputs, elemwise_* and broadcast_* of MxNet</para>
+		/// <para>Inputs of the same shape, or b of the trailing dims of a, go through the ops, other broadcasts by the</para>
+		/// <para>strides of the output with a step 0 on the broadcasted dims.</para>
+		/// </summary>
+		class EltwiseLayer : public Layer
+		{
+		public:
+			EltwiseLayer(const std::string& op, const Attrs& attrs) : type(GetEltwiseType(op)) {}
+
+			std::vector<Shape> Reshape(const std::vector<Shape>& inputs) override
+			{
+				CHECK_EQ(2, inputs.size());
+				const Shape& a = inputs[0];
+				const Shape& b = inputs[1];
+				CHECK_EQ(a.Size(), b.Size()) << "Shapes " << a << " and " << b << " can not be broadcasted";
+
+				Shape output = a;
+				for (size_t i = 0; i < a.Size(); i++)
+				{
+					CHECK(a[i] == b[i] || a[i] == 1 || b[i] == 1) << "Shapes " << a << " and " << b << " can not be broadcasted";
+					output[i] = std::max(a[i], b[i]);
+				}
+				return { output };
+			}
+			bool InPlace() const override { return true; }
+
+			void Forward(const std::vector<Tensor>& inputs, std::vector<Tensor>& outputs) override
+			{
+				const Tensor& a = inputs[0];
+				const Tensor& b = inputs[1];
+				Tensor& output = outputs[0];
+
+				// b of the trailing dims of a, e.g. the same shape or 1 x 1 x H x W
+				int leading = 0;
+				while (leading < b.dims && b.shape[leading] == 1) leading++;
+				bool trailing = a.shape == output.shape;
+				for (int i = leading; trailing && i < b.dims; i++) trailing = b.shape[i] == a.shape[i];
+				if (trailing)
+				{
+					const Tensor x = a.Reshape({ (int)(a.Size() / b.Size()), (int)b.Size() });
+					const Tensor y = b.Reshape({ 1, (int)b.Size() });
+					Tensor z = output.Reshape({ (int)(a.Size() / b.Size()), (int)b.Size() });
+					switch (type)
+					{
+					case ADD: Add(x, y, z); break;
+					case SUB: Sub(x, y, z); break;
+					case MUL: Mul(x, y, z); break;
+					case DIV: Div(x, y, z); break;
+					}
+					return;
+				}
+
+				// Steps of the inputs over the output, 0 on the broadcasted dims
+				const int dims = output.dims;
+				std::vector<size_t> step_a(dims), step_b(dims);
+				size_t sa = 1, sb = 1;
+				for (int i = dims - 1; i >= 0; i--)
+				{
+					step_a[i] = a.shape[i] == 1 ? 0 : sa;
+					step_b[i] = b.shape[i] == 1 ? 0 : sb;
+					sa *= a.shape[i];
+					sb *= b.shape[i];
+				}
+
+				const float* x = (const float*)a.data;
+				const float* y = (const float*)b.data;
+				float* z = (float*)output.data;
+				const size_t size = output.Size();
+				std::vector<int> position(dims, 0);
+				size_t ia = 0, ib = 0;
+				for (size_t i = 0; i < size; i++)
+				{
+					switch (type)
+					{
+					case ADD: z[i] = x[ia] + y[ib]; break;
+					case SUB: z[i] = x[ia] - y[ib]; break;
+					case MUL: z[i] = x[ia] * y[ib]; break;
+					case DIV: z[i] = x[ia] / y[ib]; break;
+					}
+
+					// Next position, carrying to the upper dims
+					for (int d = dims - 1; d >= 0; d--)
+					{
+						ia += step_a[d];
+						ib += step_b[d];
+						if (++position[d] < output.shape[d]) break;
+						ia -= step_a[d] * position[d];
+						ib -= step_b[d] * position[d];
+						position[d] = 0;
+					}
+				}
+			}
+
+		private:
+			EltwiseType type;
+		};
+
+		/// <summary>Elementwise op of the input and the attribute scalar, _plus_scalar, _rminus_scalar and so on of MxNet</summary>
+		class ScalarLayer : public Layer
+		{
+		public:
+			ScalarLayer(const std::string& op, const Attrs& attrs)
+			{
+				const float scalar = GetFloat(attrs, "scalar", 0.f);
+				const bool reversed = op.find("_r") == 0;
+				CHECK(!(reversed && GetEltwiseType(op) == DIV)) << op << " is not supported";
+
+				// y = x * alpha + beta
+				switch (GetEltwiseType(op))
+				{
+				case ADD: alpha = 1.f; beta = scalar; break;
+				case SUB: alpha = reversed ? -1.f : 1.f; beta = reversed ? scalar : -scalar; break;
+				case MUL: alpha = scalar; beta = 0.f; break;
+				case DIV: alpha = 1.f / scalar; beta = 0.f; break;
+				}
+			}
+
+			std::vector<Shape> Reshape(const std::vector<Shape>& inputs) override { return { inputs[0] }; }
+			bool InPlace() const override { return true; }
+
+			void Forward(const std::vector<Tensor>& inputs, std::vector<Tensor>& outputs) override
+			{
+				Scale(inputs[0], alpha, beta, outputs[0]);
+			}
+
+		private:
+			float alpha;
+			float beta;
+		};
+
+		REGISTER_OP_LAYER("elemwise_add", EltwiseLayer);
+		REGISTER_OP_LAYER("elemwise_sub", EltwiseLayer);
+		REGISTER_OP_LAYER("elemwise_mul", EltwiseLayer);
+		REGISTER_OP_LAYER("elemwise_div", EltwiseLayer);
+		REGISTER_OP_LAYER("broadcast_add", EltwiseLayer);
+		REGISTER_OP_LAYER("broadcast_plus", EltwiseLayer);
+		REGISTER_OP_LAYER("broadcast_sub", EltwiseLayer);
+		REGISTER_OP_LAYER("broadcast_minus", EltwiseLayer);
+		REGISTER_OP_LAYER("broadcast_mul", EltwiseLayer);
+		REGISTER_OP_LAYER("broadcast_div", EltwiseLayer);
+		REGISTER_OP_LAYER("_Plus", EltwiseLayer);
+		REGISTER_OP_LAYER("_plus", EltwiseLayer);
+		REGISTER_OP_LAYER("_add", EltwiseLayer);
+		REGISTER_OP_LAYER("_Minus", EltwiseLayer);
+		REGISTER_OP_LAYER("_minus", EltwiseLayer);
+		REGISTER_OP_LAYER("_sub", EltwiseLayer);
+		REGISTER_OP_LAYER("_Mul", EltwiseLayer);
+		REGISTER_OP_LAYER("_mul", EltwiseLayer);
+		REGISTER_OP_LAYER("_Div", EltwiseLayer);
+		REGISTER_OP_LAYER("_div", EltwiseLayer);
+
+		REGISTER_OP_LAYER("_plus_scalar", ScalarLayer);
+		REGISTER_OP_LAYER("_PlusScalar", ScalarLayer);
+		REGISTER_OP_LAYER("_minus_scalar", ScalarLayer);
+		REGISTER_OP_LAYER("_rminus_scalar", ScalarLayer);
+		REGISTER_OP_LAYER("_mul_scalar", ScalarLayer);
+		REGISTER_OP_LAYER("_div_scalar", ScalarLayer);
+	}
+}
@@ -0,0 +1,162 @@
+#include "dnn/layers/layer.hpp"
+#include "dnn/gemm.hpp"
+#include "dnn/simd.hpp"
+
+namespace chaos
+{
+	namespace dnn
+	{
+		template<class V>
+		static inline float DotRow(const float* a, const float* b, int n)
+		{
+			typename V::Type sum = V::Set(0.f);
+			int i = 0;
+			for (; i + V::N <= n; i += V::N)
+			{
+				sum = V::Fma(V::Load(a + i), V::Load(b + i), sum);
+			}
+			float result = V::ReduceSum(sum);
+			for (; i < n; i++) result += a[i] * b[i];
+			return result;
+		}
+
+		/// <summary>
+		/// <para>Fully connected layer as MxNet FullyConnected, y = x * W^T + b</para>
+		/// <para>x is flattened to N x K, or only its last axis is connected if flatten is False. A few rows are dot</para>
+		/// <para>products with the rows of W in parallel, more rows go through the GEMM.</para>
+		/// <para>With the __int8_scale__ and __int8_zero__ attributes of Optimizer::Quantize, x is quantized to bytes and</para>
+		/// <para>multiplied by W quantized by row in GemmU8S8.</para>
+		/// </summary>
+		class InnerProductLayer : public Layer
+		{
+		public:
+			InnerProductLayer(const Attrs& attrs)
+			{
+				num_hidden = GetInt(attrs, "num_hidden", 0);
+				no_bias = GetBool(attrs, "no_bias", false);
+				flatten = GetBool(attrs, "flatten", true);
+				CHECK_LT(0, num_hidden);
+
+				in_scale = GetFloat(attrs, "__int8_scale__", 0.f);
+				in_zero = GetInt(attrs, "__int8_zero__", 0);
+			}
+
+			void SetWeights(const std::vector<Tensor>& weights) override
+			{
+				CHECK_EQ((no_bias ? 1 : 2), weights.size()) << "FullyConnected takes weight" << (no_bias ? "" : " and bias");
+				weight = weights[0].ConvertTo(F32).Flatten();
+				CHECK(weight.dims == 2 && weight.shape[0] == num_hidden) << "Weight of " << weight.shape << " mismatches num_hidden " << num_hidden;
+				if (!no_bias)
+				{
+					bias = weights[1].ConvertTo(F32).Flatten();
+					CHECK_EQ(num_hidden, bias.Size());
+				}
+
+				if (in_scale > 0.f)
+				{
+					const int K = weight.shape[1];
+					weight_q.resize((size_t)num_hidden * K);
+					out_scale.resize(num_hidden);
+					offset.resize(num_hidden);
+					QuantizeRows((const float*)weight.data, num_hidden, K, weight_q.data(), out_scale.data(), offset.data());
+					for (int o = 0; o < num_hidden; o++)
+					{
+						out_scale[o] *= in_scale;
+						offset[o] *= in_zero;
+					}
+				}
+			}
+
+			std::vector<Shape> Reshape(const std::vector<Shape>& inputs) override
+			{
+				const Shape& input = inputs[0];
+				Shape output;
+				int K;
+				if (flatten)
+				{
+					K = (int)(Size(input) / input[0]);
+					output = { input[0], num_hidden };
+				}
+				else
+				{
+					K = input[input.Size() - 1];
+					output = input;
+					output[output.Size() - 1] = num_hidden;
+				}
+				CHECK_EQ(weight.shape[1], K) << "Input of " << input << " mismatches the weight of " << weight.shape;
+				return { output };
+			}
+
+			void Forward(const std::vector<Tensor>& inputs, std::vector<Tensor>& outputs) override
+			{
+				const Tensor& input = inputs[0];
+				Tensor& output = outputs[0];
+				const int K = weight.shape[1];
+				const int rows = (int)(input.Size() / K);
+				const float* x = (const float*)input.data;
+				const float* w = (const float*)weight.data;
+				const float* b = no_bias ? nullptr : (const float*)bias.data;
+				float* y = (float*)output.data;
+
+				if (in_scale > 0.f)
+				{
+					thread_local std::vector<uint8_t> bytes;
+					bytes.resize(input.Size());
+					const float inv_scale = 1.f / in_scale;
+					for (size_t i = 0; i < bytes.size(); i++) bytes[i] = QuantizeU8(x[i], inv_scale, in_zero);
+
+					GemmU8S8(num_hidden, rows, K, weight_q.data(), K, bytes.data(), K, y, num_hidden, true, out_scale.data(), offset.data(), b);
+					return;
+				}
+
+				if (rows < 4)
+				{
+					Dispatch([&](auto v) {
+						using V = decltype(v);
+						ForEach(num_hidden, (size_t)rows * K, [&](size_t o) {
+							for (int r = 0; r < rows; r++)
+							{
+								y[(size_t)r * num_hidden + o] = DotRow<V>(x + (size_t)r * K, w + o * K, K) + (b ? b[o] : 0.f);
+							}
+						});
+					});
+					return;
+				}
+
+				Gemm(rows, num_hidden, K, x, K, w, K, true, y, num_hidden);
+				if (b)
+				{
+					for (int r = 0; r < rows; r++)
+					{
+						float* row = y + (size_t)r * num_hidden;
+						for (int o = 0; o < num_hidden; o++) row[o] += b[o];
+					}
+				}
+			}
+
+		private:
+			static size_t Size(const Shape& shape)
+			{
+				size_t size = 1;
+				for (auto n : shape) size *= n;
+				return size;
+			}
+
+			int num_hidden;
+			bool no_bias;
+			bool flatten;
+
+			Tensor weight; // num_hidden x K
+			Tensor bias;
+
+			// INT8
+			float in_scale;
+			int in_zero;
+			std::vector<int8_t> weight_q;
+			std::vector<float> out_scale; // of the input and each row of W
+			std::vector<int32_t> offset; // zero point of the input times the sum of each row of W
+		};
+
+		REGISTER_LAYER("FullyConnected", InnerProductLayer);
+	}
+}
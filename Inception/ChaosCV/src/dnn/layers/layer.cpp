@@ -0,0 +1,77 @@
+#include "dnn/layers/layer.hpp"
+
+namespace chaos
+{
+	namespace dnn
+	{
+		// Constructed on the first registration, which may come before any other static of this file
+		static std::map<std::string, Layer::Creator>& Creators()
+		{
+			static std::map<std::string, Layer::Creator> creators;
+			return creators;
+		}
+
+		Layer::~Layer() {}
+		void Layer::SetWeights(const std::vector<Tensor>& weights)
+		{
+			CHECK(weights.empty()) << "Layer takes no weights, but got " << weights.size();
+		}
+		bool Layer::InPlace() const { return false; }
+
+		Ptr<Layer> Layer::Create(const std::string& op, const Attrs& attrs)
+		{
+			auto creator = Creators().find(op);
+			return creator == Creators().end() ? Ptr<Layer>() : creator->second(attrs);
+		}
+		bool Layer::Register(const std::string& op, const Creator& creator)
+		{
+			CHECK(Creators().find(op) == Creators().end()) << "Layer " << op << " is already registered";
+			Creators()[op] = creator;
+			return true;
+		}
+
+		bool Layer::GetBool(const Attrs& attrs, const std::string& key, bool value)
+		{
+			auto attr = attrs.find(key);
+			if (attr == attrs.end()) return value;
+			return attr->second == "True" || attr->second == "true" || attr->second == "1";
+		}
+		int Layer::GetInt(const Attrs& attrs, const std::string& key, int value)
+		{
+			auto attr = attrs.find(key);
+			return attr == attrs.end() || attr->second == "None" ? value : std::stoi(attr->second);
+		}
+		float Layer::GetFloat(const Attrs& attrs, const std::string& key, float value)
+		{
+			auto attr = attrs.find(key);
+			return attr == attrs.end() || attr->second == "None" ? value : std::stof(attr->second);
+		}
+		std::string Layer::GetString(const Attrs& attrs, const std::string& key, const std::string& value)
+		{
+			auto attr = attrs.find(key);
+			return attr == attrs.end() ? value : attr->second;
+		}
+		std::vector<int> Layer::GetTuple(const Attrs& attrs, const std::string& key, const std::vector<int>& value)
+		{
+			auto attr = attrs.find(key);
+			if (attr == attrs.end() || attr->second == "None" || attr->second == "()" || attr->second == "[]") return value;
+
+			// "(3, 3)", "[3,3]" or "3"
+			std::vector<int> tuple;
+			std::string item;
+			for (char c : attr->second + ",")
+			{
+				if (c == ',' || c == ')' || c == ']')
+				{
+					if (!item.empty()) tuple.push_back(item == "None" ? 0 : std::stoi(item));
+					item.clear();
+				}
+				else if (c != '(' && c != '[' && c != ' ' && c != 'L')
+				{
+					item.push_back(c);
+				}
+			}
+			return tuple;
+		}
+	}
+}
@@ -0,0 +1,117 @@
+#include "dnn/layers/layer.hpp"
+#include "dnn/simd.hpp"
+
+namespace chaos
+{
+	namespace dnn
+	{
+		/// <summary>
+		/// <para>2D max, average or sum pooling as MxNet Pooling</para>
+		/// <para>The "valid" convention floors the output size, "full" ceils it as Caffe does. Windows of average pooling</para>
+		/// <para>count the padding unless count_include_pad is False.</para>
+		/// </summary>
+		class PoolingLayer : public Layer
+		{
+		public:
+			PoolingLayer(const Attrs& attrs)
+			{
+				global_pool = GetBool(attrs, "global_pool", false);
+				std::vector<int> kernel = GetTuple(attrs, "kernel", { 1, 1 });
+				std::vector<int> stride = GetTuple(attrs, "stride", { 1, 1 });
+				std::vector<int> pad = GetTuple(attrs, "pad", { 0, 0 });
+				CHECK(global_pool || (kernel.size() == 2 && stride.size() == 2 && pad.size() == 2)) << "Only 2D pooling is supported";
+
+				kernel_h = kernel[0]; kernel_w = kernel.back();
+				stride_h = stride[0]; stride_w = stride.back();
+				pad_h = pad[0]; pad_w = pad.back();
+
+				const std::string type = GetString(attrs, "pool_type", "max");
+				CHECK(type == "max" || type == "avg" || type == "sum") << "Unsupported pool_type " << type;
+				pool_type = type == "max" ? MAX : type == "avg" ? AVG : SUM;
+
+				const std::string convention = GetString(attrs, "pooling_convention", "valid");
+				CHECK(convention == "valid" || convention == "full") << "Unsupported pooling_convention " << convention;
+				full = convention == "full";
+				count_include_pad = GetBool(attrs, "count_include_pad", true);
+			}
+
+			std::vector<Shape> Reshape(const std::vector<Shape>& inputs) override
+			{
+				const Shape& input = inputs[0];
+				CHECK_EQ(4, input.Size()) << "Pooling input must be N x C x H x W";
+				if (global_pool) return { { input[0], input[1], 1, 1 } };
+
+				int OH, OW;
+				if (full)
+				{
+					OH = 1 + (input[2] + 2 * pad_h - kernel_h + stride_h - 1) / stride_h;
+					OW = 1 + (input[3] + 2 * pad_w - kernel_w + stride_w - 1) / stride_w;
+				}
+				else
+				{
+					OH = 1 + (input[2] + 2 * pad_h - kernel_h) / stride_h;
+					OW = 1 + (input[3] + 2 * pad_w - kernel_w) / stride_w;
+				}
+				CHECK(OH > 0 && OW > 0) << "Input of " << input << " is smaller than the kernel";
+				return { { input[0], input[1], OH, OW } };
+			}
+
+			void Forward(const std::vector<Tensor>& inputs, std::vector<Tensor>& outputs) override
+			{
+				const Tensor& input = inputs[0];
+				Tensor& output = outputs[0];
+				const int H = input.shape[2], W = input.shape[3];
+				const int OH = output.shape[2], OW = output.shape[3];
+				const int kh = global_pool ? H : kernel_h, kw = global_pool ? W : kernel_w;
+				const int sh = global_pool ? 1 : stride_h, sw = global_pool ? 1 : stride_w;
+				const int ph = global_pool ? 0 : pad_h, pw = global_pool ? 0 : pad_w;
+
+				ForEach((size_t)input.shape[0] * input.shape[1], (size_t)OH * OW * kh * kw, [&](size_t i) {
+					const float* src = (const float*)input.data + i * H * W;
+					float* dst = (float*)output.data + i * OH * OW;
+					for (int oy = 0; oy < OH; oy++)
+					{
+						for (int ox = 0; ox < OW; ox++)
+						{
+							int y0 = oy * sh - ph, x0 = ox * sw - pw;
+							int y1 = std::min(y0 + kh, H + ph), x1 = std::min(x0 + kw, W + pw);
+							int count = (y1 - y0) * (x1 - x0);
+							y0 = std::max(y0, 0); x0 = std::max(x0, 0);
+							y1 = std::min(y1, H); x1 = std::min(x1, W);
+							if (!count_include_pad) count = (y1 - y0) * (x1 - x0);
+
+							float value = pool_type == MAX ? -FLT_MAX : 0.f;
+							for (int y = y0; y < y1; y++)
+							{
+								const float* row = src + (size_t)y * W;
+								if (pool_type == MAX)
+								{
+									for (int x = x0; x < x1; x++) value = std::max(value, row[x]);
+								}
+								else
+								{
+									for (int x = x0; x < x1; x++) value += row[x];
+								}
+							}
+							if (pool_type == AVG) value = count > 0 ? value / count : 0.f;
+							dst[oy * OW + ox] = value;
+						}
+					}
+				});
+			}
+
+		private:
+			enum PoolType { MAX, AVG, SUM };
+
+			int kernel_h, kernel_w;
+			int stride_h, stride_w;
+			int pad_h, pad_w;
+			PoolType pool_type;
+			bool global_pool;
+			bool full;
+			bool count_include_pad;
+		};
+
+		REGISTER_LAYER("Pooling", PoolingLayer);
+	}
+}
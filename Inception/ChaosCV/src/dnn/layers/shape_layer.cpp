@@ -0,0 +1,137 @@
+#include "dnn/layers/layer.hpp"
+
+namespace chaos
+{
+	namespace dnn
+	{
+		// Copy the input unless the output is written over it
+		static void CopyIfNeeded(const Tensor& input, Tensor& output)
+		{
+			if (input.data != output.data) memcpy(output.data, input.data, input.Size() * sizeof(float));
+		}
+
+		/// <summary>
+		/// <para>Ops which keep the elements and only change the shape, Flatten, Reshape and the identities of inference,</para>
+		/// <para>Dropout, BlockGrad, _copy and identity. They run in place, so they cost nothing in a planned net.</para>
+		/// </summary>
+		class ReshapeLayer : public Layer
+		{
+		public:
+			ReshapeLayer(const std::string& op, const Attrs& attrs) : op(op)
+			{
+				shape = GetTuple(attrs, "shape", {});
+				CHECK(op != "Reshape" || !shape.empty()) << "Reshape needs the target shape";
+			}
+
+			std::vector<Shape> Reshape(const std::vector<Shape>& inputs) override
+			{
+				const Shape& input = inputs[0];
+				size_t size = 1;
+				for (auto n : input) size *= n;
+
+				if (op == "Flatten" || op == "flatten")
+				{
+					return { { input[0], (int)(size / input[0]) } };
+				}
+				if (op != "Reshape")
+				{
+					return { input };
+				}
+
+				// 0 copies the dim of the input, -1 is inferred from the others
+				std::vector<int> output;
+				int infer = -1;
+				size_t known = 1;
+				for (size_t i = 0; i < shape.size(); i++)
+				{
+					int n = shape[i];
+					if (n == 0)
+					{
+						CHECK_LT(i, input.Size());
+						n = input[i];
+					}
+					else if (n == -1)
+					{
+						CHECK_EQ(-1, infer) << "Only one dim can be inferred";
+						infer = (int)i;
+					}
+					else
+					{
+						CHECK_LT(0, n) << "Special value " << n << " of Reshape is not supported";
+					}
+					if (n > 0) known *= n;
+					output.push_back(n);
+				}
+				if (infer >= 0) output[infer] = (int)(size / known);
+				return { Shape(output) };
+			}
+			bool InPlace() const override { return true; }
+
+			void Forward(const std::vector<Tensor>& inputs, std::vector<Tensor>& outputs) override
+			{
+				CopyIfNeeded(inputs[0], outputs[0]);
+			}
+
+		private:
+			std::string op;
+			std::vector<int> shape;
+		};
+
+		/// <summary>Concat the inputs along dim, the channels by default</summary>
+		class ConcatLayer : public Layer
+		{
+		public:
+			ConcatLayer(const Attrs& attrs)
+			{
+				dim = GetInt(attrs, "dim", 1);
+			}
+
+			std::vector<Shape> Reshape(const std::vector<Shape>& inputs) override
+			{
+				Shape output = inputs[0];
+				CHECK(dim >= 0 && dim < (int)output.Size()) << "Dim " << dim << " out of range of " << output;
+				for (size_t i = 1; i < inputs.size(); i++)
+				{
+					CHECK_EQ(output.Size(), inputs[i].Size());
+					for (size_t d = 0; d < output.Size(); d++)
+					{
+						CHECK((int)d == dim || output[d] == inputs[i][d]) << "Shapes " << inputs[0] << " and " << inputs[i] << " can not be concatenated";
+					}
+					output[dim] += inputs[i][dim];
+				}
+				return { output };
+			}
+
+			void Forward(const std::vector<Tensor>& inputs, std::vector<Tensor>& outputs) override
+			{
+				Tensor& output = outputs[0];
+				size_t outer = 1;
+				for (int d = 0; d < dim; d++) outer *= output.shape[d];
+				const size_t row = output.Size() / outer; // elements of one outer index in the output
+
+				size_t offset = 0;
+				for (const auto& input : inputs)
+				{
+					const size_t size = input.Size() / outer;
+					for (size_t o = 0; o < outer; o++)
+					{
+						memcpy((float*)output.data + o * row + offset, (const float*)input.data + o * size, size * sizeof(float));
+					}
+					offset += size;
+				}
+			}
+
+		private:
+			int dim;
+		};
+
+		REGISTER_OP_LAYER("Flatten", ReshapeLayer);
+		REGISTER_OP_LAYER("flatten", ReshapeLayer);
+		REGISTER_OP_LAYER("Reshape", ReshapeLayer);
+		REGISTER_OP_LAYER("Dropout", ReshapeLayer);
+		REGISTER_OP_LAYER("BlockGrad", ReshapeLayer);
+		REGISTER_OP_LAYER("_copy", ReshapeLayer);
+		REGISTER_OP_LAYER("identity", ReshapeLayer);
+		REGISTER_LAYER("Concat", ConcatLayer);
+	}
+}
@@ -0,0 +1,62 @@
+#include "dnn/layers/layer.hpp"
+#include "dnn/ops.hpp"
+
+namespace chaos
+{
+	namespace dnn
+	{
+		/// <summary>
+		/// <para>Softmax of SoftmaxOutput, SoftmaxActivation and softmax of MxNet, the label input of SoftmaxOutput is ignored</para>
+		/// <para>Without an axis the softmax is over all the elements of a sample, as the output layers of classifiers</para>
+		/// </summary>
+		class SoftmaxLayer : public Layer
+		{
+		public:
+			SoftmaxLayer(const std::string& op, const Attrs& attrs)
+			{
+				if (op == "SoftmaxOutput")
+				{
+					axis = GetBool(attrs, "multi_output", false) ? 1 : GetBool(attrs, "preserve_shape", false) ? -1 : INSTANCE;
+				}
+				else if (op == "SoftmaxActivation")
+				{
+					const std::string mode = GetString(attrs, "mode", "instance");
+					CHECK(mode == "instance" || mode == "channel") << "Unsupported mode " << mode;
+					axis = mode == "channel" ? 1 : INSTANCE;
+				}
+				else
+				{
+					axis = GetInt(attrs, "axis", -1);
+				}
+			}
+
+			std::vector<Shape> Reshape(const std::vector<Shape>& inputs) override { return { inputs[0] }; }
+			bool InPlace() const override { return true; }
+
+			void Forward(const std::vector<Tensor>& inputs, std::vector<Tensor>& outputs) override
+			{
+				const Tensor& input = inputs[0];
+				if (axis == INSTANCE)
+				{
+					const int num = input.shape[0];
+					const int size = (int)(input.Size() / num);
+					Tensor output = outputs[0].Reshape({ num, size });
+					Softmax(input.Reshape({ num, size }), output, 1);
+				}
+				else
+				{
+					Softmax(input, outputs[0], axis);
+				}
+			}
+
+		private:
+			static constexpr int INSTANCE = std::numeric_limits<int>::max(); // over each sample
+
+			int axis;
+		};
+
+		REGISTER_OP_LAYER("SoftmaxOutput", SoftmaxLayer);
+		REGISTER_OP_LAYER("SoftmaxActivation", SoftmaxLayer);
+		REGISTER_OP_LAYER("softmax", SoftmaxLayer);
+	}
+}
@@ -0,0 +1,897 @@
+#include "dnn/net.hpp"
+#include "dnn/reg.hpp"
+#include "dnn/layers/layer.hpp"
+#include "dnn/simd.hpp"
+#include "utils/json.hpp"
+
+#include <chrono>
+
+namespace chaos
+{
+	namespace dnn
+	{
+		// Magics of the MxNet NDArray files
+		static constexpr uint64_t NDARRAY_LIST_MAGIC = 0x112;
+		static constexpr uint32_t NDARRAY_V1_MAGIC = 0xF993FAC8;
+		static constexpr uint32_t NDARRAY_V2_MAGIC = 0xF993FAC9;
+		static constexpr uint32_t NDARRAY_V3_MAGIC = 0xF993FACA;
+
+		// Magic and version of the compiled net
+		static constexpr char COMPILED_MAGIC[8] = { 'C', 'H', 'A', 'O', 'S', 'N', 'E', 'T' };
+		static constexpr uint32_t COMPILED_VERSION = 1;
+		static constexpr size_t COMPILED_SECTION_ALIGN = 4096; // page of the mapped weights
+		static constexpr size_t COMPILED_ARRAY_ALIGN = 64; // cache line of each weight
+
+		// Sequential reader of the little endian binary files
+		class BinaryReader
+		{
+		public:
+			BinaryReader(const char* data, size_t size) : data(data), size(size), pos(0) {}
+
+			template<class Type>
+			Type Get()
+			{
+				Type value;
+				Copy(&value, sizeof(Type));
+				return value;
+			}
+
+			// String of uint32 length
+			std::string GetString()
+			{
+				std::string value(Get<uint32_t>(), '\0');
+				Copy(&value[0], value.size());
+				return value;
+			}
+
+			void Copy(void* dst, size_t bytes)
+			{
+				CHECK_LE(pos + bytes, size) << "File is truncated";
+				memcpy(dst, data + pos, bytes);
+				pos += bytes;
+			}
+
+		protected:
+			const char* data;
+			size_t size;
+			size_t pos;
+		};
+
+		// Writer of the files read by BinaryReader
+		class BinaryWriter
+		{
+		public:
+			template<class Type>
+			void Put(const Type& value)
+			{
+				data.append((const char*)&value, sizeof(Type));
+			}
+
+			void PutString(const std::string& value)
+			{
+				Put((uint32_t)value.size());
+				data.append(value);
+			}
+
+			std::string data;
+		};
+
+		/// <summary>Reader of the NDArray list saved by mx.nd.save, which is the .params file</summary>
+		class ParamsReader : public BinaryReader
+		{
+		public:
+			ParamsReader(const std::string& data) : BinaryReader(data.data(), data.size()) {}
+
+			std::map<std::string, Tensor> Read()
+			{
+				CHECK_EQ(NDARRAY_LIST_MAGIC, Get<uint64_t>()) << "Invalid params file";
+				Get<uint64_t>(); // reserved
+
+				std::vector<Tensor> arrays(Get<uint64_t>());
+				for (auto& array : arrays) array = ReadArray();
+
+				const size_t num_names = Get<uint64_t>();
+				CHECK_EQ(arrays.size(), num_names) << "Params without names";
+
+				std::map<std::string, Tensor> params;
+				for (size_t i = 0; i < num_names; i++)
+				{
+					std::string name(Get<uint64_t>(), '\0');
+					Copy(&name[0], name.size());
+
+					// arg:conv1_weight, aux:bn1_moving_mean
+					if (name.compare(0, 4, "arg:") == 0 || name.compare(0, 4, "aux:") == 0) name = name.substr(4);
+					params[name] = arrays[i];
+				}
+				return params;
+			}
+
+		private:
+			Tensor ReadArray()
+			{
+				const uint32_t magic = Get<uint32_t>();
+
+				std::vector<int64_t> shape;
+				if (magic == NDARRAY_V2_MAGIC || magic == NDARRAY_V3_MAGIC)
+				{
+					CHECK_EQ(0, Get<int32_t>()) << "Only dense NDArray is supported";
+					const int32_t dims = Get<int32_t>();
+					for (int32_t i = 0; i < dims; i++) shape.push_back(Get<int64_t>());
+				}
+				else if (magic == NDARRAY_V1_MAGIC)
+				{
+					const uint32_t dims = Get<uint32_t>();
+					for (uint32_t i = 0; i < dims; i++) shape.push_back(Get<int64_t>());
+				}
+				else
+				{
+					// Legacy arrays begin with dims, each dim is 32 bit
+					for (uint32_t i = 0; i < magic; i++) shape.push_back(Get<uint32_t>());
+				}
+				if (shape.empty()) return Tensor();
+
+				Get<int32_t>(); // device type
+				Get<int32_t>(); // device id
+				const int32_t type = Get<int32_t>();
+
+				Shape tensor_shape(shape);
+				switch (type)
+				{
+				case 0: // float32
+				{
+					Tensor tensor(tensor_shape, F32);
+					Copy(tensor.data, tensor.Size() * sizeof(float));
+					return tensor;
+				}
+				case 2: // float16
+				{
+					Tensor tensor(tensor_shape, F16);
+					Copy(tensor.data, tensor.Size() * sizeof(uint16_t));
+					return tensor.ConvertTo(F32);
+				}
+				case 1: // float64
+				{
+					Tensor tensor(tensor_shape, F32);
+					for (size_t i = 0; i < tensor.Size(); i++) ((float*)tensor.data)[i] = (float)Get<double>();
+					return tensor;
+				}
+				default:
+					LOG(FATAL) << "Unsupported NDArray type " << type;
+					return Tensor(); // Never reachable
+				}
+			}
+		};
+
+		static std::string ReadFile(const std::string& file)
+		{
+			std::fstream fs(file, std::ios::in | std::ios::binary);
+			CHECK(fs.good()) << "Can not open " << file;
+
+			fs.seekg(0, std::ios::end);
+			size_t size = fs.tellg();
+			fs.seekg(0, std::ios::beg);
+
+			std::string data(size, '\0');
+			fs.read((char*)data.data(), size);
+			fs.close();
+			return data;
+		}
+
+		// Map the file read only, the mapping is shared by the processes and released with the returned pointer
+		static Ptr<void> MapFile(const std::string& file, size_t& size);
+
+		struct NativeNode
+		{
+			std::string op;
+			std::string name;
+			Layer::Attrs attrs;
+			std::vector<int> inputs; // ids of the input nodes, each node has one output
+			std::vector<Tensor> weights; // inputs which are params
+			Ptr<Layer> layer; // null for the variables
+		};
+
+		/// <summary>
+		/// <para>Graph of the native net, loaded from the MxNet symbol and params or from the compiled net</para>
+		/// <para>The compiled net is a single file of a header, the parsed graph and the F32 weights:</para>
+		/// <para>    header  | magic "CHAOSNET", uint32 version, uint32 reserved, uint64 offset and size of the graph and the weights</para>
+		/// <para>    graph   | nodes of op, name, attrs, inputs and the shape and offset of each weight, variables and outputs</para>
+		/// <para>    weights | page aligned, each weight aligned to the cache line</para>
+		/// <para>The weights of a mapped file are used in place, so that loading copies nothing and the processes which</para>
+		/// <para>load the same net share one copy of the weights in memory.</para>
+		/// </summary>
+		struct NativeGraph
+		{
+			std::vector<NativeNode> nodes; // in topological order as the symbol
+			std::map<std::string, int> variables; // inputs which are not params, by name
+			std::vector<int> heads;
+			std::vector<std::string> output_names; // by output handle
+			Ptr<void> storage; // memory of the compiled net which the weights point into
+
+			void LoadSymbol(const std::string& json)
+			{
+				Json symbol = Shrink(json);
+
+				Json json_nodes = symbol["nodes"];
+				const size_t num = json_nodes.Data.size();
+				for (size_t i = 0; i < num; i++)
+				{
+					Json json_node = json_nodes[i];
+					NativeNode node;
+					node.op = json_node.Data["op"];
+					node.name = json_node.Data["name"];
+
+					// "attrs" since MxNet 1.0, "param" and "attr" before
+					node.attrs = json_node["attrs"].Data;
+					if (node.attrs.empty()) node.attrs = json_node["param"].Data;
+					if (node.attrs.empty()) node.attrs = json_node["attr"].Data;
+
+					Json inputs = json_node["inputs"];
+					const size_t num_inputs = inputs.Data.size();
+					for (size_t j = 0; j < num_inputs; j++)
+					{
+						CHECK_EQ("0", inputs[j].Data["1"]) << "Node " << node.name << " takes the output " << inputs[j].Data["1"] << " of a multiple outputs node, which is not supported";
+						node.inputs.push_back(std::stoi(inputs[j].Data["0"]));
+					}
+					nodes.push_back(node);
+				}
+
+				Json json_heads = symbol["heads"];
+				const size_t num_heads = json_heads.Data.size();
+				for (size_t i = 0; i < num_heads; i++)
+				{
+					const int head = std::stoi(json_heads[i].Data["0"]);
+					const NativeNode& node = nodes[head];
+					heads.push_back(head);
+					output_names.push_back(node.op == "null" ? node.name : node.name + "_output");
+				}
+			}
+
+			void LoadParams(const std::string& data)
+			{
+				std::map<std::string, Tensor> params = ParamsReader(data).Read();
+
+				for (size_t i = 0; i < nodes.size(); i++)
+				{
+					NativeNode& node = nodes[i];
+					if (node.op == "null")
+					{
+						if (!params.count(node.name)) variables[node.name] = (int)i;
+						continue;
+					}
+
+					// Inputs which are params are the weights, the others stay the inputs of the layer
+					std::vector<int> inputs;
+					for (int input : node.inputs)
+					{
+						const NativeNode& from = nodes[input];
+						if (from.op == "null" && params.count(from.name))
+						{
+							node.weights.push_back(params[from.name]);
+						}
+						else
+						{
+							inputs.push_back(input);
+						}
+					}
+					node.inputs = inputs;
+				}
+			}
+
+			void LoadCompiled(const Ptr<void>& data, size_t size)
+			{
+				storage = data;
+				const char* base = (const char*)data.get();
+
+				BinaryReader header(base, size);
+				char magic[sizeof(COMPILED_MAGIC)];
+				header.Copy(magic, sizeof(magic));
+				CHECK(memcmp(magic, COMPILED_MAGIC, sizeof(magic)) == 0) << "Invalid compiled net";
+				const uint32_t version = header.Get<uint32_t>();
+				CHECK_EQ(COMPILED_VERSION, version) << "Unsupported version " << version << " of the compiled net";
+				header.Get<uint32_t>(); // reserved
+				const uint64_t graph_offset = header.Get<uint64_t>();
+				const uint64_t graph_size = header.Get<uint64_t>();
+				const uint64_t weight_offset = header.Get<uint64_t>();
+				const uint64_t weight_size = header.Get<uint64_t>();
+				CHECK(graph_offset + graph_size <= size && weight_offset + weight_size <= size) << "Compiled net is truncated";
+
+				BinaryReader graph(base + graph_offset, graph_size);
+				nodes.resize(graph.Get<uint32_t>());
+				for (auto& node : nodes)
+				{
+					node.op = graph.GetString();
+					node.name = graph.GetString();
+					const uint32_t num_attrs = graph.Get<uint32_t>();
+					for (uint32_t i = 0; i < num_attrs; i++)
+					{
+						std::string key = graph.GetString();
+						node.attrs[key] = graph.GetString();
+					}
+					node.inputs.resize(graph.Get<uint32_t>());
+					for (auto& input : node.inputs)
+					{
+						input = graph.Get<int32_t>();
+						CHECK(input >= 0 && input < (int)nodes.size()) << "Invalid input " << input << " of node " << node.name;
+					}
+					node.weights.resize(graph.Get<uint32_t>());
+					for (auto& weight : node.weights)
+					{
+						std::vector<int> shape(graph.Get<uint32_t>());
+						size_t count = 1;
+						for (auto& n : shape)
+						{
+							n = graph.Get<int32_t>();
+							count *= n;
+						}
+						const uint64_t offset = graph.Get<uint64_t>();
+						CHECK_LE(offset + count * sizeof(float), weight_size) << "Weight of node " << node.name << " is out of the file";
+						weight = Tensor(Shape(shape), F32, (void*)(base + weight_offset + offset));
+					}
+				}
+
+				const uint32_t num_variables = graph.Get<uint32_t>();
+				for (uint32_t i = 0; i < num_variables; i++)
+				{
+					std::string name = graph.GetString();
+					variables[name] = graph.Get<int32_t>();
+				}
+				const uint32_t num_heads = graph.Get<uint32_t>();
+				for (uint32_t i = 0; i < num_heads; i++)
+				{
+					output_names.push_back(graph.GetString());
+					heads.push_back(graph.Get<int32_t>());
+				}
+			}
+
+			void SaveCompiled(const std::string& file) const
+			{
+				// Offsets of the weights in the weight section
+				std::vector<std::vector<uint64_t>> offsets(nodes.size());
+				uint64_t weight_size = 0;
+				for (size_t i = 0; i < nodes.size(); i++)
+				{
+					for (const auto& weight : nodes[i].weights)
+					{
+						offsets[i].push_back(weight_size);
+						weight_size = AlignSize(weight_size + weight.Size() * sizeof(float), COMPILED_ARRAY_ALIGN);
+					}
+				}
+
+				BinaryWriter graph;
+				graph.Put((uint32_t)nodes.size());
+				for (size_t i = 0; i < nodes.size(); i++)
+				{
+					const NativeNode& node = nodes[i];
+					graph.PutString(node.op);
+					graph.PutString(node.name);
+					graph.Put((uint32_t)node.attrs.size());
+					for (const auto& attr : node.attrs)
+					{
+						graph.PutString(attr.first);
+						graph.PutString(attr.second);
+					}
+					graph.Put((uint32_t)node.inputs.size());
+					for (int input : node.inputs) graph.Put((int32_t)input);
+					graph.Put((uint32_t)node.weights.size());
+					for (size_t w = 0; w < node.weights.size(); w++)
+					{
+						const Tensor& weight = node.weights[w];
+						graph.Put((uint32_t)weight.dims);
+						for (int d = 0; d < weight.dims; d++) graph.Put((int32_t)weight.shape[d]);
+						graph.Put(offsets[i][w]);
+					}
+				}
+				graph.Put((uint32_t)variables.size());
+				for (const auto& variable : variables)
+				{
+					graph.PutString(variable.first);
+					graph.Put((int32_t)variable.second);
+				}
+				graph.Put((uint32_t)heads.size());
+				for (size_t i = 0; i < heads.size(); i++)
+				{
+					graph.PutString(output_names[i]);
+					graph.Put((int32_t)heads[i]);
+				}
+
+				BinaryWriter header;
+				header.data.append(COMPILED_MAGIC, sizeof(COMPILED_MAGIC));
+				header.Put(COMPILED_VERSION);
+				header.Put((uint32_t)0); // reserved
+				const uint64_t graph_offset = sizeof(COMPILED_MAGIC) + sizeof(uint32_t) * 2 + sizeof(uint64_t) * 4;
+				const uint64_t weight_offset = AlignSize(graph_offset + graph.data.size(), COMPILED_SECTION_ALIGN);
+				header.Put(graph_offset);
+				header.Put((uint64_t)graph.data.size());
+				header.Put(weight_offset);
+				header.Put(weight_size);
+
+				std::string weights(weight_size, '\0');
+				for (size_t i = 0; i < nodes.size(); i++)
+				{
+					for (size_t w = 0; w < nodes[i].weights.size(); w++)
+					{
+						const Tensor weight = nodes[i].weights[w].ConvertTo(F32).Flatten();
+						memcpy(&weights[offsets[i][w]], weight.data, weight.Size() * sizeof(float));
+					}
+				}
+
+				std::fstream fs(file, std::ios::out | std::ios::binary);
+				CHECK(fs.good()) << "Can not open " << file;
+				fs.write(header.data.data(), header.data.size());
+				fs.write(graph.data.data(), graph.data.size());
+				fs.write(std::string(weight_offset - graph_offset - graph.data.size(), '\0').data(), weight_offset - graph_offset - graph.data.size());
+				fs.write(weights.data(), weights.size());
+				CHECK(fs.good()) << "Can not write " << file;
+				fs.close();
+			}
+
+			void CreateLayers()
+			{
+				for (auto& node : nodes)
+				{
+					if (node.op == "null") continue;
+
+					node.layer = Layer::Create(node.op, node.attrs);
+					CHECK(node.layer) << "Op " << node.op << " of " << node.name << " is not supported by the native net";
+					node.layer->SetWeights(node.weights);
+				}
+			}
+		};
+
+		/// <summary>
+		/// <para>Net of the layers of ChaosCV, which runs the MxNet symbol and params or the compiled net without MxNet</para>
+		/// <para>The graph and the layers with their weights are shared by the clones. Bind and Reshape infer the shapes</para>
+		/// <para>and plan the activations into as few buffers as possible: a buffer is reused once its last reader has run,</para>
+		/// <para>and in place layers write over their input. Forward then just runs the layers on views of the buffers.</para>
+		/// </summary>
+		class NativeNet : public Net
+		{
+		public:
+			/// <param name="framework">Name of the registered framework which loaded the graph</param>
+			NativeNet(const Ptr<NativeGraph>& graph, const std::string& framework) : graph(graph), framework(framework) {}
+
+			using Net::BindExecutor;
+
+			void BindExecutor(const std::vector<DataLayer>& inputs) final
+			{
+				input_names.clear();
+				input_shapes.clear();
+				for (const auto& layer : inputs)
+				{
+					CHECK(graph->variables.count(layer.name)) << "Unknown input " << layer.name;
+					input_names.push_back(layer.name);
+					input_shapes.push_back(layer.shape);
+				}
+				Plan();
+				ApplyTunedSettings(GetInputs());
+			}
+
+			void Forward() final
+			{
+				// Parallelism of the layers, restored for the other nets forwarded by the thread
+				Parallelism& parallelism = ThreadParallelism();
+				const Parallelism outer = parallelism;
+				parallelism.threads = settings.threads;
+				if (settings.grain > 0) parallelism.grain = settings.grain;
+
+				const auto start = std::chrono::steady_clock::now();
+				if (profiling)
+				{
+					layer_times.resize(steps.size());
+					auto tick = start;
+					for (size_t i = 0; i < steps.size(); i++)
+					{
+						const NativeNode& node = graph->nodes[steps[i].node];
+						node.layer->Forward(steps[i].inputs, steps[i].outputs);
+
+						const auto now = std::chrono::steady_clock::now();
+						layer_times[i] = { node.name, node.op, std::chrono::duration<double, std::milli>(now - tick).count() };
+						tick = now;
+					}
+				}
+				else
+				{
+					for (auto& step : steps)
+					{
+						graph->nodes[step.node].layer->Forward(step.inputs, step.outputs);
+					}
+				}
+				latency.Add(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+				parallelism = outer;
+			}
+
+			void SetLayerData(const std::string& name, const Tensor& data) final
+			{
+				SetLayerData(GetInputHandle(name), data);
+			}
+			void GetLayerData(const std::string& name, Tensor& data) final
+			{
+				GetLayerData(GetOutputHandle(name), data);
+			}
+
+			int GetInputHandle(const std::string& name) final
+			{
+				auto input = std::find(input_names.begin(), input_names.end(), name);
+				CHECK(input != input_names.end()) << "Unknown input " << name;
+				return (int)(input - input_names.begin());
+			}
+			int GetOutputHandle(const std::string& name) final
+			{
+				auto output = std::find(graph->output_names.begin(), graph->output_names.end(), name);
+				CHECK(output != graph->output_names.end()) << "Unknown output " << name;
+				return (int)(output - graph->output_names.begin());
+			}
+
+			void SetLayerData(int handle, const Tensor& data) final
+			{
+				CHECK(handle >= 0 && handle < (int)input_names.size()) << "Invalid input handle " << handle;
+				CHECK_EQ(input_shapes[handle], data.shape);
+
+				const Tensor input = data.ConvertTo(F32).Flatten();
+				const Tensor& entry = entries[graph->variables[input_names[handle]]];
+				memcpy(entry.data, input.data, input.Size() * sizeof(float));
+			}
+			void GetLayerData(int handle, Tensor& data) final
+			{
+				CHECK(handle >= 0 && handle < (int)graph->heads.size()) << "Invalid output handle " << handle;
+
+				const Tensor& entry = entries[graph->heads[handle]];
+				// Reused only if no other tensor shares the buffer and data is not a view
+				if (!(data.ref_cnt && *data.ref_cnt == 1 && data.data == data.buffer &&
+					data.shape == entry.shape && data.depth == F32 && data.layout == NCHW && data.IsContinue()))
+				{
+					AllocationTag tag("Native output", /*fallback=*/true);
+					data = Tensor(entry.shape, F32, false, data.allocator);
+				}
+				memcpy(data.data, entry.data, entry.Size() * sizeof(float));
+			}
+
+			void Reshape(const std::vector<DataLayer>& new_inputs) final
+			{
+				for (const auto& layer : new_inputs)
+				{
+					input_shapes[GetInputHandle(layer.name)] = layer.shape;
+				}
+				Plan();
+				ApplyTunedSettings(GetInputs());
+			}
+
+			Ptr<Net> Clone() final
+			{
+				CHECK(!steps.empty()) << "Bind the executor before clone";
+
+				Ptr<NativeNet> net(new NativeNet(graph, framework));
+				net->input_names = input_names;
+				net->input_shapes = input_shapes;
+				net->tuned_settings = tuned_settings;
+				net->settings = settings;
+				net->Plan();
+				return net;
+			}
+
+			void SetProfiling(bool enable) final
+			{
+				// The times of the last profiled forward are kept after profiling
+				profiling = enable;
+				if (enable) layer_times.clear();
+			}
+			std::vector<LayerTime> GetLayerTimes() const final
+			{
+				return layer_times;
+			}
+			LatencyStats GetLatencyStats() const final
+			{
+				return latency.GetStats();
+			}
+
+			void SetForwardSettings(const ForwardSettings& settings) final
+			{
+				this->settings = settings;
+			}
+			ForwardSettings GetForwardSettings() const final
+			{
+				return settings;
+			}
+			std::vector<ForwardSettings> GetTuningSpace() const final
+			{
+				// Powers of 2 threads up to all of them, each with a finer and a coarser grain than the default
+				const int max_threads = std::max(1, cv::getNumThreads());
+				std::vector<int> threads;
+				for (int n = 1; n < max_threads; n *= 2) threads.push_back(n);
+				threads.push_back(max_threads);
+
+				std::vector<ForwardSettings> space;
+				for (int n : threads)
+				{
+					for (int grain : { 16 * 1024, 64 * 1024, 256 * 1024 })
+					{
+						space.push_back(ForwardSettings());
+						space.back().threads = n;
+						space.back().grain = n == 1 ? 0 : grain;
+						if (n == 1) break; // the grain does not matter on one thread
+					}
+				}
+				return space;
+			}
+
+			dnn::Framework& GetFramework() final
+			{
+				return Registered::Have(framework);
+			}
+
+		private:
+			std::vector<DataLayer> GetInputs() const
+			{
+				std::vector<DataLayer> inputs;
+				for (size_t i = 0; i < input_names.size(); i++) inputs.push_back(DataLayer(input_names[i], input_shapes[i]));
+				return inputs;
+			}
+
+			struct Step
+			{
+				int node;
+				std::vector<Tensor> inputs;
+				std::vector<Tensor> outputs;
+			};
+
+			// Infer the shapes from the inputs and assign the activations to the buffers
+			void Plan()
+			{
+				const std::vector<NativeNode>& nodes = graph->nodes;
+				const size_t num = nodes.size();
+
+				// Nodes the heads depend on, unbound variables such as labels are left out
+				std::map<int, Shape> bound;
+				for (size_t i = 0; i < input_names.size(); i++)
+				{
+					bound[graph->variables[input_names[i]]] = input_shapes[i];
+				}
+				std::vector<bool> needed(num, false);
+				for (int head : graph->heads) needed[head] = true;
+				for (int i = (int)num - 1; i >= 0; i--)
+				{
+					if (!needed[i]) continue;
+					CHECK(nodes[i].layer || bound.count(i)) << "Input " << nodes[i].name << " is not bound";
+					for (int input : nodes[i].inputs)
+					{
+						if (nodes[input].layer || bound.count(input)) needed[input] = true;
+					}
+				}
+
+				std::vector<std::vector<int>> inputs(num);
+				std::vector<int> readers(num, 0);
+				for (size_t i = 0; i < num; i++)
+				{
+					if (!needed[i] || !nodes[i].layer) continue;
+					for (int input : nodes[i].inputs)
+					{
+						if (needed[input])
+						{
+							inputs[i].push_back(input);
+							readers[input]++;
+						}
+					}
+				}
+				for (int head : graph->heads) readers[head]++; // never released
+
+				// Shapes and buffers, inputs have their own buffers which are never written by the layers
+				std::vector<Shape> shapes(num);
+				std::vector<int> buffer_of(num, -1);
+				std::vector<size_t> capacities;
+				std::vector<int> free_buffers;
+				auto Size = [](const Shape& shape) {
+					size_t size = 1;
+					for (auto n : shape) size *= n;
+					return size;
+				};
+				auto Allocate = [&](size_t size) {
+					// The smallest free buffer which fits, otherwise the largest one grows
+					int best = -1;
+					for (int buffer : free_buffers)
+					{
+						if (best < 0)
+						{
+							best = buffer;
+							continue;
+						}
+						const bool fits = capacities[buffer] >= size;
+						const bool best_fits = capacities[best] >= size;
+						if ((fits && (!best_fits || capacities[buffer] < capacities[best])) || (!fits && !best_fits && capacities[buffer] > capacities[best])) best = buffer;
+					}
+					if (best < 0)
+					{
+						capacities.push_back(size);
+						return (int)capacities.size() - 1;
+					}
+					free_buffers.erase(std::find(free_buffers.begin(), free_buffers.end(), best));
+					capacities[best] = std::max(capacities[best], size);
+					return best;
+				};
+
+				steps.clear();
+				for (size_t i = 0; i < num; i++)
+				{
+					if (!needed[i]) continue;
+					if (!nodes[i].layer)
+					{
+						shapes[i] = bound[(int)i];
+						buffer_of[i] = Allocate(Size(shapes[i]));
+						readers[i]++; // inputs are kept for the next Forward
+						continue;
+					}
+
+					std::vector<Shape> input_shapes;
+					for (int input : inputs[i]) input_shapes.push_back(shapes[input]);
+					std::vector<Shape> output_shapes = nodes[i].layer->Reshape(input_shapes);
+					CHECK_EQ(1, output_shapes.size()) << "Node " << nodes[i].name << " has multiple outputs, which is not supported";
+					shapes[i] = output_shapes[0];
+
+					// Write over the first input if this is its last reader
+					const int first = inputs[i].empty() ? -1 : inputs[i][0];
+					if (first >= 0 && nodes[i].layer->InPlace() && readers[first] == 1 && Size(shapes[first]) == Size(shapes[i]))
+					{
+						buffer_of[i] = buffer_of[first];
+						readers[first] = 0;
+					}
+					else
+					{
+						buffer_of[i] = Allocate(Size(shapes[i]));
+					}
+
+					for (int input : inputs[i])
+					{
+						if (readers[input] > 0 && --readers[input] == 0) free_buffers.push_back(buffer_of[input]);
+					}
+					steps.push_back({ (int)i });
+				}
+
+				// Buffers only grow, so that reshaping back and forth does not allocate
+				buffers.resize(std::max(buffers.size(), capacities.size()));
+				for (size_t b = 0; b < capacities.size(); b++)
+				{
+					if (buffers[b].size() < capacities[b]) buffers[b].resize(capacities[b]);
+				}
+
+				entries.assign(num, Tensor());
+				for (size_t i = 0; i < num; i++)
+				{
+					if (buffer_of[i] >= 0) entries[i] = Tensor(shapes[i], F32, buffers[buffer_of[i]].data());
+				}
+				for (auto& step : steps)
+				{
+					for (int input : inputs[step.node]) step.inputs.push_back(entries[input]);
+					step.outputs.push_back(entries[step.node]);
+				}
+			}
+
+			Ptr<NativeGraph> graph; // shared by the clones
+			std::string framework;
+
+			std::vector<std::string> input_names; // by input handle
+			std::vector<Shape> input_shapes; // by input handle
+
+			std::vector<Step> steps;
+			std::vector<Tensor> entries; // views of the buffers by node
+			std::vector<std::vector<float>> buffers;
+
+			ForwardSettings settings;
+
+			bool profiling = false;
+			std::vector<LayerTime> layer_times; // by step
+			LatencyWindow latency;
+		};
+
+		static void CheckDevice(const Context& ctx)
+		{
+			if (ctx.type != CPU)
+			{
+				LOG(WARNING) << "Native net runs on CPU only, device type " << ctx.type << " is ignored.";
+			}
+		}
+
+		static Ptr<NativeGraph> LoadGraph(const Model& model)
+		{
+			Ptr<NativeGraph> graph = std::make_shared<NativeGraph>();
+			if (model.from_file)
+			{
+				graph->LoadSymbol(ReadFile(model.symbol));
+				graph->LoadParams(ReadFile(model.weight));
+			}
+			else
+			{
+				graph->LoadSymbol(model.symbol);
+				graph->LoadParams(model.weight);
+			}
+			return graph;
+		}
+
+		Ptr<Net> LoadNative(const Model& model, const Context& ctx)
+		{
+			CheckDevice(ctx);
+
+			Ptr<NativeGraph> graph = LoadGraph(model);
+			graph->CreateLayers();
+			return Ptr<Net>(new NativeNet(graph, "Native"));
+		}
+
+		Ptr<Net> LoadCompiled(const Model& model, const Context& ctx)
+		{
+			CheckDevice(ctx);
+
+			Ptr<NativeGraph> graph = std::make_shared<NativeGraph>();
+			if (model.from_file)
+			{
+				size_t size;
+				Ptr<void> data = MapFile(model.weight, size);
+				graph->LoadCompiled(data, size);
+			}
+			else
+			{
+				Ptr<std::string> data = std::make_shared<std::string>(model.weight);
+				graph->LoadCompiled(Ptr<void>(data, &(*data)[0]), data->size());
+			}
+			graph->CreateLayers();
+			return Ptr<Net>(new NativeNet(graph, "Compiled"));
+		}
+
+		void CompileNative(const Model& model, const std::string& file)
+		{
+			LoadGraph(model)->SaveCompiled(file);
+		}
+	}
+}
+
+// Registered once by ChaosCV, the MxNet files by Native and the compiled files by Compiled
+REGISTER_FRAMEWORK(Native, "json", "params", chaos::dnn::LoadNative);
+REGISTER_FRAMEWORK(Compiled, "", "cnet", chaos::dnn::LoadCompiled);
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace chaos
+{
+	namespace dnn
+	{
+#ifdef _WIN32
+		static Ptr<void> MapFile(const std::string& file, size_t& size)
+		{
+			HANDLE handle = CreateFileA(file.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+			CHECK(handle != INVALID_HANDLE_VALUE) << "Can not open " << file;
+
+			LARGE_INTEGER file_size;
+			GetFileSizeEx(handle, &file_size);
+			size = (size_t)file_size.QuadPart;
+
+			HANDLE mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+			CloseHandle(handle);
+			CHECK(mapping != NULL) << "Can not map " << file;
+
+			void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+			CloseHandle(mapping);
+			CHECK(data != NULL) << "Can not map " << file;
+			return Ptr<void>(data, [](void* data) { UnmapViewOfFile(data); });
+		}
+#else
+		static Ptr<void> MapFile(const std::string& file, size_t& size)
+		{
+			int fd = open(file.c_str(), O_RDONLY);
+			CHECK_LE(0, fd) << "Can not open " << file;
+
+			struct stat st;
+			fstat(fd, &st);
+			size = (size_t)st.st_size;
+
+			void* data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+			close(fd);
+			CHECK(data != MAP_FAILED) << "Can not map " << file;
+			return Ptr<void>(data, [size](void* data) { munmap(data, size); });
+		}
+#endif
+	}
+}
@@ -1,18 +1,233 @@
 #include "dnn/net.hpp"
 #include "dnn/reg.hpp"
 
+#include <cfloat>
+#include <iomanip>
+#include <numeric>
+
 namespace chaos
 {
 	namespace dnn
 	{
 		Context::Context() {};
-		Context::Context(const DeviceType& type, int id) : type(type), id(id) {};
+		Context::Context(const DeviceType& type, int id, const std::string& framework) : type(type), id(id), framework(framework) {};
 
 		Model::Model() {}
 		Model::Model(const std::string& weight) : symbol(std::string()), weight(weight) {}
 		Model::Model(const std::string& symbol, const std::string& weight) : symbol(symbol), weight(weight) {}
 
+		double CacheStats::HitRate() const
+		{
+			return hits + misses ? (double)hits / (hits + misses) : 0.;
+		}
+
+		LatencyWindow::LatencyWindow(size_t capacity) : capacity(capacity)
+		{
+			CHECK_LT(0, capacity);
+			latencies.reserve(capacity);
+		}
+		void LatencyWindow::Add(double ms)
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			if (latencies.size() < capacity)
+			{
+				latencies.push_back(ms);
+			}
+			else
+			{
+				latencies[next] = ms;
+			}
+			next = (next + 1) % capacity;
+			count++;
+		}
+		LatencyStats LatencyWindow::GetStats() const
+		{
+			std::vector<double> sorted;
+			LatencyStats stats;
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				sorted = latencies;
+				stats.count = count;
+			}
+			if (sorted.empty()) return stats;
+
+			std::sort(sorted.begin(), sorted.end());
+			auto Percentile = [&](double p) { return sorted[std::min(sorted.size() - 1, (size_t)(p * sorted.size()))]; };
+			stats.window = sorted.size();
+			stats.mean = std::accumulate(sorted.begin(), sorted.end(), 0.) / sorted.size();
+			stats.p50 = Percentile(0.50);
+			stats.p95 = Percentile(0.95);
+			stats.p99 = Percentile(0.99);
+			stats.max = sorted.back();
+			return stats;
+		}
+
+		std::string ForwardSettings::ToString() const
+		{
+			return "threads " + std::to_string(threads) + ", grain " + std::to_string(grain);
+		}
+
 		Net::~Net() {}
+		void Net::SetExecutorCache(int capacity, bool bucketing) {}
+		CacheStats Net::GetCacheStats() const { return CacheStats(); }
+		void Net::SetProfiling(bool enable) {}
+		std::vector<LayerTime> Net::GetLayerTimes() const { return std::vector<LayerTime>(); }
+		LatencyStats Net::GetLatencyStats() const { return LatencyStats(); }
+		void Net::SetForwardSettings(const ForwardSettings& settings) {}
+		ForwardSettings Net::GetForwardSettings() const { return ForwardSettings(); }
+		std::vector<ForwardSettings> Net::GetTuningSpace() const { return { ForwardSettings() }; }
+
+		// Key of the inputs in the tune file, without spaces, e.g. Native/data:1x3x112x112
+		static std::string TuneKey(const std::string& framework, std::vector<DataLayer> inputs)
+		{
+			std::sort(inputs.begin(), inputs.end(), [](const DataLayer& a, const DataLayer& b) { return a.name < b.name; });
+			std::string key = framework + "/";
+			for (size_t i = 0; i < inputs.size(); i++)
+			{
+				key += (i ? ";" : "") + inputs[i].name + ":";
+				for (size_t j = 0; j < inputs[i].shape.Size(); j++)
+				{
+					key += (j ? "x" : "") + std::to_string(inputs[i].shape[j]);
+				}
+			}
+			return key;
+		}
+
+		void Net::BindExecutor(const std::vector<DataLayer>& inputs, const BindOptions& options)
+		{
+			std::vector<std::vector<DataLayer>> shapes = { inputs };
+			shapes.insert(shapes.end(), options.shapes.begin(), options.shapes.end());
+
+			// Dummy inputs, and the first output which is got to wait for the forward
+			auto Run = [&](const std::vector<DataLayer>& layers, int forwards) {
+				std::vector<std::pair<int, Tensor>> data;
+				for (const auto& layer : layers)
+				{
+					Tensor dummy(layer.shape, F32);
+					memset(dummy.data, 0, dummy.Size() * sizeof(float));
+					data.push_back({ GetInputHandle(layer.name), dummy });
+				}
+				Tensor output;
+				std::vector<double> times;
+				for (int i = 0; i < forwards; i++)
+				{
+					const int64 start = cv::getTickCount();
+					for (const auto& input : data) SetLayerData(input.first, input.second);
+					Forward();
+					GetLayerData(0, output);
+					times.push_back((cv::getTickCount() - start) * 1000. / cv::getTickFrequency());
+				}
+				std::sort(times.begin(), times.end());
+				return times.empty() ? 0. : times[times.size() / 2];
+			};
+
+			std::map<std::string, ForwardSettings> loaded;
+			if (!options.tune_file.empty())
+			{
+				std::ifstream fs(options.tune_file);
+				std::string key;
+				ForwardSettings settings;
+				while (fs >> key >> settings.threads >> settings.grain)
+				{
+					loaded[key] = settings;
+				}
+			}
+
+			bool updated = false;
+			BindExecutor(inputs);
+			// Each shape keeps its executor, otherwise the next shape evicts the one just warmed
+			const CacheStats cache = GetCacheStats();
+			if (cache.capacity < (int)shapes.size()) SetExecutorCache((int)shapes.size(), cache.bucketing);
+			for (size_t i = 0; i < shapes.size(); i++)
+			{
+				if (i) Reshape(shapes[i]);
+				if (options.tune_file.empty()) continue;
+
+				const std::string key = TuneKey(GetFramework().name, shapes[i]);
+				if (loaded.count(key))
+				{
+					tuned_settings[key] = loaded[key];
+					continue;
+				}
+
+				double best_ms = DBL_MAX;
+				for (const auto& settings : GetTuningSpace())
+				{
+					SetForwardSettings(settings);
+					Run(shapes[i], 2);
+					const double ms = Run(shapes[i], options.tune_forwards);
+					if (ms < best_ms)
+					{
+						best_ms = ms;
+						tuned_settings[key] = settings;
+					}
+				}
+				loaded[key] = tuned_settings[key];
+				updated = true;
+				LOG(INFO) << "Tuned " << key << " to " << tuned_settings[key].ToString() << ", " << best_ms << " ms";
+			}
+
+			if (updated)
+			{
+				std::ofstream fs(options.tune_file);
+				CHECK(fs.good()) << "Can not write " << options.tune_file;
+				for (const auto& settings : loaded)
+				{
+					fs << settings.first << " " << settings.second.threads << " " << settings.second.grain << std::endl;
+				}
+			}
+
+			for (size_t i = 0; i < shapes.size() && options.warmup > 0; i++)
+			{
+				Reshape(shapes[i]);
+				Run(shapes[i], options.warmup);
+			}
+			Reshape(inputs);
+		}
+
+		void Net::ApplyTunedSettings(const std::vector<DataLayer>& inputs)
+		{
+			if (tuned_settings.empty()) return;
+
+			auto settings = tuned_settings.find(TuneKey(GetFramework().name, inputs));
+			SetForwardSettings(settings != tuned_settings.end() ? settings->second : ForwardSettings());
+		}
+
+		std::string Net::DumpProfile(const std::string& file)
+		{
+			auto Quote = [](const std::string& str) {
+				std::string quoted = "\"";
+				for (auto c : str)
+				{
+					if (c == '"' || c == '\\') quoted.push_back('\\');
+					quoted.push_back(c);
+				}
+				return quoted + "\"";
+			};
+
+			const LatencyStats stats = GetLatencyStats();
+			std::stringstream json;
+			json << std::setprecision(6) << "{" << std::endl
+				<< "  \"framework\": " << Quote(GetFramework().name) << "," << std::endl
+				<< "  \"latency\": {\"count\": " << stats.count << ", \"window\": " << stats.window << ", \"mean\": " << stats.mean
+				<< ", \"p50\": " << stats.p50 << ", \"p95\": " << stats.p95 << ", \"p99\": " << stats.p99 << ", \"max\": " << stats.max << "}," << std::endl
+				<< "  \"layers\": [";
+			const std::vector<LayerTime> times = GetLayerTimes();
+			for (size_t i = 0; i < times.size(); i++)
+			{
+				json << (i ? "," : "") << std::endl
+					<< "    {\"name\": " << Quote(times[i].name) << ", \"op\": " << Quote(times[i].op) << ", \"ms\": " << times[i].ms << "}";
+			}
+			json << (times.empty() ? "" : "\n  ") << "]" << std::endl << "}" << std::endl;
+
+			if (!file.empty())
+			{
+				std::ofstream fs(file);
+				CHECK(fs.good()) << "Can not write " << file;
+				fs << json.str();
+			}
+			return json.str();
+		}
 		Ptr<Net> Net::Load(const Model& model, const Context& ctx)
 		{
 			CHECK(model.from_file) << "General load funcion just support load net from file.";
@@ -20,16 +235,29 @@ namespace chaos
 			File symbol(model.symbol);
 			File weight(model.weight);
 
-			for (auto framework : Registered::frameworks)
+			// The native net reads the files of MxNet too, so it only loads them if asked for or if MxNet is not built in
+			const Framework* fallback = nullptr;
+			for (const auto& framework : Registered::Frameworks())
 			{
+				if (!ctx.framework.empty() && framework.name != ctx.framework) continue;
 				if (framework.symbol_type == symbol.Type && framework.weight_type == weight.Type)
 				{
+					if (ctx.framework.empty() && framework.name == "Native")
+					{
+						fallback = &framework;
+						continue;
+					}
 					return framework.load_func(model, ctx);
 				}
 			}
-			LOG(FATAL) << "Unknown inference framework for ." << symbol.Type << " and ." << weight.Type << " files.";
+			if (fallback) return fallback->load_func(model, ctx);
+			LOG(FATAL) << "Unknown inference framework " << ctx.framework << " for ." << symbol.Type << " and ." << weight.Type << " files.";
 			return Ptr<Net>(); // Never reachable
 		}
+		std::string Net::TuneFile(const Model& model)
+		{
+			return model.weight + ".tune";
+		}
 
 		Framework::Framework() {}
 		Framework::Framework(const std::string& name) : name(name) {}
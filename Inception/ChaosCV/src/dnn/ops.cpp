@@ -0,0 +1,349 @@
+#include "dnn/ops.hpp"
+#include "dnn/simd.hpp"
+
+#include <numeric>
+
+namespace chaos
+{
+	namespace dnn
+	{
+		static Tensor Input(const Tensor& src)
+		{
+			CHECK_LT(0, src.dims) << "Empty tensor";
+			return src.ConvertTo(F32).Flatten();
+		}
+
+		// Create an empty dst as a continue tensor of shape and depth, otherwise dst must already be one
+		// A dst which is not empty may be a view or user data the caller expects the result in, so it is never replaced
+		static void Output(Tensor& dst, const Shape& shape, const Depth& depth = F32)
+		{
+			if (!dst.data)
+			{
+				Allocator* allocator = dst.allocator;
+				dst = Tensor(shape, depth, false, allocator);
+				return;
+			}
+			const bool view = !dst.ref_cnt || dst.data != dst.buffer;
+			CHECK(dst.shape == shape && dst.depth == depth && dst.IsContinue())
+				<< "dst " << (view ? "view " : "") << "of " << dst.shape << " can not take the continue result of " << shape;
+		}
+
+		// Kernels of one row, tails are left to the scalar loops
+
+		template<class V>
+		static void SoftmaxRow(const float* src, float* dst, int n)
+		{
+			int i = 0;
+			typename V::Type vmax = V::Set(-FLT_MAX);
+			for (; i + V::N <= n; i += V::N) vmax = V::Max(vmax, V::Load(src + i));
+			float max = V::ReduceMax(vmax);
+			for (; i < n; i++) max = std::max(max, src[i]);
+
+			typename V::Type vsum = V::Set(0.f);
+			vmax = V::Set(max);
+			for (i = 0; i + V::N <= n; i += V::N)
+			{
+				typename V::Type e = V::Exp(V::Sub(V::Load(src + i), vmax));
+				V::Store(dst + i, e);
+				vsum = V::Add(vsum, e);
+			}
+			float sum = V::ReduceSum(vsum);
+			for (; i < n; i++)
+			{
+				dst[i] = std::exp(src[i] - max);
+				sum += dst[i];
+			}
+
+			float inv = 1.f / sum;
+			typename V::Type vinv = V::Set(inv);
+			for (i = 0; i + V::N <= n; i += V::N) V::Store(dst + i, V::Mul(V::Load(dst + i), vinv));
+			for (; i < n; i++) dst[i] *= inv;
+		}
+
+		// Softmax of V::N adjacent columns over k elements which are stride apart
+		template<class V>
+		static void SoftmaxColumns(const float* src, float* dst, int k, size_t stride)
+		{
+			typename V::Type max = V::Set(-FLT_MAX);
+			for (int j = 0; j < k; j++) max = V::Max(max, V::Load(src + j * stride));
+
+			typename V::Type sum = V::Set(0.f);
+			for (int j = 0; j < k; j++)
+			{
+				typename V::Type e = V::Exp(V::Sub(V::Load(src + j * stride), max));
+				V::Store(dst + j * stride, e);
+				sum = V::Add(sum, e);
+			}
+
+			typename V::Type inv = V::Div(V::Set(1.f), sum);
+			for (int j = 0; j < k; j++) V::Store(dst + j * stride, V::Mul(V::Load(dst + j * stride), inv));
+		}
+
+		template<class V>
+		static float DotRow(const float* a, const float* b, int n)
+		{
+			int i = 0;
+			typename V::Type vsum = V::Set(0.f);
+			for (; i + V::N <= n; i += V::N) vsum = V::Add(vsum, V::Mul(V::Load(a + i), V::Load(b + i)));
+			float sum = V::ReduceSum(vsum);
+			for (; i < n; i++) sum += a[i] * b[i];
+			return sum;
+		}
+
+		template<class V>
+		static float CosineRow(const float* a, const float* b, int n)
+		{
+			int i = 0;
+			typename V::Type vab = V::Set(0.f), vaa = V::Set(0.f), vbb = V::Set(0.f);
+			for (; i + V::N <= n; i += V::N)
+			{
+				typename V::Type va = V::Load(a + i);
+				typename V::Type vb = V::Load(b + i);
+				vab = V::Add(vab, V::Mul(va, vb));
+				vaa = V::Add(vaa, V::Mul(va, va));
+				vbb = V::Add(vbb, V::Mul(vb, vb));
+			}
+			float ab = V::ReduceSum(vab), aa = V::ReduceSum(vaa), bb = V::ReduceSum(vbb);
+			for (; i < n; i++)
+			{
+				ab += a[i] * b[i];
+				aa += a[i] * a[i];
+				bb += b[i] * b[i];
+			}
+			float norm = std::sqrt(aa * bb);
+			return norm > 0.f ? ab / norm : 0.f;
+		}
+
+		template<class V>
+		static void ScaleRow(const float* src, float* dst, int n, float alpha, float beta)
+		{
+			int i = 0;
+			typename V::Type va = V::Set(alpha), vb = V::Set(beta);
+			for (; i + V::N <= n; i += V::N) V::Store(dst + i, V::Add(V::Mul(V::Load(src + i), va), vb));
+			for (; i < n; i++) dst[i] = src[i] * alpha + beta;
+		}
+
+		enum BinaryOp { ADD, SUB, MUL, DIV };
+
+		template<class V, BinaryOp OP>
+		static inline typename V::Type Apply(typename V::Type a, typename V::Type b)
+		{
+			if constexpr (OP == ADD) return V::Add(a, b);
+			else if constexpr (OP == SUB) return V::Sub(a, b);
+			else if constexpr (OP == MUL) return V::Mul(a, b);
+			else return V::Div(a, b);
+		}
+
+		template<class V, BinaryOp OP>
+		static void BinaryRow(const float* a, const float* b, float* dst, int n)
+		{
+			int i = 0;
+			for (; i + V::N <= n; i += V::N) V::Store(dst + i, Apply<V, OP>(V::Load(a + i), V::Load(b + i)));
+			for (; i < n; i++) dst[i] = Apply<Float1, OP>(a[i], b[i]);
+		}
+
+		template<class V>
+		static int64 ArgMaxRow(const float* src, int n)
+		{
+			int i = 0;
+			typename V::Type vmax = V::Set(-FLT_MAX);
+			for (; i + V::N <= n; i += V::N) vmax = V::Max(vmax, V::Load(src + i));
+			float max = V::ReduceMax(vmax);
+			for (; i < n; i++) max = std::max(max, src[i]);
+
+			// The first one of the max
+			for (i = 0; i < n && src[i] != max; i++);
+			return i < n ? i : 0; // All NaN
+		}
+
+		std::string GetOpsISA()
+		{
+			switch (GetISA())
+			{
+			case AVX2:
+				return "AVX2";
+			case SSE41:
+				return "SSE4.1";
+			default:
+				return "Scalar";
+			}
+		}
+
+		void Softmax(const Tensor& src, Tensor& dst, int axis)
+		{
+			const Tensor input = Input(src);
+			if (axis < 0) axis += input.dims;
+			CHECK(axis >= 0 && axis < input.dims) << "Axis " << axis << " out of range";
+
+			// outer x k x inner, the softmax is over k
+			size_t outer = 1, inner = 1;
+			for (int i = 0; i < axis; i++) outer *= input.shape[i];
+			for (int i = axis + 1; i < input.dims; i++) inner *= input.shape[i];
+			const int k = input.shape[axis];
+
+			Output(dst, input.shape);
+			const float* src_data = (const float*)input.data;
+			float* dst_data = (float*)dst.data;
+			Dispatch([&](auto v) {
+				using V = decltype(v);
+				ForEach(outer, k * inner, [&](size_t o) {
+					const float* s = src_data + o * k * inner;
+					float* d = dst_data + o * k * inner;
+					if (inner == 1)
+					{
+						SoftmaxRow<V>(s, d, k);
+						return;
+					}
+
+					size_t j = 0;
+					for (; j + V::N <= inner; j += V::N) SoftmaxColumns<V>(s + j, d + j, k, inner);
+					for (; j < inner; j++) SoftmaxColumns<Float1>(s + j, d + j, k, inner);
+				});
+			});
+		}
+
+		void L2Normalize(const Tensor& src, Tensor& dst)
+		{
+			const Tensor input = Input(src);
+			const int n = input.shape.back();
+			const size_t rows = input.Size() / n;
+
+			Output(dst, input.shape);
+			const float* src_data = (const float*)input.data;
+			float* dst_data = (float*)dst.data;
+			Dispatch([&](auto v) {
+				using V = decltype(v);
+				ForEach(rows, n, [&](size_t r) {
+					const float* s = src_data + r * n;
+					float norm = std::sqrt(DotRow<V>(s, s, n));
+					ScaleRow<V>(s, dst_data + r * n, n, norm > 0.f ? 1.f / norm : 0.f, 0.f);
+				});
+			});
+		}
+
+		// Rows of a against the rows of b, or the one row of b
+		static void RowsOp(const Tensor& a, const Tensor& b, Tensor& dst, bool cosine)
+		{
+			const Tensor x = Input(a);
+			const Tensor y = Input(b);
+			const int n = x.shape.back();
+			const size_t rows = x.Size() / n;
+			CHECK(y.Size() == (size_t)n || y.Size() == x.Size()) << "b must have one row or the rows of a, " << y.shape << " vs " << x.shape;
+			const size_t y_step = y.Size() == x.Size() ? n : 0;
+
+			Output(dst, { (int)rows });
+			const float* x_data = (const float*)x.data;
+			const float* y_data = (const float*)y.data;
+			float* dst_data = (float*)dst.data;
+			Dispatch([&](auto v) {
+				using V = decltype(v);
+				ForEach(rows, n, [&](size_t r) {
+					dst_data[r] = cosine ? CosineRow<V>(x_data + r * n, y_data + r * y_step, n) : DotRow<V>(x_data + r * n, y_data + r * y_step, n);
+				});
+			});
+		}
+
+		void Dot(const Tensor& a, const Tensor& b, Tensor& dst) { RowsOp(a, b, dst, false); }
+		void Cosine(const Tensor& a, const Tensor& b, Tensor& dst) { RowsOp(a, b, dst, true); }
+
+		template<BinaryOp OP>
+		static void Binary(const Tensor& a, const Tensor& b, Tensor& dst)
+		{
+			const Tensor x = Input(a);
+			const Tensor y = Input(b);
+			const size_t size = y.Size();
+			CHECK_EQ(0, x.Size() % size) << "b must have the size of a or of its trailing dims, " << y.shape << " vs " << x.shape;
+			const size_t repeats = x.Size() / size;
+
+			Output(dst, x.shape);
+			const float* x_data = (const float*)x.data;
+			const float* y_data = (const float*)y.data;
+			float* dst_data = (float*)dst.data;
+			Dispatch([&](auto v) {
+				using V = decltype(v);
+				ForEach(repeats, size, [&](size_t r) {
+					BinaryRow<V, OP>(x_data + r * size, y_data, dst_data + r * size, (int)size);
+				});
+			});
+		}
+
+		void Add(const Tensor& a, const Tensor& b, Tensor& dst) { Binary<ADD>(a, b, dst); }
+		void Sub(const Tensor& a, const Tensor& b, Tensor& dst) { Binary<SUB>(a, b, dst); }
+		void Mul(const Tensor& a, const Tensor& b, Tensor& dst) { Binary<MUL>(a, b, dst); }
+		void Div(const Tensor& a, const Tensor& b, Tensor& dst) { Binary<DIV>(a, b, dst); }
+
+		void Scale(const Tensor& src, float alpha, float beta, Tensor& dst)
+		{
+			const Tensor input = Input(src);
+			const size_t size = input.Size();
+
+			Output(dst, input.shape);
+			Dispatch([&](auto v) {
+				using V = decltype(v);
+				ScaleRow<V>((const float*)input.data, (float*)dst.data, (int)size, alpha, beta);
+			});
+		}
+
+		void Axpy(float alpha, const Tensor& x, Tensor& y)
+		{
+			const Tensor input = Input(x);
+			CHECK_EQ(F32, y.depth);
+			CHECK(y.IsContinue()) << "y is updated in place, it must be continue";
+			CHECK_EQ(input.Size(), y.Size());
+
+			const size_t size = input.Size();
+			Dispatch([&](auto v) {
+				using V = decltype(v);
+				const float* x_data = (const float*)input.data;
+				float* y_data = (float*)y.data;
+				typename V::Type va = V::Set(alpha);
+				size_t i = 0;
+				for (; i + V::N <= size; i += V::N) V::Store(y_data + i, V::Add(V::Load(y_data + i), V::Mul(va, V::Load(x_data + i))));
+				for (; i < size; i++) y_data[i] += alpha * x_data[i];
+			});
+		}
+
+		void ArgMax(const Tensor& src, Tensor& dst)
+		{
+			const Tensor input = Input(src);
+			const int n = input.shape.back();
+			const size_t rows = input.Size() / n;
+
+			Output(dst, { (int)rows }, S64);
+			const float* src_data = (const float*)input.data;
+			int64* dst_data = (int64*)dst.data;
+			Dispatch([&](auto v) {
+				using V = decltype(v);
+				ForEach(rows, n, [&](size_t r) { dst_data[r] = ArgMaxRow<V>(src_data + r * n, n); });
+			});
+		}
+
+		void TopK(const Tensor& src, int k, Tensor& values, Tensor& indices, bool largest)
+		{
+			const Tensor input = Input(src);
+			const int n = input.shape.back();
+			const size_t rows = input.Size() / n;
+			CHECK(k > 0 && k <= n) << "k must be in [1, " << n << "]";
+
+			Output(values, { (int)rows, k });
+			Output(indices, { (int)rows, k }, S64);
+			const float* src_data = (const float*)input.data;
+			float* values_data = (float*)values.data;
+			int64* indices_data = (int64*)indices.data;
+			ForEach(rows, n, [&](size_t r) {
+				const float* row = src_data + r * n;
+				std::vector<int> order(n);
+				std::iota(order.begin(), order.end(), 0);
+				// Only the first k are sorted, O(n log k)
+				std::partial_sort(order.begin(), order.begin() + k, order.end(), [&](int i, int j) {
+					return row[i] == row[j] ? i < j : (largest ? row[i] > row[j] : row[i] < row[j]);
+				});
+				for (int i = 0; i < k; i++)
+				{
+					values_data[r * k + i] = row[order[i]];
+					indices_data[r * k + i] = order[i];
+				}
+			});
+		}
+	}
+}
@@ -4,23 +4,29 @@ namespace chaos
 {
 	namespace dnn
 	{
-		std::vector<Framework> Registered::frameworks = std::vector<Framework>();
+		// Constructed on first use, as the frameworks are registered by the statics of other units and modules
+		std::vector<Framework>& Registered::Frameworks()
+		{
+			static std::vector<Framework> frameworks;
+			return frameworks;
+		}
 		Framework& Registered::Have(const std::string& name)
 		{
-			return *std::find_if(frameworks.begin(), frameworks.end(),
+			return *std::find_if(Frameworks().begin(), Frameworks().end(),
 				[=](const Framework& f) { return f.name == name; });
 		}
 
 		Framework& Register(const std::string& name)
 		{
 			// If already registered, return it directly
-			auto it = std::find_if(Registered::frameworks.begin(), Registered::frameworks.end(),
+			std::vector<Framework>& frameworks = Registered::Frameworks();
+			auto it = std::find_if(frameworks.begin(), frameworks.end(),
 				[=](const Framework& f) { return f.name == name; });
 
-			if (Registered::frameworks.end() == it)
+			if (frameworks.end() == it)
 			{
-				Registered::frameworks.push_back(Framework(name));
-				return Registered::frameworks.back();
+				frameworks.push_back(Framework(name));
+				return frameworks.back();
 			}
 			return *it;
 		}
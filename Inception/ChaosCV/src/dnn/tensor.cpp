@@ -1,4 +1,7 @@
 #include "dnn/tensor.hpp"
+#include "dnn/transform.hpp"
+
+#include <intrin.h>
 
 namespace chaos
 {
@@ -19,6 +22,7 @@ namespace chaos
 			case S16:
 				return CV_16S;
 			case U16:
+			case BF16: // OpenCV has no bfloat16, viewed as raw bits
 				return CV_16U;
 			case S8:
 				return CV_8S;
@@ -74,6 +78,8 @@ namespace chaos
 				return "uint32";
 			case F16:
 				return "float16";
+			case BF16:
+				return "bfloat16";
 			case U8:
 				return "uint8";
 			case S8:
@@ -87,27 +93,104 @@ namespace chaos
 
 
 
-		Tensor::Tensor() : data(nullptr), ref_cnt(nullptr), allocator(nullptr), depth(U8), shape(Shape()), cstep(0), dims(0), aligned(false) {}
+		// Copy W elements of C channels, src[c] / dst[c] point to the first element of channel c
+		// and the elements of a channel are sx / dx apart
+		template<class Type>
+		static void CopyChannels(const Type* const* src, size_t sx, Type* const* dst, size_t dx, int C, int W)
+		{
+			for (int c = 0; c < C; c++)
+			{
+				if (sx == 1 && dx == 1)
+				{
+					memcpy(dst[c], src[c], W * sizeof(Type));
+				}
+				else
+				{
+					for (int x = 0; x < W; x++) dst[c][x * dx] = src[c][x * sx];
+				}
+			}
+		}
+
+		// Same as CopyChannels for 4 bytes elements. 4 planar channels are transposed with 4 pixels by SSE
+		// when the other side keeps them in adjacent lanes, which covers NCHW <-> NC4HW4 / NC8HW8 / NHWC
+		static void CopyChannels32(const float* const* src, size_t sx, float* const* dst, size_t dx, int C, int W)
+		{
+			int c = 0;
+			for (; c + 4 <= C; c += 4)
+			{
+				bool pack = sx == 1 && dx >= 4 && dst[c + 1] == dst[c] + 1 && dst[c + 2] == dst[c] + 2 && dst[c + 3] == dst[c] + 3;
+				bool unpack = dx == 1 && sx >= 4 && src[c + 1] == src[c] + 1 && src[c + 2] == src[c] + 2 && src[c + 3] == src[c] + 3;
+				if (!pack && !unpack)
+				{
+					CopyChannels(src + c, sx, dst + c, dx, 4, W);
+					continue;
+				}
+
+				int x = 0;
+				for (; x + 4 <= W; x += 4)
+				{
+					__m128 v[4];
+					if (pack)
+					{
+						for (int k = 0; k < 4; k++) v[k] = _mm_loadu_ps(src[c + k] + x);
+						_MM_TRANSPOSE4_PS(v[0], v[1], v[2], v[3]);
+						for (int i = 0; i < 4; i++) _mm_storeu_ps(dst[c] + (x + i) * dx, v[i]);
+					}
+					else
+					{
+						for (int i = 0; i < 4; i++) v[i] = _mm_loadu_ps(src[c] + (x + i) * sx);
+						_MM_TRANSPOSE4_PS(v[0], v[1], v[2], v[3]);
+						for (int k = 0; k < 4; k++) _mm_storeu_ps(dst[c + k] + x, v[k]);
+					}
+				}
+				for (int k = 0; k < 4; k++)
+				{
+					for (int i = x; i < W; i++) dst[c + k][i * dx] = src[c + k][i * sx];
+				}
+			}
+			CopyChannels(src + c, sx, dst + c, dx, C - c, W);
+		}
+
+		// Offset in elements of (n, c, h, 0) of a 4 dims tensor in any layout
+		static inline size_t RowOffset(const Tensor& tensor, int n, int c, int h)
+		{
+			const int pack = tensor.Pack();
+			return n * tensor.steps[0] + (c / pack) * tensor.steps[1] + c % pack + h * tensor.steps[2];
+		}
+
+
+		Tensor::Tensor() : data(nullptr), buffer(nullptr), ref_cnt(nullptr), allocator(nullptr), depth(U8), layout(NCHW), shape(Shape()), cstep(0), steps{ 0 }, dims(0), aligned(false) {}
 
-		Tensor::Tensor(const Shape& shape, const Depth& depth, bool aligned, Allocator* allocator) : Tensor()
+		Tensor::Tensor(const Shape& shape, const Depth& depth, bool aligned, Allocator* allocator, const Layout& layout) : Tensor()
 		{
-			Create(shape, depth, aligned, allocator);
+			Create(shape, depth, aligned, allocator, layout);
 		}
-		Tensor::Tensor(const Shape& shape, const Depth& depth, void* data, bool aligned, Allocator* allocator) 
-			: data(data), ref_cnt(nullptr), aligned(aligned), shape(shape), dims(static_cast<int>(shape.Size())), depth(depth), allocator(allocator)
+		Tensor::Tensor(const Shape& shape, const Depth& depth, void* data, bool aligned, Allocator* allocator, const Layout& layout)
+			: data(data), buffer(data), ref_cnt(nullptr), aligned(aligned), shape(shape), dims(static_cast<int>(shape.Size())), depth(depth), layout(layout), allocator(allocator)
 		{
 			//CHECK_NE(UNK, depth);
-			cstep = dims >= 2 ? (size_t)shape[dims - 1LL] * shape[dims - 2LL] : shape[0];
-			if (aligned) cstep = AlignSize(cstep * (depth >> DEPTH_SHIFT), MALLOC_ALIGN) / (depth >> DEPTH_SHIFT);
+			UpdateCStep();
+			UpdateSteps();
 		}
 
 		Tensor::Tensor(const Tensor& t) 
-			: data(t.data), ref_cnt(t.ref_cnt), aligned(t.aligned), shape(t.shape), dims(t.dims), depth(t.depth), cstep(t.cstep), allocator(t.allocator)
+			: data(t.data), buffer(t.buffer), ref_cnt(t.ref_cnt), aligned(t.aligned), shape(t.shape), dims(t.dims), depth(t.depth), layout(t.layout), cstep(t.cstep), allocator(t.allocator)
 		{
+			std::copy(t.steps, t.steps + Shape::MAX_DIMS, steps);
 			if (ref_cnt)
 				CHAOS_XADD(ref_cnt, 1);
 		}
 
+		Tensor::Tensor(Tensor&& t) noexcept
+			: data(t.data), buffer(t.buffer), ref_cnt(t.ref_cnt), aligned(t.aligned), shape(t.shape), dims(t.dims), depth(t.depth), layout(t.layout), cstep(t.cstep), allocator(t.allocator)
+		{
+			std::copy(t.steps, t.steps + Shape::MAX_DIMS, steps);
+			t.data = nullptr;
+			t.buffer = nullptr;
+			t.ref_cnt = nullptr;
+			t.Release();
+		}
+
 		Tensor::~Tensor()
 		{
 			Release();
@@ -124,24 +207,59 @@ namespace chaos
 			Release();
 
 			data = t.data;
+			buffer = t.buffer;
+			ref_cnt = t.ref_cnt;
+			aligned = t.aligned;
+			shape = t.shape;
+			dims = t.dims;
+			depth = t.depth;
+			layout = t.layout;
+			cstep = t.cstep;
+			std::copy(t.steps, t.steps + Shape::MAX_DIMS, steps);
+			allocator = t.allocator;
+
+			return *this;
+		}
+
+		Tensor& Tensor::operator=(Tensor&& t) noexcept
+		{
+			if (this == &t)
+				return *this;
+
+			Release();
+
+			data = t.data;
+			buffer = t.buffer;
 			ref_cnt = t.ref_cnt;
 			aligned = t.aligned;
 			shape = t.shape;
 			dims = t.dims;
 			depth = t.depth;
+			layout = t.layout;
 			cstep = t.cstep;
+			std::copy(t.steps, t.steps + Shape::MAX_DIMS, steps);
 			allocator = t.allocator;
 
+			t.data = nullptr;
+			t.buffer = nullptr;
+			t.ref_cnt = nullptr;
+			t.Release();
+
 			return *this;
 		}
 
-		Tensor Tensor::Unroll(const std::vector<Mat>& vdata, bool rechannel, bool aligned, Allocator* allocator)
+		Tensor Tensor::Unroll(const std::vector<Mat>& vdata, bool rechannel, bool aligned, Allocator* allocator, const Layout& layout)
 		{
 			CHECK(!vdata.empty());
 
+			// Packed layouts are repacked from the planar tensor
+			if (layout != NCHW && layout != NHWC) return Unroll(vdata, rechannel).ToLayout(layout, aligned, allocator);
+
 			Shape shape = { (int)vdata.size(), vdata[0].channels(), vdata[0].rows, vdata[0].cols };
-			Tensor tensor = Tensor(shape, Cast(vdata[0].depth()), aligned, allocator);
+			Tensor tensor = Tensor(shape, Cast(vdata[0].depth()), aligned, allocator, layout);
 
+			// Mat headers to the channels of the tensor, reused for all images
+			std::vector<Mat> slice(tensor.shape[1]);
 			for (int n = 0; n < tensor.shape[0]; n++)
 			{
 				CHECK_EQ(2, vdata[n].dims);
@@ -150,8 +268,21 @@ namespace chaos
 				CHECK_EQ(shape[2], vdata[n].rows);
 				CHECK_EQ(shape[3], vdata[n].cols);
 
-				std::vector<Mat> slice(tensor.shape[1]);
 				int c = rechannel ? shape[1] - 1 : 0;
+				if (layout == NHWC)
+				{
+					// The image is copied as it is, channels are reordered by mixChannels
+					Mat image(vdata[n].size(), vdata[n].type(), (uchar*)tensor.data + n * tensor.steps[0] * vdata[n].elemSize1());
+					std::vector<int> from_to;
+					for (int i = 0; i < shape[1]; i++)
+					{
+						from_to.push_back(i);
+						from_to.push_back(std::abs(c - i));
+					}
+					cv::mixChannels(&vdata[n], 1, &image, 1, from_to.data(), shape[1]);
+					continue;
+				}
+
 				for (int i = 0; i < shape[1]; i++)
 				{
 					int idx = std::abs(c - i);
@@ -167,16 +298,38 @@ namespace chaos
 		{
 			CHECK_EQ(4, dims);
 
+			if (Pack() > 1) return ToLayout(NCHW).Rollup(rechannel);
+
+			// Interleave in one pass for the common case
+			if (layout == NCHW && depth == F32 && shape[1] <= 4) return TensorToImages(*this, rechannel);
+
 			std::vector<Mat> _data;
 			for (int n = 0; n < shape[0]; n++)
 			{
 				Mat packed;
+				if (layout == NHWC)
+				{
+					// Images are already interleaved, only copied with the channels reordered
+					Mat image(shape[2], shape[3], CV_MAKETYPE(Cast(depth), shape[1]), (uchar*)data + steps[0] * n * (depth >> DEPTH_SHIFT), steps[2] * (depth >> DEPTH_SHIFT));
+					packed.create(image.size(), image.type());
+					std::vector<int> from_to;
+					int c = rechannel ? shape[1] - 1 : 0;
+					for (int i = 0; i < shape[1]; i++)
+					{
+						from_to.push_back(i);
+						from_to.push_back(std::abs(c - i));
+					}
+					cv::mixChannels(&image, 1, &packed, 1, from_to.data(), shape[1]);
+					_data.push_back(packed);
+					continue;
+				}
+
 				std::vector<cv::Mat> slice(shape[1]);
 				int c = rechannel ? shape[1] - 1 : 0;
 				for (int i = 0; i < shape[1]; i++)
 				{
 					int idx = std::abs(c - i);
-					slice[idx] = cv::Mat(shape[2], shape[3], Cast(depth), (uchar*)data + ((size_t)shape[1] * n + i) * cstep * (depth >> DEPTH_SHIFT));
+					slice[idx] = cv::Mat(shape[2], shape[3], Cast(depth), (uchar*)data + (steps[0] * n + steps[1] * i) * (depth >> DEPTH_SHIFT), steps[2] * (depth >> DEPTH_SHIFT));
 				}
 				cv::merge(slice, packed);
 
@@ -188,32 +341,35 @@ namespace chaos
 
 		Tensor::operator Mat() const
 		{
-			std::vector<size_t> steps;
-			switch (dims)
+			if (dims == 0) return Mat();
+
+			const size_t elem_size = depth >> DEPTH_SHIFT;
+			if (layout == NHWC)
 			{
-			default:
-				for (int i = 1; i < dims - 2; i++)
-				{
-					size_t step = cstep * (depth >> DEPTH_SHIFT);
-					for (int j = 0; j < dims - 2; j++)
-					{
-						step *= shape[j];
-					}
-					steps.push_back(step);
-				}
-			case 3:
-				steps.push_back(cstep * (depth >> DEPTH_SHIFT));
-			case 2:
-				steps.push_back((size_t)shape.back() * (depth >> DEPTH_SHIFT));
-			case 1:
-				steps.push_back((depth >> DEPTH_SHIFT));
+				int sizes[] = { shape[0], shape[2], shape[3] };
+				size_t bytes[] = { steps[0] * elem_size, steps[2] * elem_size, steps[3] * elem_size };
+				return Mat(3, sizes, CV_MAKETYPE(Cast(depth), shape[1]), data, bytes);
 			}
-			return Mat(dims, shape.data(), Cast(depth), data, steps.data());
+			if (Pack() > 1)
+			{
+				int sizes[] = { shape[0], (shape[1] + Pack() - 1) / Pack(), shape[2], shape[3] };
+				size_t bytes[] = { steps[0] * elem_size, steps[1] * elem_size, steps[2] * elem_size, steps[3] * elem_size };
+				return Mat(4, sizes, CV_MAKETYPE(Cast(depth), Pack()), data, bytes);
+			}
+
+			CHECK_EQ(1, steps[dims - 1LL]) << "Mat needs the elements of the last dim to be continue";
+
+			size_t bytes[Shape::MAX_DIMS];
+			for (int i = 0; i < dims; i++)
+			{
+				bytes[i] = steps[i] * (depth >> DEPTH_SHIFT);
+			}
+			return Mat(dims, shape.data(), Cast(depth), data, bytes);
 		}
 
-		void Tensor::Create(const Shape& _shape, const Depth& _depth, bool _aligned, Allocator* _allocator)
+		void Tensor::Create(const Shape& _shape, const Depth& _depth, bool _aligned, Allocator* _allocator, const Layout& _layout)
 		{
-			if (shape == _shape && depth == _depth && allocator == _allocator) return;
+			if (shape == _shape && depth == _depth && allocator == _allocator && layout == _layout) return;
 
 			Release();
 
@@ -223,65 +379,143 @@ namespace chaos
 			depth = _depth;
 			aligned = _aligned;
 			allocator = _allocator;
+			layout = _layout;
 
 			dims = static_cast<int>(shape.Size());
 
-			cstep = dims > 1 ? (size_t)shape[dims - 1LL] * shape[dims - 2LL] : shape[0];
-			if (aligned) cstep = AlignSize(cstep * (depth >> DEPTH_SHIFT), MALLOC_ALIGN) / (depth >> DEPTH_SHIFT);
+			UpdateCStep();
+			UpdateSteps();
 
 			if (Total() > 0)
 			{
 				size_t size = AlignSize(Total() * (depth >> DEPTH_SHIFT), 4);
+				AllocationTag tag("Tensor", /*fallback=*/true);
 				if (allocator)
 					data = allocator->FastMalloc(size + sizeof(*ref_cnt));
 				else
 					data = FastMalloc(size + sizeof(*ref_cnt));
+				buffer = data;
 				ref_cnt = (int*)(((uchar*)data) + size);
 				*ref_cnt = 1;
 			}
 		}
 
+		void Tensor::UpdateCStep()
+		{
+			CHECK(layout == NCHW || dims == 4) << "Layouts other than NCHW need 4 dims";
+
+			if (layout == NHWC)
+				cstep = (size_t)shape[1] * shape[2] * shape[3];
+			else if (Pack() > 1)
+				cstep = (size_t)shape[2] * shape[3] * Pack();
+			else
+				cstep = dims > 1 ? (size_t)shape[dims - 1LL] * shape[dims - 2LL] : shape[0];
+
+			if (aligned) cstep = AlignSize(cstep * (depth >> DEPTH_SHIFT), MALLOC_ALIGN) / (depth >> DEPTH_SHIFT);
+		}
+
+		void Tensor::UpdateSteps()
+		{
+			std::fill(steps, steps + Shape::MAX_DIMS, 0);
+			if (layout == NHWC)
+			{
+				steps[0] = cstep;
+				steps[1] = 1;
+				steps[2] = (size_t)shape[3] * shape[1];
+				steps[3] = shape[1];
+				return;
+			}
+			if (Pack() > 1)
+			{
+				steps[0] = cstep * ((shape[1] + Pack() - 1) / Pack());
+				steps[1] = cstep;
+				steps[2] = (size_t)shape[3] * Pack();
+				steps[3] = Pack();
+				return;
+			}
+
+			for (int i = dims - 1; i >= 0; i--)
+			{
+				if (i == dims - 1) steps[i] = 1;
+				else if (i == dims - 3) steps[i] = cstep;
+				else steps[i] = steps[i + 1LL] * shape[i + 1LL];
+			}
+		}
+
 
 		void Tensor::Release()
 		{
 			if (ref_cnt && CHAOS_XADD(ref_cnt, -1) == 1)
 			{
 				if (allocator)
-					allocator->FastFree(data);
+					allocator->FastFree(buffer);
 				else
-					FastFree(data);
+					FastFree(buffer);
 			}
 
-			Shape().Swap(shape);
+			shape = Shape();
 			depth = U8;
+			layout = NCHW;
 			dims = 0;
 			aligned = false;
+			std::fill(steps, steps + Shape::MAX_DIMS, 0);
 
 			data = nullptr;
+			buffer = nullptr;
 			ref_cnt = nullptr;
 		}
 
 		Tensor Tensor::Flatten() const
 		{
-			if (IsContinue())
+			if (layout != NCHW)
+			{
+				return ToLayout(NCHW, /*aligned=*/false, allocator);
+			}
+			else if (IsContinue())
 			{
 				return *this;
 			}
 			else
 			{
 				Tensor flattened = Tensor(shape, depth, /*aligned=*/false, allocator);
-				auto num = Total() / cstep;
-				for (int n = 0; n < num; n++)
+
+				// Copy the rows of the last dim one by one, walking the other dims like an odometer
+				size_t elem_size = depth >> DEPTH_SHIFT;
+				size_t row_size = shape.back() * elem_size;
+				size_t num_rows = Size() / shape.back();
+				int position[Shape::MAX_DIMS] = { 0 };
+				for (size_t r = 0; r < num_rows; r++)
 				{
-					const void* src = (unsigned char*)data + n * cstep * (depth >> DEPTH_SHIFT);
-					void* dst = (unsigned char*)flattened.data + n * flattened.cstep * (flattened.depth >> DEPTH_SHIFT);
-					memcpy(dst, src, flattened.cstep * (flattened.depth >> DEPTH_SHIFT));
+					size_t offset = 0;
+					for (int i = 0; i < dims - 1; i++)
+					{
+						offset += steps[i] * position[i];
+					}
+
+					const uchar* src = (const uchar*)data + offset * elem_size;
+					uchar* dst = (uchar*)flattened.data + r * row_size;
+					if (steps[dims - 1LL] == 1)
+					{
+						memcpy(dst, src, row_size);
+					}
+					else
+					{
+						for (int i = 0; i < shape.back(); i++)
+						{
+							memcpy(dst + i * elem_size, src + i * steps[dims - 1LL] * elem_size, elem_size);
+						}
+					}
+
+					for (int i = dims - 2; i >= 0 && ++position[i] == shape[i]; i--)
+					{
+						position[i] = 0;
+					}
 				}
 				return flattened;
 			}
 		}
 
-		Tensor Tensor::Reshape(const Shape& new_shape)
+		Tensor Tensor::Reshape(const Shape& new_shape) const
 		{
 			size_t new_size = 1;
 			for (auto n : new_shape)
@@ -290,35 +524,125 @@ namespace chaos
 			}
 			CHECK_EQ(Size(), new_size) << "Must keep the number of elements same.";
 
-			Tensor new_tensor = Tensor(new_shape, depth, aligned, allocator);
+			// A view of the continue buffer, only the shape and steps are changed
+			Tensor reshaped = Flatten();
+			reshaped.shape = new_shape;
+			reshaped.layout = NCHW;
+			reshaped.dims = static_cast<int>(new_shape.Size());
+			reshaped.aligned = false;
+			reshaped.cstep = reshaped.dims >= 2 ? (size_t)new_shape[reshaped.dims - 1LL] * new_shape[reshaped.dims - 2LL] : new_shape[0];
+			reshaped.UpdateSteps();
+			return reshaped;
+		}
 
-			if (!aligned)
+		Tensor Tensor::Slice(int axis, int begin, int end) const
+		{
+			CHECK(axis >= 0 && axis < dims) << "Axis " << axis << " out of range";
+			CHECK(begin >= 0 && begin < end && end <= shape[axis]) << "Invalid range [" << begin << ", " << end << ") for axis " << axis;
+
+			Tensor sliced = *this;
+			if (axis == 1 && Pack() > 1)
 			{
-				//new_tensor = Tensor(new_shape, depth, data, aligned, allocator); //???ƺⰡ
-				memcpy(new_tensor.data, data, Size() * depth); 
+				CHECK_EQ(0, begin % Pack()) << "Channel slices of " << Pack() << " packed tensors must begin at a block";
+				sliced.data = (uchar*)data + steps[1] * (begin / Pack()) * (depth >> DEPTH_SHIFT);
 			}
 			else
 			{
-				// Flatten
-				//new_tensor = Tensor(new_shape, depth, aligned, allocator);
-				Tensor flattened = Flatten();
-
-				// Copy to new shape
-				auto new_num = new_tensor.Total() / new_tensor.cstep;
-				auto csize = new_tensor.Size() / new_num;
-				for (int n = 0; n < new_num; n++)
+				sliced.data = (uchar*)data + steps[axis] * begin * (depth >> DEPTH_SHIFT);
+			}
+			sliced.shape[axis] = end - begin;
+			if (layout == NCHW && axis >= dims - 2)
+			{
+				// The planes are cut, cstep does not hold a whole plane any more
+				sliced.cstep = (size_t)sliced.shape[dims - 1LL] * (dims >= 2 ? sliced.shape[dims - 2LL] : 1);
+			}
+			return sliced;
+		}
+
+		Tensor Tensor::ConvertTo(const Depth& new_depth, Allocator* new_allocator) const
+		{
+			if (new_depth == depth) return *this;
+
+			const Tensor src = Flatten();
+			Tensor dst = Tensor(shape, new_depth, /*aligned=*/false, new_allocator);
+
+			std::function<void(size_t, size_t)> convert;
+			if (depth == F32 && new_depth == F16)
+				convert = [&](size_t i, size_t n) { FloatToHalf((const float*)src.data + i, (uint16_t*)dst.data + i, n); };
+			else if (depth == F16 && new_depth == F32)
+				convert = [&](size_t i, size_t n) { HalfToFloat((const uint16_t*)src.data + i, (float*)dst.data + i, n); };
+			else if (depth == F32 && new_depth == BF16)
+				convert = [&](size_t i, size_t n) { FloatToBFloat((const float*)src.data + i, (uint16_t*)dst.data + i, n); };
+			else if (depth == BF16 && new_depth == F32)
+				convert = [&](size_t i, size_t n) { BFloatToFloat((const uint16_t*)src.data + i, (float*)dst.data + i, n); };
+			else
+				LOG(FATAL) << "Do not support to convert " << ToString(depth) << " to " << ToString(new_depth);
+
+			// Large tensors are converted in parallel by chunks
+			constexpr size_t CHUNK = 64 * 1024;
+			size_t size = Size();
+			int num_chunks = (int)((size + CHUNK - 1) / CHUNK);
+			cv::parallel_for_(cv::Range(0, num_chunks), [&](const cv::Range& range) {
+				for (int i = range.start; i < range.end; i++)
 				{
-					const void* src = (unsigned char*)flattened.data + n * csize * (flattened.depth >> DEPTH_SHIFT);
-					void* dst = (unsigned char*)new_tensor.data + n * new_tensor.cstep * (new_tensor.depth >> DEPTH_SHIFT);
-					memcpy(dst, src, csize * (new_tensor.depth >> DEPTH_SHIFT));
+					convert(i * CHUNK, std::min(CHUNK, size - i * CHUNK));
 				}
-			}
+			});
+			return dst;
+		}
+
+		Tensor Tensor::ToLayout(const Layout& new_layout, bool new_aligned, Allocator* new_allocator) const
+		{
+			if (new_layout == layout) return *this;
+			CHECK_EQ(4, dims) << "Layouts other than NCHW need 4 dims";
+
+			const int C = shape[1];
+			const int H = shape[2];
+			const int W = shape[3];
+			const size_t elem_size = depth >> DEPTH_SHIFT;
+
+			Tensor dst = Tensor(shape, depth, new_aligned, new_allocator, new_layout);
+			// Lanes of the channels padded to a whole block are zeros
+			if (C % dst.Pack() != 0) memset(dst.data, 0, dst.Total() * elem_size);
+
+			cv::parallel_for_(cv::Range(0, shape[0] * H), [&](const cv::Range& range) {
+				std::vector<const uchar*> src_rows(C);
+				std::vector<uchar*> dst_rows(C);
+				for (int i = range.start; i < range.end; i++)
+				{
+					int n = i / H;
+					int y = i % H;
+					for (int c = 0; c < C; c++)
+					{
+						src_rows[c] = (const uchar*)data + RowOffset(*this, n, c, y) * elem_size;
+						dst_rows[c] = (uchar*)dst.data + RowOffset(dst, n, c, y) * elem_size;
+					}
 
-			return new_tensor;
+					switch (elem_size)
+					{
+					case 1:
+						CopyChannels((const uchar* const*)src_rows.data(), steps[3], (uchar* const*)dst_rows.data(), dst.steps[3], C, W);
+						break;
+					case 2:
+						CopyChannels((const uint16_t* const*)src_rows.data(), steps[3], (uint16_t* const*)dst_rows.data(), dst.steps[3], C, W);
+						break;
+					case 4: // Only moved, so any 4 bytes depth is copied as float
+						CopyChannels32((const float* const*)src_rows.data(), steps[3], (float* const*)dst_rows.data(), dst.steps[3], C, W);
+						break;
+					default:
+						CopyChannels((const int64* const*)src_rows.data(), steps[3], (int64* const*)dst_rows.data(), dst.steps[3], C, W);
+						break;
+					}
+				}
+			});
+
+			return dst;
 		}
 
 		size_t Tensor::Total() const
 		{
+			if (layout != NCHW) return steps[0] * shape[0];
+
 			size_t total = cstep;
 			for (int i = 0; i < dims - 2; i++) total *= shape[i];
 			return total;
@@ -333,8 +657,13 @@ namespace chaos
 
 		bool Tensor::IsContinue() const
 		{
-			if (dims < 3) return true;
-			return cstep == (size_t)shape[dims - 1LL] * shape[dims - 2LL];
+			size_t step = 1;
+			for (int i = dims - 1; i >= 0; i--)
+			{
+				if (shape[i] > 1 && steps[i] != step) return false;
+				step *= shape[i];
+			}
+			return true;
 		}
 
 		inline std::ostream& operator<<(std::ostream& stream, const Tensor& tensor)
@@ -345,6 +674,8 @@ namespace chaos
 			}
 			else
 			{
+				Tensor flattened = tensor.Flatten();
+
 				int num = 1;
 				for (int i = 0; i < tensor.dims - 2; i++)
 				{
@@ -353,11 +684,11 @@ namespace chaos
 
 				int h = tensor.shape[tensor.dims - 2LL];
 				int w = tensor.shape[tensor.dims - 1LL];
-				char* slice = (char*)tensor.data;
+				char* slice = (char*)flattened.data;
 				for (int i = 0; i < num; i++)
 				{
 					stream << Mat(h, w, Cast(tensor.depth), slice) << std::endl;
-					slice += tensor.cstep * (tensor.depth >> DEPTH_SHIFT);
+					slice += (size_t)h * w * (tensor.depth >> DEPTH_SHIFT);
 				}
 				//stream << Mat(h, w, Cast(tensor.depth), slice);
 			}
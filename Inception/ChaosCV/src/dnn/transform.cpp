@@ -0,0 +1,336 @@
+#include "dnn/transform.hpp"
+
+#include <intrin.h>
+
+namespace chaos
+{
+	namespace dnn
+	{
+		// Rows of one image converted by one job of parallel_for_, multiple of 4 for the transposed kernel
+		constexpr int BLOCK_ROWS = 16;
+
+		struct ConvertParam
+		{
+			int channels;
+			float mean[4]; // in the order of image channels
+			float scale[4];
+			int order[4]; // tensor channel of each image channel
+			bool transpose;
+		};
+
+		// Convert pixel x of row y in scalar
+		static inline void ConvertPixel(const uchar* src, float** planes, int x, int y, int width, int height, const ConvertParam& param)
+		{
+			size_t offset = param.transpose ? (size_t)x * height + y : (size_t)y * width + x;
+			for (int k = 0; k < param.channels; k++)
+			{
+				planes[param.order[k]][offset] = (src[x * param.channels + k] - param.mean[k]) * param.scale[k];
+			}
+		}
+
+		// Convert rows [y0, y1) of image to the channel planes of the tensor
+		static void ConvertRows(const Mat& image, float** planes, int y0, int y1, const ConvertParam& param, bool simd)
+		{
+			const int C = param.channels;
+			const int W = image.cols;
+			const int H = image.rows;
+
+			// Pixels which can be loaded by 16 bytes without reading over the row
+			const int vec_width = simd ? std::max(0, (W * C - 16) / C + 1) & ~3 : 0;
+
+			__m128i masks[4];
+			__m128 means[4], scales[4];
+			for (int k = 0; k < C && simd; k++)
+			{
+				// Byte k + j * C of the 16 bytes goes to the lowest byte of lane j
+				char m[16];
+				for (int j = 0; j < 16; j++) m[j] = (j & 3) == 0 ? (char)(k + (j >> 2) * C) : (char)0x80;
+				masks[k] = _mm_loadu_si128((const __m128i*)m);
+				means[k] = _mm_set1_ps(param.mean[k]);
+				scales[k] = _mm_set1_ps(param.scale[k]);
+			}
+
+			int y = y0;
+			if (param.transpose && simd)
+			{
+				// 4 rows at once, 4x4 blocks are transposed in registers
+				for (; y + 4 <= y1; y += 4)
+				{
+					const uchar* src[4] = { image.ptr(y), image.ptr(y + 1), image.ptr(y + 2), image.ptr(y + 3) };
+					int x = 0;
+					for (; x < vec_width; x += 4)
+					{
+						__m128i px[4];
+						for (int r = 0; r < 4; r++) px[r] = _mm_loadu_si128((const __m128i*)(src[r] + x * C));
+						for (int k = 0; k < C; k++)
+						{
+							__m128 v[4];
+							for (int r = 0; r < 4; r++)
+							{
+								v[r] = _mm_cvtepi32_ps(_mm_shuffle_epi8(px[r], masks[k]));
+								v[r] = _mm_mul_ps(_mm_sub_ps(v[r], means[k]), scales[k]);
+							}
+							_MM_TRANSPOSE4_PS(v[0], v[1], v[2], v[3]);
+							float* dst = planes[param.order[k]] + (size_t)x * H + y;
+							for (int i = 0; i < 4; i++) _mm_storeu_ps(dst + (size_t)i * H, v[i]);
+						}
+					}
+					for (; x < W; x++)
+					{
+						for (int r = 0; r < 4; r++) ConvertPixel(src[r], planes, x, y + r, W, H, param);
+					}
+				}
+			}
+
+			for (; y < y1; y++)
+			{
+				const uchar* src = image.ptr(y);
+				int x = 0;
+				if (!param.transpose)
+				{
+					for (; x < vec_width; x += 4)
+					{
+						__m128i px = _mm_loadu_si128((const __m128i*)(src + x * C));
+						for (int k = 0; k < C; k++)
+						{
+							__m128 v = _mm_cvtepi32_ps(_mm_shuffle_epi8(px, masks[k]));
+							v = _mm_mul_ps(_mm_sub_ps(v, means[k]), scales[k]);
+							_mm_storeu_ps(planes[param.order[k]] + (size_t)y * W + x, v);
+						}
+					}
+				}
+				for (; x < W; x++)
+				{
+					ConvertPixel(src, planes, x, y, W, H, param);
+				}
+			}
+		}
+
+		Tensor ImagesToTensor(const std::vector<Mat>& images, const Scalar& mean, const Scalar& scale, bool swap_rb, bool transpose, bool aligned, Allocator* allocator)
+		{
+			CHECK(!images.empty());
+			const int C = images[0].channels();
+			const int H = images[0].rows;
+			const int W = images[0].cols;
+			CHECK_EQ(CV_8U, images[0].depth()) << "Only 8-bit images are supported";
+			CHECK(C >= 1 && C <= 4) << "Only 1 ~ 4 channels are supported";
+			for (const auto& image : images)
+			{
+				CHECK_EQ(images[0].type(), image.type());
+				CHECK_EQ(H, image.rows);
+				CHECK_EQ(W, image.cols);
+			}
+
+			ConvertParam param;
+			param.channels = C;
+			param.transpose = transpose;
+			for (int k = 0; k < C; k++)
+			{
+				param.order[k] = swap_rb ? C - 1 - k : k;
+				param.mean[k] = (float)mean[param.order[k]];
+				param.scale[k] = (float)scale[param.order[k]];
+			}
+
+			Shape shape = { (int)images.size(), C, transpose ? W : H, transpose ? H : W };
+			Tensor tensor = Tensor(shape, F32, aligned, allocator);
+
+			bool simd = cv::checkHardwareSupport(CV_CPU_SSSE3);
+			int num_blocks = (H + BLOCK_ROWS - 1) / BLOCK_ROWS;
+			cv::parallel_for_(cv::Range(0, (int)images.size() * num_blocks), [&](const cv::Range& range) {
+				for (int i = range.start; i < range.end; i++)
+				{
+					int n = i / num_blocks;
+					int y0 = i % num_blocks * BLOCK_ROWS;
+
+					float* planes[4];
+					for (int c = 0; c < C; c++) planes[c] = (float*)tensor.data + ((size_t)n * C + c) * tensor.cstep;
+					ConvertRows(images[n], planes, y0, std::min(y0 + BLOCK_ROWS, H), param, simd);
+				}
+			});
+
+			return tensor;
+		}
+
+		std::vector<Mat> TensorToImages(const Tensor& tensor, bool swap_rb)
+		{
+			CHECK_EQ(4, tensor.dims);
+			CHECK_EQ(F32, tensor.depth);
+			const int N = tensor.shape[0];
+			const int C = tensor.shape[1];
+			const int H = tensor.shape[2];
+			const int W = tensor.shape[3];
+			CHECK(C >= 1 && C <= 4) << "Only 1 ~ 4 channels are supported";
+
+			// Elements in the rows must be continue
+			Tensor src = tensor.steps[3] == 1 ? tensor : tensor.Flatten();
+
+			std::vector<Mat> images(N);
+			for (auto& image : images) image.create(H, W, CV_32FC(C));
+
+			cv::parallel_for_(cv::Range(0, N * H), [&](const cv::Range& range) {
+				for (int i = range.start; i < range.end; i++)
+				{
+					int n = i / H;
+					int y = i % H;
+
+					// Missing channels read zeros, they are overwritten by the next pixel or never stored
+					const float zeros[4] = { 0 };
+					const float* planes[4];
+					for (int c = 0; c < C; c++)
+					{
+						int k = swap_rb ? C - 1 - c : c;
+						planes[k] = (const float*)src.data + n * src.steps[0] + c * src.steps[1] + y * src.steps[2];
+					}
+
+					float* dst = images[n].ptr<float>(y);
+					int x = 0;
+					// The last store of 4 pixels writes 4 floats from (x + 3) * C
+					for (; (x + 3) * C + 4 <= W * C; x += 4)
+					{
+						__m128 v[4];
+						for (int k = 0; k < 4; k++) v[k] = _mm_loadu_ps(k < C ? planes[k] + x : zeros);
+						_MM_TRANSPOSE4_PS(v[0], v[1], v[2], v[3]);
+						for (int j = 0; j < 4; j++) _mm_storeu_ps(dst + (size_t)(x + j) * C, v[j]);
+					}
+					for (; x < W; x++)
+					{
+						for (int k = 0; k < C; k++) dst[(size_t)x * C + k] = planes[k][x];
+					}
+				}
+			});
+
+			return images;
+		}
+
+		// Scalar conversions, see https://gist.github.com/rygorous/2156668
+		static inline uint16_t FloatToHalf(float value)
+		{
+			uint32_t bits;
+			memcpy(&bits, &value, sizeof(bits));
+			uint32_t sign = (bits >> 16) & 0x8000;
+			bits &= 0x7FFFFFFF;
+
+			if (bits >= 0x47800000) // Inf, NaN or too large
+			{
+				return (uint16_t)(sign | 0x7C00 | (bits > 0x7F800000 ? 0x200 : 0));
+			}
+			if (bits < 0x38800000) // Subnormal half or zero, rounded by adding 0.5f
+			{
+				float f;
+				memcpy(&f, &bits, sizeof(f));
+				f += 0.5f;
+				memcpy(&bits, &f, sizeof(bits));
+				return (uint16_t)(sign | (bits - 0x3F000000));
+			}
+			// Rebias the exponent and round to nearest even
+			bits += 0xC8000FFF + ((bits >> 13) & 1);
+			return (uint16_t)(sign | (bits >> 13));
+		}
+
+		static inline float HalfToFloat(uint16_t value)
+		{
+			uint32_t sign = (uint32_t)(value & 0x8000) << 16;
+			uint32_t bits = value & 0x7FFF;
+			if (bits >= 0x7C00) // Inf or NaN
+			{
+				bits = 0x7F800000 | ((bits & 0x3FF) << 13);
+			}
+			else if (bits >= 0x400) // Normal
+			{
+				bits = (bits << 13) + 0x38000000;
+			}
+			else // Subnormal or zero, bits * 2^-24
+			{
+				float f = bits * 5.9604645e-8f;
+				memcpy(&bits, &f, sizeof(bits));
+			}
+			bits |= sign;
+
+			float f;
+			memcpy(&f, &bits, sizeof(f));
+			return f;
+		}
+
+		static inline uint16_t FloatToBFloat(float value)
+		{
+			uint32_t bits;
+			memcpy(&bits, &value, sizeof(bits));
+			if ((bits & 0x7FFFFFFF) > 0x7F800000) return (uint16_t)((bits >> 16) | 0x40); // Quiet NaN
+			return (uint16_t)((bits + 0x7FFF + ((bits >> 16) & 1)) >> 16);
+		}
+
+		static inline float BFloatToFloat(uint16_t value)
+		{
+			uint32_t bits = (uint32_t)value << 16;
+			float f;
+			memcpy(&f, &bits, sizeof(f));
+			return f;
+		}
+
+		void FloatToHalf(const float* src, uint16_t* dst, size_t n)
+		{
+			size_t i = 0;
+			if (cv::checkHardwareSupport(CV_CPU_FP16))
+			{
+				for (; i + 8 <= n; i += 8)
+				{
+					__m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+					_mm_storeu_si128((__m128i*)(dst + i), h);
+				}
+			}
+			for (; i < n; i++) dst[i] = FloatToHalf(src[i]);
+		}
+
+		void HalfToFloat(const uint16_t* src, float* dst, size_t n)
+		{
+			size_t i = 0;
+			if (cv::checkHardwareSupport(CV_CPU_FP16))
+			{
+				for (; i + 8 <= n; i += 8)
+				{
+					_mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(src + i))));
+				}
+			}
+			for (; i < n; i++) dst[i] = HalfToFloat(src[i]);
+		}
+
+		void FloatToBFloat(const float* src, uint16_t* dst, size_t n)
+		{
+			size_t i = 0;
+			if (cv::checkHardwareSupport(CV_CPU_AVX2))
+			{
+				const __m256i one = _mm256_set1_epi32(1);
+				const __m256i bias = _mm256_set1_epi32(0x7FFF);
+				const __m256i quiet = _mm256_set1_epi32(0x40);
+				auto round = [&](__m256 v) {
+					__m256i bits = _mm256_castps_si256(v);
+					__m256i high = _mm256_srli_epi32(bits, 16);
+					__m256i rounded = _mm256_srli_epi32(_mm256_add_epi32(_mm256_add_epi32(bits, bias), _mm256_and_si256(high, one)), 16);
+					__m256i nan = _mm256_castps_si256(_mm256_cmp_ps(v, v, _CMP_UNORD_Q));
+					return _mm256_blendv_epi8(rounded, _mm256_or_si256(high, quiet), nan);
+				};
+				for (; i + 16 <= n; i += 16)
+				{
+					// packus interleaves the 128-bit lanes, permute them back
+					__m256i packed = _mm256_packus_epi32(round(_mm256_loadu_ps(src + i)), round(_mm256_loadu_ps(src + i + 8)));
+					_mm256_storeu_si256((__m256i*)(dst + i), _mm256_permute4x64_epi64(packed, 0xD8));
+				}
+			}
+			for (; i < n; i++) dst[i] = FloatToBFloat(src[i]);
+		}
+
+		void BFloatToFloat(const uint16_t* src, float* dst, size_t n)
+		{
+			size_t i = 0;
+			if (cv::checkHardwareSupport(CV_CPU_AVX2))
+			{
+				for (; i + 8 <= n; i += 8)
+				{
+					__m256i bits = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(src + i)));
+					_mm256_storeu_ps(dst + i, _mm256_castsi256_ps(_mm256_slli_epi32(bits, 16)));
+				}
+			}
+			for (; i < n; i++) dst[i] = BFloatToFloat(src[i]);
+		}
+	}
+}
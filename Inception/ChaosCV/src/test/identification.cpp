@@ -1,5 +1,7 @@
 #include "test/test_engine.hpp"
 #include "utils/utils.hpp"
+#include "dnn/transform.hpp"
+#include "dnn/ops.hpp"
 
 #include <rocksdb/db.h>
 
@@ -28,6 +30,43 @@ namespace chaos
 			return y;
 		}
 
+		void TestEngine::SetFeatureDepth(const Depth& depth)
+		{
+			CHECK(depth == F32 || depth == F16 || depth == BF16) << "Features are kept in F32, F16 or BF16";
+			feature_depth = depth;
+		}
+
+		std::string TestEngine::Encode(const dnn::Tensor& feat) const
+		{
+			dnn::Tensor stored = feat.ConvertTo(feature_depth).Flatten();
+			return std::string((char*)stored.data, stored.Size() * (feature_depth >> DEPTH_SHIFT));
+		}
+
+		Mat TestEngine::Decode(const std::string& buffer) const
+		{
+			size_t elem_size = feature_depth >> DEPTH_SHIFT;
+			CHECK_EQ(0, buffer.size() % elem_size);
+			int len = (int)(buffer.size() / elem_size);
+
+			switch (feature_depth)
+			{
+			case F16:
+			{
+				Mat feat(1, len, CV_32F);
+				dnn::HalfToFloat((const uint16_t*)buffer.data(), feat.ptr<float>(), len);
+				return feat;
+			}
+			case BF16:
+			{
+				Mat feat(1, len, CV_32F);
+				dnn::BFloatToFloat((const uint16_t*)buffer.data(), feat.ptr<float>(), len);
+				return feat;
+			}
+			default:
+				return Mat(1, len, CV_32F, (void*)buffer.data());
+			}
+		}
+
 		ITest::~ITest() {}
 
 		void ITest::SetGallery(const Ptr<DataLoader>& loader) { gallery = loader; }
@@ -110,6 +149,10 @@ namespace chaos
 				CHECK(status.ok()) << status.ToString();
 				during = std::stoull(buff);
 
+				// Databases before the feature depth was kept are all F32
+				status = database->Get(rocksdb::ReadOptions(), "Feature Depth", &buff);
+				feature_depth = status.ok() ? (Depth)std::stoi(buff) : F32;
+
 				// Load Mat Data
 				{
 					int noc = 0;
@@ -139,6 +182,9 @@ namespace chaos
 						c = ConfusionTable(nbins);
 					}
 
+					status = database->Put(rocksdb::WriteOptions(), "Feature Depth", std::to_string(feature_depth));
+					CHECK(status.ok()) << status.ToString();
+
 					RunForward(gallery, GALLERY, false);
 					RunForward(genuine, GENUINE, true);
 
@@ -372,10 +418,7 @@ namespace chaos
 
 					if (feat.data)
 					{
-						CHECK(feat.IsContinue());
-						CHECK_EQ(F32, feat.depth);
-
-						status = database->Put(rocksdb::WriteOptions(), handles[idx], data.key, std::string((char*)feat.data, feat.Size() * sizeof(float)));
+						status = database->Put(rocksdb::WriteOptions(), handles[idx], data.key, Encode(feat));
 						CHECK(status.ok()) << status.ToString();
 						valid_size[idx]++;
 					}
@@ -396,19 +439,33 @@ namespace chaos
 				status = database->NewIterators(rocksdb::ReadOptions(), handles, &iters);
 				CHECK(status.ok()) << status.ToString();
 
-				auto Match = [=](const Mat& f1) {
+				// The gallery is read once into rows, normalized once for COS distance
+				std::vector<int> ids;
+				Mat gallery_feats;
+				for (iters[GALLERY]->SeekToFirst(); iters[GALLERY]->Valid(); iters[GALLERY]->Next())
+				{
+					auto key = iters[GALLERY]->key().ToString();
+					ids.push_back(gallery->Get(key).label.CastTo<CLabel>()[0]);
+					gallery_feats.push_back(Decode(iters[GALLERY]->value().ToString()));
+				}
+				CHECK(!ids.empty()) << "Empty gallery";
+				dnn::Tensor gallery_tensor = dnn::Tensor({ gallery_feats.rows, gallery_feats.cols }, F32, gallery_feats.data);
+				if (!measure) dnn::L2Normalize(gallery_tensor, gallery_tensor);
+
+				auto Match = [&](const Mat& f1) {
 					std::vector<double> scores(noc);
-					for (iters[GALLERY]->SeekToFirst(); iters[GALLERY]->Valid(); iters[GALLERY]->Next())
+					if (measure)
 					{
-						auto key = iters[GALLERY]->key().ToString();
-						int id = gallery->Get(key).label.CastTo<CLabel>()[0];
-						auto buff = iters[GALLERY]->value().ToString();
-						int len = (int)buff.size() / sizeof(float);
-						cv::Mat f2(1, len, CV_32F, buff.data());
-						scores[id] = measure(f1, f2);
+						for (int i = 0; i < (int)ids.size(); i++) scores[ids[i]] = measure(f1, gallery_feats.row(i));
+						return scores;
 					}
+
+					dnn::Tensor query, dots;
+					dnn::L2Normalize(dnn::Tensor({ 1, f1.cols }, F32, f1.data), query);
+					dnn::Dot(gallery_tensor, query, dots);
+					for (int i = 0; i < (int)ids.size(); i++) scores[ids[i]] = (((float*)dots.data)[i] + 1.) / 2.;
 					return scores;
-				}; // Slow ?   ---->  Yes, slow!!
+				};
 
 				ProgressBar::Render("Identifying", valid_size[GENUINE]);
 				for (iters[GENUINE]->SeekToFirst(); iters[GENUINE]->Valid(); iters[GENUINE]->Next())
@@ -416,8 +473,7 @@ namespace chaos
 					auto key = iters[GENUINE]->key().ToString();
 
 					auto buffer = iters[GENUINE]->value().ToString();
-					int len = (int)buffer.size() / sizeof(float);
-					cv::Mat feat(1, len, CV_32F, buffer.data());
+					cv::Mat feat = Decode(buffer);
 
 					std::vector<double> scores = Match(feat);
 
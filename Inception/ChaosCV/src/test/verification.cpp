@@ -1,4 +1,5 @@
 #include "test/test_engine.hpp"
+#include "dnn/ops.hpp"
 
 #include <rocksdb/db.h>
 
@@ -61,6 +62,9 @@ namespace chaos
 
 			void Run() final
 			{
+				status = database->Put(rocksdb::WriteOptions(), "Feature Depth", std::to_string(feature_depth));
+				CHECK(status.ok()) << status.ToString();
+
 				RunForward();
 				Verify();
 			}
@@ -126,14 +130,9 @@ namespace chaos
 
 					if (feat0.data && feat1.data)
 					{
-						CHECK(feat0.IsContinue());
-						CHECK(feat1.IsContinue());
-						CHECK_EQ(F32, feat0.depth);
-						CHECK_EQ(F32, feat1.depth);
-
-						status = database->Put(rocksdb::WriteOptions(), handles[0], data.key, std::string((char*)feat0.data, feat0.Size() * sizeof(float)));
+						status = database->Put(rocksdb::WriteOptions(), handles[0], data.key, Encode(feat0));
 						CHECK(status.ok()) << status.ToString();
-						status = database->Put(rocksdb::WriteOptions(), handles[1], data.key, std::string((char*)feat1.data, feat1.Size() * sizeof(float)));
+						status = database->Put(rocksdb::WriteOptions(), handles[1], data.key, Encode(feat1));
 						CHECK(status.ok()) << status.ToString();
 					}
 					else
@@ -159,14 +158,22 @@ namespace chaos
 					std::string key = iters[0]->key().ToString();
 
 					auto buffer0 = iters[0]->value().ToString();
-					int len0 = (int)buffer0.size() / sizeof(float);
-					cv::Mat feat0(1, len0, CV_32F, buffer0.data());
+					cv::Mat feat0 = Decode(buffer0);
 
 					auto buffer1 = iters[1]->value().ToString();
-					int len1 = (int)buffer1.size() / sizeof(float);
-					cv::Mat feat1(1, len1, CV_32F, buffer1.data());
+					cv::Mat feat1 = Decode(buffer1);
 
-					auto score = measure(feat0, feat1);
+					double score;
+					if (measure)
+					{
+						score = measure(feat0, feat1);
+					}
+					else
+					{
+						dnn::Tensor cosine;
+						dnn::Cosine(dnn::Tensor({ 1, feat0.cols }, F32, feat0.data), dnn::Tensor({ 1, feat1.cols }, F32, feat1.data), cosine);
+						score = (((float*)cosine.data)[0] + 1.) / 2.;
+					}
 
 					int label = pair_list->Get(key).label.CastTo<CLabel>()[0];
 
@@ -2,10 +2,22 @@
 
 #pragma warning (push, 0)
 #include <faiss/IndexFlat.h>
+#include <faiss/IndexScalarQuantizer.h>
+#include <faiss/utils.h>
 #pragma warning (pop)
 
 namespace chaos
 {
+	// Continue F32 rows of data, F16 and BF16 vectors are converted
+	static dnn::Tensor ToFloat(const dnn::Tensor& data, int dims)
+	{
+		CHECK_EQ(2, data.dims);
+		CHECK(data.depth == F32 || data.depth == F16 || data.depth == BF16) << "Only F32, F16 and BF16 vectors are supported";
+		CHECK_EQ(dims, data.shape[1]);
+
+		return data.ConvertTo(F32).Flatten();
+	}
+
 	class Flat : public FastSearcher
 	{
 	public:
@@ -16,25 +28,19 @@ namespace chaos
 
 		void Add(const dnn::Tensor& data) final
 		{
-			CHECK(data.IsContinue());
-			CHECK_EQ(2, data.dims);
-			CHECK_EQ(F32, data.depth);
-			CHECK_EQ(dims, data.shape[1]);
+			const dnn::Tensor vectors = ToFloat(data, dims);
 			
-			index.add(data.shape[0], (float*)data.data);
+			index.add(vectors.shape[0], (float*)vectors.data);
 		}
 
 		void Search(const dnn::Tensor& data, int k, dnn::Tensor& distances, dnn::Tensor& labels)
 		{
-			CHECK(data.IsContinue());
-			CHECK_EQ(2, data.dims);
-			CHECK_EQ(F32, data.depth);
-			CHECK_EQ(dims, data.shape[1]);
+			const dnn::Tensor vectors = ToFloat(data, dims);
 
 			distances = dnn::Tensor({ data.shape[0], k }, F32);
 			labels = dnn::Tensor({ data.shape[0], k }, S64);
 
-			index.search(data.shape[0], (float*)data.data, k, (float*)distances.data, (int64*)labels.data);
+			index.search(vectors.shape[0], (float*)vectors.data, k, (float*)distances.data, (int64*)labels.data);
 		}
 
 	private:
@@ -42,8 +48,107 @@ namespace chaos
 		faiss::IndexFlat index;
 	};
 
+	// Same as Flat, but the gallery is in a tensor from the allocator
+	class AllocatedFlat : public FastSearcher
+	{
+	public:
+		AllocatedFlat(int dims, const Method& method, Allocator* allocator) : dims(dims), method(method), allocator(allocator), ntotal(0)
+		{
+			CHECK(method == IP || method == L2) << "Only IP and L2 are supported by allocated flat searcher";
+		}
+
+		void Add(const dnn::Tensor& data) final
+		{
+			const dnn::Tensor vectors = ToFloat(data, dims);
+
+			int64 num = data.shape[0];
+			int64 capacity = gallery.dims == 0 ? 0 : gallery.shape[0];
+			if (ntotal + num > capacity)
+			{
+				// Double the capacity to keep Add amortized O(n)
+				capacity = std::max(ntotal + num, capacity * 2);
+				dnn::Tensor expanded({ (int)capacity, dims }, F32, false, allocator);
+				if (ntotal > 0) memcpy(expanded.data, gallery.data, ntotal * dims * sizeof(float));
+				gallery = expanded;
+			}
+
+			memcpy((float*)gallery.data + ntotal * dims, vectors.data, num * dims * sizeof(float));
+			ntotal += num;
+		}
+
+		void Search(const dnn::Tensor& data, int k, dnn::Tensor& distances, dnn::Tensor& labels)
+		{
+			const dnn::Tensor vectors = ToFloat(data, dims);
+
+			distances = dnn::Tensor({ data.shape[0], k }, F32);
+			labels = dnn::Tensor({ data.shape[0], k }, S64);
+
+			size_t n = data.shape[0];
+			if (method == IP)
+			{
+				faiss::float_minheap_array_t res = { n, (size_t)k, (faiss::float_minheap_array_t::TI*)labels.data, (float*)distances.data };
+				faiss::knn_inner_product((float*)vectors.data, (float*)gallery.data, dims, n, ntotal, &res);
+			}
+			else
+			{
+				faiss::float_maxheap_array_t res = { n, (size_t)k, (faiss::float_maxheap_array_t::TI*)labels.data, (float*)distances.data };
+				faiss::knn_L2sqr((float*)vectors.data, (float*)gallery.data, dims, n, ntotal, &res);
+			}
+		}
+
+	private:
+		int dims;
+		Method method;
+		Allocator* allocator;
+
+		int64 ntotal;
+		dnn::Tensor gallery; // capacity x dims
+	};
+
+	// Same as Flat, but the gallery is kept in half floats
+	class Half : public FastSearcher
+	{
+	public:
+		Half(int dims, const Method& method) : dims(dims), index(dims, faiss::ScalarQuantizer::QT_fp16, (faiss::MetricType)method)
+		{
+			CHECK(method == IP || method == L2) << "Only IP and L2 are supported by half searcher";
+			CHECK(index.is_trained);
+		}
+
+		void Add(const dnn::Tensor& data) final
+		{
+			const dnn::Tensor vectors = ToFloat(data, dims);
+
+			index.add(vectors.shape[0], (float*)vectors.data);
+		}
+
+		void Search(const dnn::Tensor& data, int k, dnn::Tensor& distances, dnn::Tensor& labels)
+		{
+			const dnn::Tensor vectors = ToFloat(data, dims);
+
+			distances = dnn::Tensor({ data.shape[0], k }, F32);
+			labels = dnn::Tensor({ data.shape[0], k }, S64);
+
+			index.search(vectors.shape[0], (float*)vectors.data, k, (float*)distances.data, (int64*)labels.data);
+		}
+
+	private:
+		int dims;
+		faiss::IndexScalarQuantizer index;
+	};
+
 	Ptr<FastSearcher> FastSearcher::CreateFlat(int dims, const Method& method)
 	{
 		return Ptr<FastSearcher>(new Flat(dims, method));
 	}
+
+	Ptr<FastSearcher> FastSearcher::CreateFlat(int dims, Allocator* allocator, const Method& method)
+	{
+		return Ptr<FastSearcher>(new AllocatedFlat(dims, method, allocator));
+	}
+
+	Ptr<FastSearcher> FastSearcher::CreateHalf(int dims, const Method& method)
+	{
+		return Ptr<FastSearcher>(new Half(dims, method));
+	}
 }
\ No newline at end of file
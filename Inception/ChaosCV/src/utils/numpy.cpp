@@ -13,10 +13,12 @@ namespace chaos
 			return "<i8";
 		case F32:
 			return "<f4";
+		case F16:
+			return "<f2";
 		case U8:
 			return "<i4";
 		default:
-			LOG(FATAL) << "Now just support F32 and U8";
+			LOG(FATAL) << "Now just support S64, F32, F16 and U8";
 			return ""; // Never reachable
 		}
 	}
@@ -27,6 +29,8 @@ namespace chaos
 		{
 		case "'<f4'"_hash:
 			return F32;
+		case "'<f2'"_hash:
+			return F16;
 		case "'<i4'"_hash:
 			return U8;
 		default:
@@ -6,30 +6,34 @@ namespace chaos
 
 	std::vector<int> SoftNMS(std::vector<ObjectRect>& objects, double overlap_rate, double min_confidence, IoUType iou_type, WeightType weight_type)
 	{
-		std::multimap<float, int> score_mapper;
+		std::vector<int> picked;
+		SoftNMS(objects, picked, overlap_rate, min_confidence, iou_type, weight_type);
+		return picked;
+	}
+
+	void SoftNMS(std::vector<ObjectRect>& objects, std::vector<int>& picked, double overlap_rate, double min_confidence, IoUType iou_type, WeightType weight_type)
+	{
+		// Indices sorted by the scores before the suppression, the ties by index, which is the order of a multimap of the scores
+		// Reused by the following calls on the thread
+		thread_local std::vector<std::pair<float, int>> score_mapper;
+		score_mapper.clear();
 		for (int i = 0; i < objects.size(); i++)
 		{
-			score_mapper.insert(std::multimap<float, int>::value_type(objects[i].score, (int)i));
+			score_mapper.push_back(std::make_pair(objects[i].score, i));
 		}
+		std::sort(score_mapper.begin(), score_mapper.end());
 
-		std::vector<int> picked;
+		picked.clear();
 		while (!score_mapper.empty())
 		{
-			auto last_item = score_mapper.rbegin();
-			int last_idx = score_mapper.rbegin()->second; // get the index of maximum score value
+			int last_idx = score_mapper.back().second; // get the index of maximum score value
+			score_mapper.pop_back();
 
 			picked.push_back(last_idx);
-			for (auto it = score_mapper.begin(); it != score_mapper.end();)
+			size_t kept = 0;
+			for (size_t i = 0; i < score_mapper.size(); i++)
 			{
-				int idx = it->second;
-				if (idx == last_idx)
-				{
-					auto next_item = it;
-					next_item++;
-					score_mapper.erase(it);
-					it = next_item;
-					continue;
-				}
+				int idx = score_mapper[i].second;
 
 				Rect overlap = objects[idx].rect & objects[last_idx].rect;
 
@@ -64,20 +68,12 @@ namespace chaos
 				}
 				objects[idx].score *= weight;
 
-				if (objects[idx].score < min_confidence)
-				{
-					auto next_item = it;
-					next_item++;
-					score_mapper.erase(it);
-					it = next_item;
-				}
-				else
-				{
-					it++;
-				}
+				// Dropped if under min_confidence, the rest are kept in order
+				if (objects[idx].score < min_confidence) continue;
+				score_mapper[kept++] = score_mapper[i];
 			}
+			score_mapper.resize(kept);
 		}
-		return picked;
 	}
 
 	void MakeRectSquare(Rect& rect)
@@ -108,14 +104,20 @@ namespace chaos
 
 	Mat Crop(const cv::Mat& src, const Rect& roi, const Size& size, int flags, int border_type, const Scalar& border_value)
 	{
-		Mat m = (cv::Mat_<float>(2, 3) <<
-			size.width / roi.width, 0, -roi.x * size.width / roi.width,
-			0, size.height / roi.height, -roi.y * size.height / roi.height);
 		Mat cropped;
-		warpAffine(src, cropped, m, size, flags, border_type, border_value);
+		Crop(src, cropped, roi, size, flags, border_type, border_value);
 		return cropped;
 	}
 
+	void Crop(const Mat& src, Mat& dst, const Rect& roi, const Size& size, int flags, int border_type, const Scalar& border_value)
+	{
+		float trans[6] = {
+			size.width / roi.width, 0, -roi.x * size.width / roi.width,
+			0, size.height / roi.height, -roi.y * size.height / roi.height };
+		Mat m(2, 3, CV_32F, trans);
+		warpAffine(src, dst, m, size, flags, border_type, border_value);
+	}
+
 	Mat FindNonReflectiveTransform(std::vector<Point> source_points, std::vector<Point> target_points, Mat& T_inv)
 	{
 		CHECK_EQ(source_points.size(), target_points.size());
@@ -1,4 +1,5 @@
 #include "face/clusterer.hpp"
+#include "dnn/ops.hpp"
 #include "utils/fast_search.hpp"
 #include "utils/undigraph.hpp"
 #include "utils/numpy.hpp"
@@ -27,7 +28,11 @@ namespace chaos
 
 			void Add(const dnn::Tensor& feat) final
 			{
-				feats.push_back(feat);
+				// A batch of features is split into views of the samples, nothing is copied
+				for (int n = 0; n < feat.shape[0]; n++)
+				{
+					feats.push_back(feat.Slice(0, n, n + 1));
+				}
 				searcher->Add(feat);
 			}
 
@@ -38,27 +43,33 @@ namespace chaos
 				graph = Undigraph((int)feats.size());
 
 				dnn::Tensor knn = dnn::Tensor({ (int)feats.size(), k_hops[0] + 1 }, S64);
-				for (size_t i = 0; i < feats.size(); i++)
+				dnn::TensorView<int64, 2> knn_view(knn);
+				for (int i = 0; i < (int)feats.size(); i++)
 				{
 					dnn::Tensor distance, labels;
 					searcher->Search(feats[i], k_hops[0] + 1, distance, labels);
 
-					memcpy((int64*)knn.data + i * (k_hops[0] + 1LL), labels.data, (k_hops[0] + 1LL) * sizeof(int64));
+					memcpy(knn_view.Row(i), labels.data, (k_hops[0] + 1LL) * sizeof(int64));
 				}
 
+				// Inputs and output of the gcn, reused for all center nodes
+				dnn::Tensor data = dnn::Tensor({ max_num_nodes, 512 }, F32);
+				dnn::Tensor prob;
+				const int data0 = gcn->GetInputHandle("data0");
+				const int data1 = gcn->GetInputHandle("data1");
+				const int output = gcn->GetOutputHandle("gcn0_dense1_sigmoid_fwd_output");
+
 				float th = FLT_MAX;
 				for (int64 center_node = 0; center_node < feats.size(); center_node++)
 				{
-					Mat center_feat = feats[center_node];
-
 					std::set<int64> unique_nodes = { center_node };
 					std::set<int64> one_hop_nodes;
-					int64* h0 = (int64*)knn.data + center_node * (k_hops[0] + 1LL);
+					const int64* h0 = knn_view.Row((int)center_node);
 					for (int i = 1; i < k_hops[0] + 1; i++)
 					{
 						unique_nodes.insert(h0[i]);
 						one_hop_nodes.insert(h0[i]);
-						int64* h1 = (int64*)knn.data + h0[i] * (k_hops[0] + 1LL);
+						const int64* h1 = knn_view.Row((int)h0[i]);
 						for (int j = 1; j < k_hops[1] + 1; j++)
 						{
 							unique_nodes.insert(h1[j]);
@@ -78,18 +89,20 @@ namespace chaos
 					//	std::cout << unique_nodes_map[node] << ", ";
 					//}
 
-					Mat data;
+					// Features relative to the center, written to the rows of data, the rest rows are zeros
+					int row = 0;
 					for (auto i : unique_nodes)
 					{
-						Mat feat = feats[i];
-						data.push_back(feat - center_feat);
+						dnn::Tensor dst = data.Slice(0, row, row + 1);
+						dnn::Sub(feats[i], feats[center_node], dst);
+						row++;
 					}
-					cv::copyMakeBorder(data, data, 0, max_num_nodes - data.rows, 0, 0, cv::BORDER_CONSTANT);
+					memset((float*)data.data + (size_t)row * 512, 0, (size_t)(max_num_nodes - row) * 512 * sizeof(float));
 
 					Mat A = Mat::zeros(unique_nodes.size(), unique_nodes.size(), CV_32F);
 					for (auto i : unique_nodes)
 					{
-						int64* active = (int64*)knn.data + i * (k_hops[0] + 1LL);
+						const int64* active = knn_view.Row((int)i);
 						for (int j = 1; j < active_connection + 1; j++)
 						{
 							if (unique_nodes_map.find(active[j]) != unique_nodes_map.end())
@@ -105,13 +118,11 @@ namespace chaos
 					A = A / D;
 					cv::copyMakeBorder(A, A, 0, max_num_nodes - A.rows, 0, max_num_nodes - A.cols, cv::BORDER_CONSTANT);
 
-					gcn->SetLayerData("data0", dnn::Tensor({ 1, max_num_nodes, 512 }, F32, data.data));
-					gcn->SetLayerData("data1", dnn::Tensor({ 1, max_num_nodes, max_num_nodes }, F32, A.data));
+					gcn->SetLayerData(data0, data.Reshape({ 1, max_num_nodes, 512 }));
+					gcn->SetLayerData(data1, dnn::Tensor({ 1, max_num_nodes, max_num_nodes }, F32, A.data));
 
 					gcn->Forward();
-
-					dnn::Tensor prob;
-					gcn->GetLayerData("gcn0_dense1_sigmoid_fwd_output", prob);
+					gcn->GetLayerData(output, prob);
 
 					for (auto node : one_hop_nodes)
 					{
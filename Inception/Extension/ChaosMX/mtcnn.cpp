@@ -1,5 +1,9 @@
 #include "face/detector.hpp"
 #include "dnn/group.hpp"
+#include "dnn/transform.hpp"
+#include "dnn/ops.hpp"
+
+#include <atomic>
 
 namespace chaos
 {
@@ -25,12 +29,43 @@ namespace chaos
 					nets[name]->BindExecutor({ inputs[name] });
 				}
 
-				nets.SetForward("PNet", [&]() { PNetForward(); })
-					.SetForward("RNet", [&]() { PNetForward(); })
-					.SetForward("ONet", [&]() { ONetForward(); });
+				nets.SetForward("PNet", [&]() { PNetForward(current); })
+					.SetForward("RNet", [&]() { RNetForward(current, scratches[0]); })
+					.SetForward("ONet", [&]() { ONetForward(current, scratches[1]); });
+
+				// Stages of DetectAsync, each net runs on its own worker with its own scratch memory
+				nets.SetStage("PNet", [&](std::any& frame) {
+					Frame& f = *std::any_cast<Ptr<Frame>&>(frame);
+					if (!f.refine) PNetForward(f);
+				}).SetStage("RNet", [&](std::any& frame) {
+					Frame& f = *std::any_cast<Ptr<Frame>&>(frame);
+					if (!f.refine) RNetForward(f, scratches[0]);
+				}).SetStage("ONet", [&](std::any& frame) {
+					ONetForward(*std::any_cast<Ptr<Frame>&>(frame), scratches[1]);
+				});
+
+				// PNet reshapes to the pyramid of each image size, and RNet / ONet to the number of candidates
+				nets.SetExecutorCache("PNet", 16)
+					.SetExecutorCache("RNet", 4, /*bucketing=*/true)
+					.SetExecutorCache("ONet", 4, /*bucketing=*/true);
+
+				pnets.push_back(std::make_shared<PNetExecutor>(nets["PNet"]));
+				rnet = nets["RNet"].get();
+				onet = nets["ONet"].get();
+				rnet_data = rnet->GetInputHandle("data");
+				rnet_prob = rnet->GetOutputHandle("conv5_1_output");
+				rnet_bounding = rnet->GetOutputHandle("conv5_2_output");
+				onet_data = onet->GetInputHandle("data");
+				onet_prob = onet->GetOutputHandle("conv6_1_output");
+				onet_bounding = onet->GetOutputHandle("conv6_2_output");
+				onet_points = onet->GetOutputHandle("conv6_3_output");
 			}
 
-			~MultiTaskCNN() {}
+			~MultiTaskCNN()
+			{
+				// The stages use the members
+				nets.StopPipeline();
+			}
 
 			std::vector<FaceInfo> Detect(const Mat& image) final
 			{
@@ -39,34 +74,51 @@ namespace chaos
 				{
 					return std::vector<FaceInfo>();
 				}
+				// The nets are run by the workers of the pipeline once it is started
+				if (nets.IsPipelined()) return DetectAsync(image).get();
 
-				// Pre-process
-				data = image.t();
-				data.convertTo(data, CV_32F, 1 / 128., -1.);
+				Begin(image, current);
+				nets.Forward("PNet").Forward("RNet").Forward("ONet");
 
-				std::vector<float>().swap(scales);
-				float scale = 12.f / min_face;
-				while (floor(image.cols * (double)scale * scale_decay >= 12 && floor(image.rows * (double)scale * scale_decay) >= 12))
-				{
-					scales.push_back(scale);
-					scale *= (float)scale_decay;
-				}
+				return Faces(current);
+			}
 
-				// Forward
-				nets.Forward("PNet").Forward("RNet").Forward("ONet");
+			std::future<std::vector<FaceInfo>> DetectAsync(const Mat& image) final
+			{
+				// Concurrent first calls start the pipeline once, StartPipeline serializes them
+				if (!nets.IsPipelined()) nets.StartPipeline({ "PNet", "RNet", "ONet" }, queue_depth);
+
+				// Images too small go through the stages as well, so that the futures are ready in order
+				Ptr<Frame> frame = std::make_shared<Frame>();
+				Begin(image, *frame);
+
+				auto promise = std::make_shared<std::promise<std::vector<FaceInfo>>>();
+				nets.Push(frame, [this, promise](std::any& result) {
+					promise->set_value(Faces(*std::any_cast<Ptr<Frame>&>(result)));
+				});
+				return promise->get_future();
+			}
 
-				// Post-process
-				std::vector<FaceInfo> faces_info(objects.size());
-				for (size_t i = 0; i < objects.size(); i++)
+			std::string Report() const final
+			{
+				// An arena only allocates chunks until it fits the frames, so the counts stop growing after the first frames
+				// Read between the frames, the arenas are not locked
+				std::stringstream report;
+				report << nets.Report();
+				size_t chunks = 0, peak_bytes = 0;
+				for (const auto& pnet : pnets)
 				{
-					faces_info[i] = objects[i];
-					if (do_landmark)
-					{
-						faces_info[i].points = landmarks[i];
-					}
+					chunks += pnet->scratch.arena.GetNumChunkAllocations();
+					peak_bytes = std::max(peak_bytes, pnet->scratch.arena.GetStats().peak_bytes);
 				}
-
-				return faces_info;
+				report << "PNet arena: " << chunks << " chunk allocations, " << peak_bytes << " peak bytes" << std::endl;
+				const char* names[2] = { "RNet", "ONet" };
+				for (int i = 0; i < 2; i++)
+				{
+					report << names[i] << " arena: " << scratches[i].arena.GetNumChunkAllocations() << " chunk allocations, "
+						<< scratches[i].arena.GetStats().peak_bytes << " peak bytes" << std::endl;
+				}
+				return report.str();
 			}
 
 			void Detect(const Mat& image, FaceInfo& info) final
@@ -77,26 +129,96 @@ namespace chaos
 					return;
 				}
 
-				data = image.t();
-				data.convertTo(data, CV_32F, 1 / 128., -1.);
-
-				std::vector<ObjectRect>().swap(objects);
+				// Refined by the ONet stage in the order of the frames if pipelined
+				// Read once, so that the frame and the way it is refined agree if another thread starts the pipeline
+				const bool pipelined = nets.IsPipelined();
+				Ptr<Frame> refined = std::make_shared<Frame>();
+				Frame& frame = pipelined ? *refined : current;
+				frame.image = image;
+				frame.scales.clear();
+				frame.objects.clear();
+				frame.refine = true;
 				// Transpose the rect
-				objects.push_back({ Rect(info.rect.y, info.rect.x, info.rect.height, info.rect.width), info.score });
+				frame.objects.push_back({ Rect(info.rect.y, info.rect.x, info.rect.height, info.rect.width), info.score });
 
-				nets.Forward("ONet");
+				if (pipelined)
+				{
+					nets.Push(refined).get();
+				}
+				else
+				{
+					nets.Forward("ONet");
+				}
 
-				if (!objects.empty())
+				if (!frame.objects.empty())
 				{
-					info = objects[0];
+					info = frame.objects[0];
 					if (do_landmark)
 					{
-						info.points = landmarks[0];
+						info.points = frame.landmarks[0];
 					}
 				}
 			}
 
 		private:
+			// State of a frame, which goes through the nets
+			struct Frame
+			{
+				Mat image; // the image being detected
+				std::vector<float> scales;
+				std::vector<ObjectRect> objects;
+				std::vector<Landmark> landmarks; // of the objects first, the rest are kept to reuse their capacity
+				bool refine = false; // only ONet runs, to refine the face of Detect(image, info)
+			};
+
+			// Scratch memory of a net, reset each time the net runs
+			// All tensors and network inputs of a frame are allocated from the arena
+			struct Scratch
+			{
+				ArenaAllocator arena;
+
+				// Kept to reuse their capacity between frames
+				std::vector<Mat> batch; // Mat headers on arena memory
+				std::vector<ObjectRect> results;
+				std::vector<ObjectRect> scale_results;
+				std::vector<Landmark> all_points; // of the results first
+				std::vector<int> picked;
+				std::vector<dnn::DataLayer> inputs = { dnn::DataLayer("data", {}) }; // reshaped to the batch of each run
+			};
+
+			// Frame of the image with its pyramid scales
+			void Begin(const Mat& image, Frame& frame)
+			{
+				// The networks work on the transposed image normalized by x / 128 - 1
+				// Transposing and normalizing are fused into ImagesToTensor, so the image is only resized or cropped here
+				frame.image = image;
+				frame.objects.clear();
+				frame.refine = false;
+
+				frame.scales.clear();
+				if (image.rows < 12 || image.cols < 12) return;
+				float scale = 12.f / min_face;
+				while (floor(image.cols * (double)scale * scale_decay >= 12 && floor(image.rows * (double)scale * scale_decay) >= 12))
+				{
+					frame.scales.push_back(scale);
+					scale *= (float)scale_decay;
+				}
+			}
+
+			std::vector<FaceInfo> Faces(const Frame& frame) const
+			{
+				std::vector<FaceInfo> faces_info(frame.objects.size());
+				for (size_t i = 0; i < frame.objects.size(); i++)
+				{
+					faces_info[i] = frame.objects[i];
+					if (do_landmark)
+					{
+						faces_info[i].points = frame.landmarks[i];
+					}
+				}
+				return faces_info;
+			}
+
 			void Parse(const std::any& any) final
 			{
 				if (any.type() == typeid(const char*) && args_list.find(std::any_cast<const char*>(any)) != args_list.end())
@@ -121,6 +243,12 @@ namespace chaos
 						case "Confidence"_hash:
 							confidence = std::any_cast<std::vector<double>>(arg_value);
 							break;
+						case "QueueDepth"_hash:
+							queue_depth = std::any_cast<int>(arg_value);
+							break;
+						case "PNetThreads"_hash:
+							pnet_threads = std::any_cast<int>(arg_value);
+							break;
 						default:
 							LOG(WARNING) << "Unknown arg " << arg;
 							break;
@@ -137,94 +265,172 @@ namespace chaos
 				}
 			}
 
-			void PNetForward()
+			// PNet with its own executors and scratch memory, for the levels of the pyramid evaluated concurrently
+			struct PNetExecutor
 			{
-				std::vector<ObjectRect> results;
-				for (auto s : scales)
+				PNetExecutor(const Ptr<dnn::Net>& net) : net(net)
 				{
-					cv::Mat input;
-					cv::resize(data, input, cv::Size(), s, s);
+					data = net->GetInputHandle("data");
+					prob = net->GetOutputHandle("conv4_1_output");
+					bounding = net->GetOutputHandle("conv4_2_output");
+				}
 
-					dnn::Tensor prob, bounding;
-					nets["PNet"]->Reshape({ {"data", {1,3, input.rows, input.cols}} });
-					nets["PNet"]->SetLayerData("data", dnn::Tensor::Unroll({ input }));
-					nets["PNet"]->Forward();
-					nets["PNet"]->GetLayerData("conv4_1_output", prob); // 1x2xhxw
-					nets["PNet"]->GetLayerData("conv4_2_output", bounding); // 1x4xhxw
+				Ptr<dnn::Net> net;
+				int data, prob, bounding;
+				Scratch scratch;
+			};
 
-					std::vector<ObjectRect> scale_results;
-					int rows = prob.shape[2], cols = prob.shape[3];
+			void PNetForward(Frame& frame)
+			{
+				// One executor per thread, but no more than the levels
+				int threads = pnet_threads > 0 ? pnet_threads : cv::getNumThreads();
+				threads = std::max(1, std::min(threads, (int)frame.scales.size()));
+				// Clones share the weights, and keep the executors of the shapes they have seen
+				while ((int)pnets.size() < threads)
+				{
+					pnets.push_back(std::make_shared<PNetExecutor>(pnets[0]->net->Clone()));
+				}
+
+				// All scratch tensors of the last frame are released
+				for (int t = 0; t < threads; t++) pnets[t]->scratch.arena.Reset();
+				levels.resize(frame.scales.size());
+
+				if (threads == 1)
+				{
+					for (size_t l = 0; l < frame.scales.size(); l++) PNetLevel(frame, l, *pnets[0], levels[l]);
+				}
+				else
+				{
+					// The levels are taken from the largest one by the first idle executor
+					std::atomic<size_t> next(0);
+					cv::parallel_for_(cv::Range(0, threads), [&](const cv::Range& range) {
+						for (int t = range.start; t < range.end; t++)
+						{
+							for (size_t l = next++; l < frame.scales.size(); l = next++) PNetLevel(frame, l, *pnets[t], levels[l]);
+						}
+					}, threads);
+				}
+
+				// Merged in the order of the levels as the serial path, so the results are the same
+				std::vector<ObjectRect>& results = candidates;
+				results.clear();
+				for (size_t l = 0; l < frame.scales.size(); l++)
+				{
+					results.insert(results.end(), levels[l].begin(), levels[l].end());
+				}
+
+				frame.objects.clear();
+				SoftNMS(results, picked, nms_threshold, confidence[0]);
+				for (auto p : picked)
+				{
+					frame.objects.push_back(results[p]);
+				}
+			}
 
-					for (int r = 0; r < rows; r++)
+			// Candidates of the level of the pyramid after the SoftNMS of the level
+			void PNetLevel(const Frame& frame, size_t level, PNetExecutor& pnet, std::vector<ObjectRect>& results)
+			{
+				// On the worker of the level, whose tag is its own
+				AllocationTag tag("PNet");
+				Scratch& scratch = pnet.scratch;
+				ArenaAllocator& arena = scratch.arena;
+				std::vector<ObjectRect>& scale_results = scratch.scale_results;
+				const float s = frame.scales[level];
+
+				// Same size as cv::resize computes from the scale, so the arena buffer is used directly
+				// rows and cols are of the transposed image
+				int rows = cvRound(frame.image.cols * (double)s), cols = cvRound(frame.image.rows * (double)s);
+				scratch.batch.assign(1, Mat(cols, rows, CV_8UC3, arena.FastMalloc((size_t)rows * cols * 3)));
+				cv::resize(frame.image, scratch.batch[0], cv::Size(), s, s);
+
+				dnn::Tensor prob, bounding;
+				prob.allocator = bounding.allocator = &arena;
+				scratch.inputs[0].shape = { 1, 3, rows, cols };
+				pnet.net->Reshape(scratch.inputs);
+				pnet.net->SetLayerData(pnet.data, ToTensor(scratch));
+				pnet.net->Forward();
+				pnet.net->GetLayerData(pnet.prob, prob); // 1x2xhxw
+				pnet.net->GetLayerData(pnet.bounding, bounding); // 1x4xhxw
+				ReleaseBatch(scratch);
+
+				scale_results.clear();
+				rows = prob.shape[2], cols = prob.shape[3];
+
+				// Softmax over the channels in place
+				dnn::Softmax(prob, prob, 1);
+
+				// Outputs are continue, so the rows are indexed directly
+				dnn::TensorView<float, 4> prob_view(prob), bounding_view(bounding);
+				for (int r = 0; r < rows; r++)
+				{
+					const float* fg_row = prob_view.Row(0, 1, r);
+					const float* bounding_rows[4] = { bounding_view.Row(0, 0, r), bounding_view.Row(0, 1, r), bounding_view.Row(0, 2, r), bounding_view.Row(0, 3, r) };
+					for (int c = 0; c < cols; c++)
 					{
-						for (int c = 0; c < cols; c++)
+						float score = fg_row[c];
+						if (score > confidence[0])
 						{
-							//// Softmax
-							float fg = prob.At<float>({ 0, 1, r, c });
-							float bg = prob.At<float>({ 0, 0, r, c });
-							float score = exp(fg) / (exp(fg) + exp(bg));
-							if (score > confidence[0])
+							float x = c * 2.f;
+							float y = r * 2.f;
+							float w = 12.f;
+							float h = 12.f;
+
+							x += 12.f * bounding_rows[1][c];
+							y += 12.f * bounding_rows[0][c];
+							w += 12.f * (bounding_rows[3][c] - bounding_rows[1][c]);
+							h += 12.f * (bounding_rows[2][c] - bounding_rows[0][c]);
+							Rect rect(x / s, y / s, w / s, h / s);
+							if (rect.width >= 12 && rect.height >= 12)
 							{
-								float x = c * 2.f;
-								float y = r * 2.f;
-								float w = 12.f;
-								float h = 12.f;
-
-								x += 12.f * bounding.At<float>({ 0, 1, r, c });
-								y += 12.f * bounding.At<float>({ 0, 0, r, c });
-								w += 12.f * (bounding.At<float>({ 0, 3, r, c }) - bounding.At<float>({ 0, 1, r, c }));
-								h += 12.f * (bounding.At<float>({ 0, 2, r, c }) - bounding.At<float>({ 0, 0, r, c }));
-								Rect rect(x / s, y / s, w / s, h / s);
-								if (rect.width >= 12 && rect.height >= 12)
-								{
-									scale_results.push_back({ rect, score });
-								}
+								scale_results.push_back({ rect, score });
 							}
 						}
 					}
-
-					auto picked = SoftNMS(scale_results, nms_threshold, confidence[0]);
-					for (auto p : picked)
-					{
-						results.push_back(scale_results[p]);
-					}
 				}
 
-				std::vector<ObjectRect>().swap(objects);
-				auto picked = SoftNMS(results, nms_threshold, confidence[0]);
-				for (auto p : picked)
+				results.clear();
+				SoftNMS(scale_results, scratch.picked, nms_threshold, confidence[0]);
+				for (auto p : scratch.picked)
 				{
-					objects.push_back(results[p]);
+					results.push_back(scale_results[p]);
 				}
 			}
 
-			void RNetForward()
+			void RNetForward(Frame& frame, Scratch& scratch)
 			{
-				if (objects.empty()) return;
+				if (frame.objects.empty()) return;
 
-				std::vector<ObjectRect> results;
+				scratch.arena.Reset();
+				AllocationTag tag("RNet");
+				std::vector<ObjectRect>& objects = frame.objects;
+				std::vector<ObjectRect>& results = scratch.results;
+				results.clear();
 
-				nets["RNet"]->Reshape({ {"data", {(int)objects.size(), 3, 24, 24}} });
-				std::vector<cv::Mat> input;
+				// Out of the frame is padded with 128, which is 0 after x / 128 - 1 as the normalized image was padded
+				scratch.inputs[0].shape = { (int)objects.size(), 3, 24, 24 };
+				rnet->Reshape(scratch.inputs);
 				for (auto& obj : objects)
 				{
 					MakeRectSquare(obj.rect);
-					input.push_back(Crop(data, obj.rect, cv::Size(24, 24)));
+					scratch.batch.push_back(Mat(24, 24, CV_8UC3, scratch.arena.FastMalloc(24 * 24 * 3)));
+					Crop(frame.image, scratch.batch.back(), Transpose(obj.rect), cv::Size(24, 24), cv::INTER_LINEAR, cv::BORDER_CONSTANT, Scalar::all(128));
 				}
 
 				dnn::Tensor prob, bounding;
-				nets["RNet"]->SetLayerData("data", dnn::Tensor::Unroll({ input }));
-				nets["RNet"]->Forward();
-				nets["RNet"]->GetLayerData("conv5_1_output", prob);
-				nets["RNet"]->GetLayerData("conv5_2_output", bounding);
-
+				prob.allocator = bounding.allocator = &scratch.arena;
+				rnet->SetLayerData(rnet_data, ToTensor(scratch));
+				ReleaseBatch(scratch);
+				rnet->Forward();
+				rnet->GetLayerData(rnet_prob, prob);
+				rnet->GetLayerData(rnet_bounding, bounding);
+				dnn::Softmax(prob, prob);
+
+				dnn::TensorView<float, 2> prob_view(prob), bounding_view(bounding);
 				for (int i = 0; i < prob.shape[0]; i++)
 				{
-					auto bg_prob = ((float*)prob.data)[i * 2];
-					auto fc_prob = ((float*)prob.data)[i * 2 + 1];
-					float score = exp(fc_prob) / (exp(bg_prob) + exp(fc_prob));
+					float score = prob_view(i, 1);
 
-					float* rect_ptr = ((float*)bounding.data) + i * (size_t)4;
+					const float* rect_ptr = bounding_view.Row(i);
 					if (score > confidence[1])
 					{
 						auto y = objects[i].rect.y + objects[i].rect.height * rect_ptr[0];
@@ -238,44 +444,51 @@ namespace chaos
 					}
 				}
 
-				std::vector<ObjectRect>().swap(objects);
-				auto picked = SoftNMS(results, nms_threshold, confidence[1]);
-				for (auto p : picked)
+				objects.clear();
+				SoftNMS(results, scratch.picked, nms_threshold, confidence[1]);
+				for (auto p : scratch.picked)
 				{
 					objects.push_back(results[p]);
 				}
 			}
 
-			void ONetForward()
+			void ONetForward(Frame& frame, Scratch& scratch)
 			{
-				if (objects.empty()) return;
+				if (frame.objects.empty()) return;
 
-				std::vector<ObjectRect> results;
-				std::vector<Landmark> all_points;
+				scratch.arena.Reset();
+				AllocationTag tag("ONet");
+				std::vector<ObjectRect>& objects = frame.objects;
+				std::vector<ObjectRect>& results = scratch.results;
+				std::vector<Landmark>& all_points = scratch.all_points;
+				results.clear();
 
-				nets["ONet"]->Reshape({ {"data", {(int)objects.size(), 3, 48, 48}} });
-				std::vector<Mat> input;
+				scratch.inputs[0].shape = { (int)objects.size(), 3, 48, 48 };
+				onet->Reshape(scratch.inputs);
 				for (auto& obj : objects)
 				{
 					MakeRectSquare(obj.rect);
-					input.push_back(Crop(data, obj.rect, cv::Size(48, 48)));
+					scratch.batch.push_back(Mat(48, 48, CV_8UC3, scratch.arena.FastMalloc(48 * 48 * 3)));
+					Crop(frame.image, scratch.batch.back(), Transpose(obj.rect), cv::Size(48, 48), cv::INTER_LINEAR, cv::BORDER_CONSTANT, Scalar::all(128));
 				}
 
 				dnn::Tensor prob, bounding, points;
-				nets["ONet"]->SetLayerData("data", dnn::Tensor::Unroll({ input }));
-				nets["ONet"]->Forward();
-				nets["ONet"]->GetLayerData("conv6_1_output", prob);
-				nets["ONet"]->GetLayerData("conv6_2_output", bounding);
-				nets["ONet"]->GetLayerData("conv6_3_output", points);
-
+				prob.allocator = bounding.allocator = points.allocator = &scratch.arena;
+				onet->SetLayerData(onet_data, ToTensor(scratch));
+				ReleaseBatch(scratch);
+				onet->Forward();
+				onet->GetLayerData(onet_prob, prob);
+				onet->GetLayerData(onet_bounding, bounding);
+				onet->GetLayerData(onet_points, points);
+				dnn::Softmax(prob, prob);
+
+				dnn::TensorView<float, 2> prob_view(prob), bounding_view(bounding), points_view(points);
 				for (int i = 0; i < prob.shape[0]; i++)
 				{
-					auto bg_prob = ((float*)prob.data)[i * 2];
-					auto fc_prob = ((float*)prob.data)[i * 2 + 1];
-					float score = exp(fc_prob) / (exp(bg_prob) + exp(fc_prob));
+					float score = prob_view(i, 1);
 
-					float* rect_ptr = ((float*)bounding.data) + i * (size_t)4;
-					float* points_ptr = ((float*)points.data) + i * (size_t)10;
+					const float* rect_ptr = bounding_view.Row(i);
+					const float* points_ptr = points_view.Row(i);
 
 					if (score > confidence[2])
 					{
@@ -290,44 +503,77 @@ namespace chaos
 							results.push_back({ this_rect, score });
 							if (do_landmark)
 							{
-								Landmark pts;
+								// Written over the landmarks of the last frames, so that their capacity is reused
+								if (all_points.size() < results.size()) all_points.resize(results.size());
+								Landmark& pts = all_points[results.size() - 1];
+								pts.clear();
 								for (int p = 0; p < 5; p++)
 								{
 									// Transpose
 									pts.push_back(Point(points_ptr[p] * objects[i].rect.height + objects[i].rect.y,
 										points_ptr[p + 5] * objects[i].rect.width + objects[i].rect.x));
 								}
-								all_points.push_back(pts);
 							}
 						}
 					}
 				}
 
-				std::vector<ObjectRect>().swap(objects);
-				std::vector<Landmark>().swap(landmarks);
-				auto picked = SoftNMS(results, nms_threshold, confidence[2], IOU_MIN);
-				for (auto p : picked)
+				objects.clear();
+				SoftNMS(results, scratch.picked, nms_threshold, confidence[2], IOU_MIN);
+				if (do_landmark && frame.landmarks.size() < scratch.picked.size()) frame.landmarks.resize(scratch.picked.size());
+				for (size_t i = 0; i < scratch.picked.size(); i++)
 				{
-					objects.push_back(results[p]);
-					if (do_landmark) landmarks.push_back(all_points[p]);
+					objects.push_back(results[scratch.picked[i]]);
+					if (do_landmark) frame.landmarks[i] = all_points[scratch.picked[i]];
 				}
 			}
 
-			std::set<std::string> args_list = { "ScaleDecay", "MinFace", "NMS", "DoLandmark", "Confidence" };
+			// Transposed and normalized input tensor of the images in batch
+			static dnn::Tensor ToTensor(Scratch& scratch)
+			{
+				return dnn::ImagesToTensor(scratch.batch, Scalar::all(128), Scalar::all(1 / 128.), false, /*transpose=*/true, false, &scratch.arena);
+			}
+
+			// Rect in the transposed image to the rect in frame
+			static Rect Transpose(const Rect& rect)
+			{
+				return Rect(rect.y, rect.x, rect.height, rect.width);
+			}
+
+			// Give back the arena memory of the Mat headers in batch
+			static void ReleaseBatch(Scratch& scratch)
+			{
+				for (auto& m : scratch.batch)
+				{
+					scratch.arena.FastFree(m.data);
+				}
+				scratch.batch.clear();
+			}
+
+			std::set<std::string> args_list = { "ScaleDecay", "MinFace", "NMS", "DoLandmark", "Confidence", "QueueDepth", "PNetThreads" };
 
 			int min_face = 40;
 			double scale_decay = 0.709;
 			std::vector<double> confidence = { 0.5, 0.7, 0.7 };
 			double nms_threshold = 0.5;
 			bool do_landmark = true;
+			int queue_depth = 2;
+			int pnet_threads = 0; // executors of PNet for the levels of the pyramid, 0 for cv::getNumThreads()
 
 			dnn::GroupNet nets;
-
-			Mat data;
-			std::vector<ObjectRect> objects;
-			std::vector<Landmark> landmarks;
-			std::vector<float> scales;
-
+			// Nets and layer handles resolved once, so that no name is looked up per forward
+			std::vector<Ptr<PNetExecutor>> pnets; // the first one is the PNet of nets
+			dnn::Net* rnet;
+			dnn::Net* onet;
+			int rnet_data, rnet_prob, rnet_bounding;
+			int onet_data, onet_prob, onet_bounding, onet_points;
+
+			Frame current; // frame of Detect if not pipelined
+			Scratch scratches[2]; // of RNet and ONet, PNet has its own in pnets
+			// Used by PNet only, kept to reuse their capacity
+			std::vector<std::vector<ObjectRect>> levels; // candidates of each level of the pyramid
+			std::vector<ObjectRect> candidates; // of all levels before the global SoftNMS
+			std::vector<int> picked; // by the global SoftNMS
 		};
 
 		Ptr<Detector> Detector::LoadMTCNN(const std::string& folder, const dnn::Context& ctx)
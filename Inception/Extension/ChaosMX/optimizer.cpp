@@ -1,6 +1,12 @@
 #include "base.hpp"
 #include "symbol.hpp"
+#include "dnn/gemm.hpp"
+#include "dnn/ops.hpp"
+#include "test/test_engine.hpp"
 
+#include <atomic>
+#include <filesystem>
+#include <iomanip>
 #include <stack>
 
 namespace chaos
@@ -23,20 +29,262 @@ namespace chaos
 				//CHECK_EQ(0, MXSymbolFree(symbol)) << MXGetLastError();
 			}
 
+			void Optimize() final
+			{
+				RemoveIdentity();
+				MergeBatchNorm();
+				MergeScale();
+			}
+
 			void MergeBatchNorm() final
 			{
 				for (size_t i = 0; i < symbols.size(); i++)
 				{
-					if ("BatchNorm" == symbols[i].op.op_name)
+					const Symbol& bn = symbols[i];
+					if (bn.op.op_name != "BatchNorm" || GetInt(bn.attrs, "axis", 1) != 1) continue;
+
+					const int producer = bn.inputs[0].node_id;
+					if (!Foldable(producer)) continue;
+
+					const Tensor& gamma = Weight(bn.inputs[1].node_id);
+					const Tensor& beta = Weight(bn.inputs[2].node_id);
+					const Tensor& mean = Weight(bn.inputs[3].node_id);
+					const Tensor& var = Weight(bn.inputs[4].node_id);
+					const float eps = GetFloat(bn.attrs, "eps", 1e-3f);
+					const bool fix_gamma = GetBool(bn.attrs, "fix_gamma", true);
+
+					// y = gamma * (x - mean) / sqrt(var + eps) + beta
+					std::vector<float> scale(mean.Size()), shift(mean.Size());
+					for (size_t c = 0; c < scale.size(); c++)
 					{
+						scale[c] = (fix_gamma ? 1.f : ((float*)gamma.data)[c]) / std::sqrt(((float*)var.data)[c] + eps);
+						shift[c] = ((float*)beta.data)[c] - ((float*)mean.data)[c] * scale[c];
 					}
+					FoldAffine(producer, scale, shift);
+					Bypass((int)i);
+				}
+				Prune();
+			}
+
+			void RemoveIdentity() final
+			{
+				for (size_t i = 0; i < symbols.size(); i++)
+				{
+					const std::string& op = symbols[i].op.op_name;
+					if (op != "Dropout" && op != "identity" && op != "_copy" && op != "BlockGrad") continue;
+
+					// The output name moves to the input, which must be an op of no other consumer
+					const int producer = symbols[i].inputs[0].node_id;
+					if (IsHead((int)i) && (symbols[producer].op.op_name == "null" || Consumers(producer) > 1)) continue;
+					Bypass((int)i);
 				}
+				Prune();
 			}
 
-			void Export(const std::string& name) final
+			void MergeScale() final
 			{
-				SaveSymbol(name + ".json");
-				SaveWeight(name + ".params");
+				for (size_t i = 0; i < symbols.size(); i++)
+				{
+					std::vector<float> scale, shift;
+					if (!GetAffine((int)i, scale, shift)) continue;
+
+					// A broadcast param of more dims than the output would reshape it
+					const int producer = symbols[i].inputs[0].node_id;
+					const int dims = symbols[producer].op.op_name == "Convolution" ? 4 : 2;
+					if (Foldable(producer) && (symbols[i].attrs.count("scalar") || Weight(symbols[i].inputs[1].node_id).dims <= dims))
+					{
+						FoldAffine(producer, scale, shift);
+						Bypass((int)i);
+						continue;
+					}
+
+					// Chained scalar ops of the same kind are one op, e.g. x * a * b is x * (a * b)
+					Symbol& sym = symbols[i];
+					const Symbol& from = symbols[producer];
+					std::vector<float> from_scale, from_shift;
+					if (sym.attrs.count("scalar") && from.attrs.count("scalar") && Consumers(producer) == 1 && !IsHead(producer) &&
+						GetAffine(producer, from_scale, from_shift))
+					{
+						const bool multiply = shift[0] == 0.f && from_shift[0] == 0.f;
+						const bool add = scale[0] == 1.f && from_scale[0] == 1.f;
+						if (!multiply && !add) continue;
+
+						const float scalar = multiply ? scale[0] * from_scale[0] : shift[0] + from_shift[0];
+						sym.op = Operator(multiply ? "_mul_scalar" : "_plus_scalar");
+						sym.attrs["scalar"] = ToString(scalar);
+						sym.inputs[0] = from.inputs[0];
+						symbols[producer].inputs.clear();
+						if (scalar == (multiply ? 1.f : 0.f) && !(IsHead((int)i) && symbols[sym.inputs[0].node_id].op.op_name == "null")) Bypass((int)i);
+					}
+				}
+				Prune();
+			}
+
+			void Quantize(const Ptr<test::DataLoader>& calibration, const std::function<Tensor(const Mat&)>& transform, size_t max_samples) final
+			{
+				// Convolution and FullyConnected which the native net runs in INT8, short rows gain nothing
+				std::vector<int> layers;
+				for (size_t i = 0; i < symbols.size(); i++)
+				{
+					const Symbol& sym = symbols[i];
+					if (sym.op.op_name != "FullyConnected" && !(sym.op.op_name == "Convolution" && GetInt(sym.attrs, "num_group", 1) == 1)) continue;
+					const Tensor& weight = Weight(sym.inputs[1].node_id);
+					if (weight.Size() / weight.shape[0] >= 32) layers.push_back((int)i);
+				}
+				CHECK(!layers.empty()) << "No layer to quantize";
+
+				float_symbols = symbols;
+				float_heads = heads;
+				float_weights.clear();
+				for (const auto& w : weights)
+				{
+					Tensor copy(w.second.shape, F32);
+					memcpy(copy.data, w.second.data, w.second.Size() * sizeof(float));
+					float_weights[w.first] = copy;
+				}
+
+				// Ranges of the inputs of the layers, which are the outputs of the calibration net
+				std::vector<int> inputs;
+				for (int layer : layers)
+				{
+					const int input = symbols[layer].inputs[0].node_id;
+					if (std::find(inputs.begin(), inputs.end(), input) == inputs.end()) inputs.push_back(input);
+				}
+				Ptr<Net> net = LoadNet(symbols, weights, inputs);
+				std::vector<int> handles;
+				for (int input : inputs)
+				{
+					handles.push_back(net->GetOutputHandle(symbols[input].op.op_name == "null" ? symbols[input].name : symbols[input].name + "_output"));
+				}
+
+				std::vector<float> lows(inputs.size(), std::numeric_limits<float>::max());
+				std::vector<float> highs(inputs.size(), std::numeric_limits<float>::lowest());
+				const std::string data = DataName();
+				Shape bound;
+				size_t count = 0;
+				test::TestData sample;
+				calibration->Reset();
+				while ((max_samples == 0 || count < max_samples) && !(sample = calibration->Next()).Empty())
+				{
+					for (const auto& image : sample.sample.GetData())
+					{
+						Run(net, data, transform(image), bound);
+						for (size_t j = 0; j < handles.size(); j++)
+						{
+							Tensor output;
+							net->GetLayerData(handles[j], output);
+							const float* ptr = (const float*)output.data;
+							for (size_t k = 0; k < output.Size(); k++)
+							{
+								lows[j] = std::min(lows[j], ptr[k]);
+								highs[j] = std::max(highs[j], ptr[k]);
+							}
+						}
+					}
+					count++;
+				}
+				CHECK_LT(0, count) << "Calibration set " << calibration->Name() << " is empty";
+
+				int quantized = 0;
+				for (int layer : layers)
+				{
+					const size_t j = std::find(inputs.begin(), inputs.end(), symbols[layer].inputs[0].node_id) - inputs.begin();
+					if (!(highs[j] > lows[j]))
+					{
+						LOG(WARNING) << "Input of " << symbols[layer].name << " is constant over the calibration set, left in F32";
+						continue;
+					}
+
+					// Unsigned 7 bit inputs for non negative ranges such as after ReLU, 7 bit around 64 for the others
+					const bool positive = lows[j] >= 0.f;
+					const float scale = positive ? highs[j] / 127.f : std::max(-lows[j], highs[j]) / 63.f;
+					symbols[layer].attrs["__int8_scale__"] = ToString(scale);
+					symbols[layer].attrs["__int8_zero__"] = positive ? "0" : "64";
+
+					// Snap the weights to the INT8 grid of each output channel, which the native net quantizes exactly
+					Tensor& weight = Weight(symbols[layer].inputs[1].node_id);
+					const int rows = weight.shape[0];
+					const int cols = (int)(weight.Size() / rows);
+					std::vector<int8_t> q(weight.Size());
+					std::vector<float> scales(rows);
+					QuantizeRows((const float*)weight.data, rows, cols, q.data(), scales.data());
+					for (size_t k = 0; k < q.size(); k++) ((float*)weight.data)[k] = q[k] * scales[k / cols];
+					quantized++;
+				}
+				LOG(INFO) << "Quantized " << quantized << " of " << symbols.size() << " nodes to INT8 by " << count << " samples of " << calibration->Name();
+			}
+
+			std::string ReportDrift(const Ptr<test::DataLoader>& pair_list, const std::function<Tensor(const Mat&)>& transform,
+				const std::string& output, const std::string& db) final
+			{
+				CHECK(!float_symbols.empty()) << "Quantize before the drift report";
+
+				Ptr<Net> float_net = LoadNet(float_symbols, float_weights, float_heads);
+				Ptr<Net> int8_net = LoadNet(symbols, weights, heads);
+				const std::string data = DataName();
+				Shape float_bound, int8_bound;
+				auto Feature = [&](Ptr<Net>& net, Shape& bound, const Mat& image) {
+					Run(net, data, transform(image), bound);
+					Tensor feature;
+					net->GetLayerData(output, feature);
+					return feature;
+				};
+
+				// Cosine of the F32 and INT8 features of each image
+				double cosine_sum = 0., cosine_min = 1.;
+				size_t images = 0;
+
+				test::ConfusionTable tables[2];
+				for (int pass = 0; pass < 2; pass++)
+				{
+					Ptr<test::VTest> vtest = test::VTest::Create(db + (pass == 0 ? "/float" : "/int8"));
+					vtest->SetPairList(pair_list);
+					if (pass == 0)
+					{
+						vtest->SetForward([&](const Mat& image) { return Feature(float_net, float_bound, image); });
+					}
+					else
+					{
+						vtest->SetForward([&](const Mat& image) {
+							Tensor feature = Feature(int8_net, int8_bound, image);
+							const Tensor reference = Feature(float_net, float_bound, image);
+							Tensor cosine;
+							Cosine(reference.Reshape({ 1, (int)reference.Size() }), feature.Reshape({ 1, (int)feature.Size() }), cosine);
+							cosine_sum += ((float*)cosine.data)[0];
+							cosine_min = std::min(cosine_min, (double)((float*)cosine.data)[0]);
+							images++;
+							return feature;
+						});
+					}
+					vtest->Run();
+					tables[pass] = vtest->GetConfusion();
+					vtest->Close();
+				}
+
+				double acc[2];
+				for (int pass = 0; pass < 2; pass++)
+				{
+					cv::minMaxIdx(tables[pass].GetACC(), nullptr, &acc[pass]);
+				}
+				const double auc[2] = { tables[0].GetAUC(), tables[1].GetAUC() };
+
+				std::stringstream report;
+				report << "INT8 drift on " << pair_list->Name() << ", " << images << " images" << std::endl
+					<< "Max ACC: " << acc[0] << " -> " << acc[1] << " (" << std::showpos << acc[1] - acc[0] << std::noshowpos << ")" << std::endl
+					<< "AUC: " << auc[0] << " -> " << auc[1] << " (" << std::showpos << auc[1] - auc[0] << std::noshowpos << ")" << std::endl
+					<< "Feature cosine: mean " << (images ? cosine_sum / images : 0.) << ", min " << cosine_min;
+				LOG(INFO) << std::endl << report.str();
+				return report.str();
+			}
+
+			void Export(const std::string& name, const ExportFormat& format) final
+			{
+				SaveSymbol(name + ".json", symbols, heads);
+				SaveWeight(name + ".params", weights);
+				if (format == EXPORT_COMPILED)
+				{
+					CompileNative(Model(name + ".json", name + ".params"), name + ".cnet");
+				}
 			}
 
 		private:
@@ -61,7 +309,7 @@ namespace chaos
 					void* buff = nullptr;
 					CHECK_EQ(0, MXNDArrayGetData(handles[i], &buff)) << MXGetLastError();
 
-					memcpy(data.data, buff, data.Size());
+					memcpy(data.data, buff, data.Size() * sizeof(float));
 
 					//auto name = Split(names[i], ":")[1];
 					weights[names[i]] = data;
@@ -92,12 +340,19 @@ namespace chaos
 				{
 					symbols.push_back(nodes[i]);
 				}
+
+				auto json_heads = symbol_json["heads"];
+				cnt = json_heads.Data.size();
+				for (size_t i = 0; i < cnt; i++)
+				{
+					heads.push_back(std::stoi(json_heads[i].Data["0"]));
+				}
 			}
 
-			void SaveSymbol(const std::string& file)
+			void SaveSymbol(const std::string& file, const std::vector<Symbol>& nodes, const std::vector<int>& outputs)
 			{
 				std::vector<SymbolHandle> handles;
-				for (auto sym : symbols)
+				for (auto sym : nodes)
 				{
 					SymbolHandle handle;
 
@@ -132,7 +387,18 @@ namespace chaos
 					handles.push_back(handle);
 				}
 
-				CHECK_EQ(0, MXSymbolSaveToFile(handles.back(), file.c_str())) << MXGetLastError();
+				std::vector<SymbolHandle> heads_handles;
+				for (int head : outputs)
+				{
+					heads_handles.push_back(handles[head]);
+				}
+				SymbolHandle output = heads_handles[0];
+				if (heads_handles.size() > 1)
+				{
+					CHECK_EQ(0, MXSymbolCreateGroup((mx_uint)heads_handles.size(), heads_handles.data(), &output)) << MXGetLastError();
+					handles.push_back(output);
+				}
+				CHECK_EQ(0, MXSymbolSaveToFile(output, file.c_str())) << MXGetLastError();
 
 				// Release
 				for (auto& h : handles)
@@ -140,11 +406,11 @@ namespace chaos
 					CHECK_EQ(0, MXSymbolFree(h)) << MXGetLastError();
 				}
 			}
-			void SaveWeight(const std::string& file)
+			void SaveWeight(const std::string& file, const std::map<std::string, Tensor>& params)
 			{
 				std::vector<NDArrayHandle> handles;
 				std::vector<const char*> keys;
-				for (const auto& w : weights)
+				for (const auto& w : params)
 				{
 					NDArrayHandle handle;
 
@@ -154,7 +420,7 @@ namespace chaos
 					void* pdata = nullptr;
 					CHECK_EQ(0, MXNDArrayGetData(handle, &pdata)) << MXGetLastError();
 
-					memcpy(pdata, w.second.data, w.second.Size());
+					memcpy(pdata, w.second.data, w.second.Size() * sizeof(float));
 
 					handles.push_back(handle);
 					keys.push_back(w.first.c_str());
@@ -169,8 +435,261 @@ namespace chaos
 				}
 			}
 
+			// Native net of the graph with the outputs as its heads, through temporary files
+			Ptr<Net> LoadNet(const std::vector<Symbol>& nodes, const std::map<std::string, Tensor>& params, const std::vector<int>& outputs)
+			{
+				static std::atomic<int> counter(0);
+				const std::string name = (std::filesystem::temp_directory_path() / ("chaos_optimizer_" + std::to_string(counter++))).string();
+				SaveSymbol(name + ".json", nodes, outputs);
+				SaveWeight(name + ".params", params);
+
+				Ptr<Net> net = LoadNative(Model(name + ".json", name + ".params"));
+				std::filesystem::remove(name + ".json");
+				std::filesystem::remove(name + ".params");
+				return net;
+			}
+
+			// Bind or reshape the net to the input, and forward it
+			static void Run(Ptr<Net>& net, const std::string& data, const Tensor& input, Shape& bound)
+			{
+				if (bound.Size() == 0)
+				{
+					net->BindExecutor({ DataLayer(data, input.shape) });
+				}
+				else if (!(bound == input.shape))
+				{
+					net->Reshape({ DataLayer(data, input.shape) });
+				}
+				bound = input.shape;
+				net->SetLayerData(data, input);
+				net->Forward();
+			}
+
+			// Input of the net, the first variable which is neither a param nor a label
+			std::string DataName() const
+			{
+				for (size_t i = 0; i < symbols.size(); i++)
+				{
+					const Symbol& sym = symbols[i];
+					if (sym.op.op_name != "null" || !WeightKey((int)i).empty()) continue;
+					if (sym.name.size() < 6 || sym.name.compare(sym.name.size() - 6, 6, "_label") != 0) return sym.name;
+				}
+				LOG(FATAL) << "Net without input";
+				return std::string(); // Never reachable
+			}
+
+			// Users of the output of the node, the heads included
+			int Consumers(int node) const
+			{
+				int count = (int)std::count(heads.begin(), heads.end(), node);
+				for (const auto& sym : symbols)
+				{
+					for (const auto& input : sym.inputs)
+					{
+						if (input.node_id == node) count++;
+					}
+				}
+				return count;
+			}
+			bool IsHead(int node) const
+			{
+				return std::find(heads.begin(), heads.end(), node) != heads.end();
+			}
+
+			// Key of the variable in weights, "arg:" or "aux:" prefixed as saved by MxNet, empty if not a param
+			std::string WeightKey(int node) const
+			{
+				const Symbol& sym = symbols[node];
+				if (sym.op.op_name != "null") return std::string();
+				for (const auto& key : { "arg:" + sym.name, "aux:" + sym.name, sym.name })
+				{
+					if (weights.count(key)) return key;
+				}
+				return std::string();
+			}
+			Tensor& Weight(int node)
+			{
+				const std::string key = WeightKey(node);
+				CHECK(!key.empty()) << symbols[node].name << " is not a param";
+				return weights[key];
+			}
+
+			// Convolution or FullyConnected whose output and weight are used by the next node only, so that the
+			// affine transform of the next node can be folded into its weight and bias
+			bool Foldable(int node) const
+			{
+				const Symbol& sym = symbols[node];
+				if (sym.op.op_name != "Convolution" && !(sym.op.op_name == "FullyConnected" && GetBool(sym.attrs, "flatten", true))) return false;
+				if (Consumers(node) != 1) return false;
+				for (size_t i = 1; i < sym.inputs.size(); i++)
+				{
+					if (WeightKey(sym.inputs[i].node_id).empty() || Consumers(sym.inputs[i].node_id) != 1) return false;
+				}
+				return true;
+			}
+
+			// Per channel y = x * scale + shift of the scalar ops and the broadcast ops of a param, false for the others
+			bool GetAffine(int node, std::vector<float>& scale, std::vector<float>& shift)
+			{
+				const Symbol& sym = symbols[node];
+				const std::string& op = sym.op.op_name;
+				if (sym.attrs.count("scalar"))
+				{
+					const float scalar = GetFloat(sym.attrs, "scalar", 0.f);
+					if (op == "_mul_scalar") { scale = { scalar }; shift = { 0.f }; }
+					else if (op == "_div_scalar") { scale = { 1.f / scalar }; shift = { 0.f }; }
+					else if (op == "_plus_scalar") { scale = { 1.f }; shift = { scalar }; }
+					else if (op == "_minus_scalar") { scale = { 1.f }; shift = { -scalar }; }
+					else if (op == "_rminus_scalar") { scale = { -1.f }; shift = { scalar }; }
+					else return false;
+					return true;
+				}
+
+				if (op.compare(0, 10, "broadcast_") != 0 || sym.inputs.size() != 2) return false;
+				const std::string key = WeightKey(sym.inputs[1].node_id);
+				if (key.empty()) return false;
+
+				// 1 x C x 1 x 1 or a single value, broadcasted over the channels
+				const Tensor& param = weights[key];
+				for (int d = 0; d < param.dims; d++)
+				{
+					if (d != 1 && param.shape[d] != 1) return false;
+				}
+				const float* value = (const float*)param.data;
+				const size_t channels = param.Size();
+				if (op == "broadcast_mul")
+				{
+					scale.assign(value, value + channels);
+					shift.assign(channels, 0.f);
+				}
+				else if (op == "broadcast_add" || op == "broadcast_plus" || op == "broadcast_sub" || op == "broadcast_minus")
+				{
+					const float sign = op == "broadcast_sub" || op == "broadcast_minus" ? -1.f : 1.f;
+					scale.assign(channels, 1.f);
+					shift.resize(channels);
+					for (size_t c = 0; c < channels; c++) shift[c] = sign * value[c];
+				}
+				else return false;
+				return true;
+			}
+
+			// W' = W * scale and b' = b * scale + shift by output channel, the bias is added if the node has none
+			void FoldAffine(int node, const std::vector<float>& scale, const std::vector<float>& shift)
+			{
+				Tensor& weight = Weight(symbols[node].inputs[1].node_id);
+				const int channels = weight.shape[0];
+				const size_t step = weight.Size() / channels;
+				CHECK(scale.size() == 1 || (int)scale.size() == channels) << "Scale of " << scale.size() << " channels can not be folded into " << symbols[node].name;
+
+				if (GetBool(symbols[node].attrs, "no_bias", false))
+				{
+					Symbol bias;
+					bias.name = symbols[node].name + "_bias";
+					while (weights.count("arg:" + bias.name)) bias.name += "_";
+
+					Tensor data(Shape{ channels }, F32);
+					memset(data.data, 0, channels * sizeof(float));
+					weights["arg:" + bias.name] = data;
+
+					Inputs input;
+					input.node_id = (int)symbols.size();
+					symbols.push_back(bias); // Prune sorts it before the node
+					symbols[node].inputs.push_back(input);
+					symbols[node].attrs["no_bias"] = "False";
+				}
+				Tensor& bias = Weight(symbols[node].inputs[2].node_id);
+
+				for (int c = 0; c < channels; c++)
+				{
+					const float s = scale[scale.size() == 1 ? 0 : c];
+					const float t = shift[shift.size() == 1 ? 0 : c];
+					float* w = (float*)weight.data + c * step;
+					for (size_t k = 0; k < step; k++) w[k] *= s;
+					((float*)bias.data)[c] = ((float*)bias.data)[c] * s + t;
+				}
+			}
+
+			// Users of the node read its first input instead, which takes over the output name if the node is a head
+			void Bypass(int node)
+			{
+				const Inputs source = symbols[node].inputs[0];
+				for (auto& sym : symbols)
+				{
+					for (auto& input : sym.inputs)
+					{
+						if (input.node_id == node) input = source;
+					}
+				}
+				for (auto& head : heads)
+				{
+					if (head != node) continue;
+					head = source.node_id;
+					symbols[head].name = symbols[node].name;
+				}
+				symbols[node].inputs.clear(); // dead until Prune
+			}
+
+			// Drop the nodes and params the heads do not depend on, and sort the others in topological order
+			void Prune()
+			{
+				std::vector<int> order;
+				std::vector<int> ids(symbols.size(), -1);
+				std::function<void(int)> Visit = [&](int node) {
+					if (ids[node] >= 0) return;
+					ids[node] = 0; // visiting
+					for (const auto& input : symbols[node].inputs) Visit(input.node_id);
+					ids[node] = (int)order.size();
+					order.push_back(node);
+				};
+				for (int head : heads) Visit(head);
+
+				std::vector<Symbol> sorted;
+				std::map<std::string, Tensor> used;
+				for (int node : order)
+				{
+					Symbol sym = symbols[node];
+					for (auto& input : sym.inputs) input.node_id = ids[input.node_id];
+					const std::string key = WeightKey(node);
+					if (!key.empty()) used[key] = weights[key];
+					sorted.push_back(sym);
+				}
+				for (auto& head : heads) head = ids[head];
+
+				symbols = sorted;
+				weights = used;
+			}
+
+			static bool GetBool(const Symbol::Attrs& attrs, const std::string& key, bool value)
+			{
+				auto attr = attrs.find(key);
+				if (attr == attrs.end()) return value;
+				return attr->second == "True" || attr->second == "true" || attr->second == "1";
+			}
+			static int GetInt(const Symbol::Attrs& attrs, const std::string& key, int value)
+			{
+				auto attr = attrs.find(key);
+				return attr == attrs.end() ? value : std::stoi(attr->second);
+			}
+			static float GetFloat(const Symbol::Attrs& attrs, const std::string& key, float value)
+			{
+				auto attr = attrs.find(key);
+				return attr == attrs.end() ? value : std::stof(attr->second);
+			}
+			static std::string ToString(float value)
+			{
+				std::stringstream stream;
+				stream << std::setprecision(9) << value;
+				return stream.str();
+			}
+
 			std::map<std::string, Tensor> weights;
 			std::vector<Symbol> symbols;
+			std::vector<int> heads;
+
+			// F32 graph before Quantize, for the drift report
+			std::map<std::string, Tensor> float_weights;
+			std::vector<Symbol> float_symbols;
+			std::vector<int> float_heads;
 
 		};
 
@@ -3,6 +3,10 @@
 
 #include "base.hpp"
 
+#include <chrono>
+#include <list>
+#include <thread>
+
 namespace chaos
 {
 	namespace dnn
@@ -35,65 +39,148 @@ namespace chaos
 				else
 				{
 					symbol = model.symbol;
-					weight = model.weight;
+					weight = std::make_shared<std::string>(model.weight);
 					GetOutputInfo();
 				}
 			}
 
 			~Predictor()
 			{
-				CHECK_EQ(0, MXPredFree(predictor)) << MXGetLastError();
+				SetProfiling(false);
+				for (const auto& executor : executors)
+				{
+					CHECK_EQ(0, MXPredFree(executor.second)) << MXGetLastError();
+				}
 			}
 
+			using Net::BindExecutor;
+
 			void BindExecutor(const std::vector<DataLayer>& inputs) final
 			{
 				for (auto layer : inputs)
 				{
 					shapes[layer.name] = layer.shape;
 				}
+				UpdateBound();
 
-				int size = (int)inputs.size();
+				std::vector<DataLayer> bound_inputs = ToLayers(bound);
+				int size = (int)bound_inputs.size();
 
 				std::vector<const char*> input_keys;
 				std::vector<mx_uint> indptr;
 				std::vector<mx_uint> shape_data;
 
-				GetInputsInfo(inputs, input_keys, indptr, shape_data);
+				GetInputsInfo(bound_inputs, input_keys, indptr, shape_data);
 
-				CHECK_EQ(0, MXPredCreate(symbol.data(), weight.data(), (int)weight.size(),
+				CHECK_EQ(0, MXPredCreate(symbol.data(), weight->data(), (int)weight->size(),
 					dev_type, dev_id, size, input_keys.data(),
 					indptr.data(), shape_data.data(), &predictor)) << MXGetLastError();
+
+				for (const auto& executor : executors)
+				{
+					CHECK_EQ(0, MXPredFree(executor.second)) << MXGetLastError();
+				}
+				executors.clear();
+				executors.push_front({ Key(bound), predictor });
+				ApplyTunedSettings(ToLayers(shapes));
 			}
 
 			/// <summary>Forward the newtork</summary>
 			void Forward() final
 			{
+				// The OpenMP threads of MxNet are set by thread, so they are set before each forward
+				if (settings.threads > 0) CHECK_EQ(0, MXSetNumOMPThreads(settings.threads)) << MXGetLastError();
+
+				forward_start = std::chrono::steady_clock::now();
+				const char* stats;
+				if (profiling)
+				{
+					// Drop what the profiler has recorded so far, so that the stats are of this forward
+					CHECK_EQ(0, MXAggregateProfileStatsPrint(&stats, 1)) << MXGetLastError();
+				}
+
 				CHECK_EQ(0, MXPredForward(predictor)) << MXGetLastError();
+				forward_pending = true;
+
+				if (profiling)
+				{
+					CHECK_EQ(0, MXNDArrayWaitAll()) << MXGetLastError();
+					CHECK_EQ(0, MXAggregateProfileStatsPrint(&stats, 1)) << MXGetLastError();
+					layer_times = ParseOperatorTimes(stats);
+				}
 			}
 
 			void SetLayerData(const std::string& name, const Tensor& data) final
 			{
-				CHECK_EQ(F32, data.depth);
-				CHECK_EQ(shapes[name], data.shape);
-
-				CHECK_EQ(0, MXPredSetInput(predictor, name.data(), (const float*)data.data, (mx_uint)data.Size())) << MXGetLastError();
+				SetLayerData(GetInputHandle(name), data);
 			}
 			void GetLayerData(const std::string& name, Tensor& data) final
 			{
-				CHECK(output_idx.find(name) != output_idx.end());
+				GetLayerData(GetOutputHandle(name), data);
+			}
+
+			int GetInputHandle(const std::string& name) final
+			{
+				auto input = std::find(input_names.begin(), input_names.end(), name);
+				CHECK(input != input_names.end()) << "Unknown input " << name;
+				return (int)(input - input_names.begin());
+			}
+			int GetOutputHandle(const std::string& name) final
+			{
+				CHECK(output_idx.find(name) != output_idx.end()) << "Unknown output " << name;
+				return output_idx[name];
+			}
+
+			void SetLayerData(int handle, const Tensor& data) final
+			{
+				CHECK(handle >= 0 && handle < (int)input_names.size()) << "Invalid input handle " << handle;
+				CHECK_EQ(input_shapes[handle], data.shape);
+				const std::string& name = input_names[handle];
+
+				// MxNet takes continue float inputs, F16 / BF16 inputs are widened here
+				const Tensor input = data.ConvertTo(F32).Flatten();
+				if (bound_batch == batch)
+				{
+					CHECK_EQ(0, MXPredSetInput(predictor, name.data(), (const float*)input.data, (mx_uint)input.Size())) << MXGetLastError();
+				}
+				else
+				{
+					// The executor of a bucket takes more samples, the rest are zeros
+					buffer.assign(input.Size() / batch * bound_batch, 0.f);
+					memcpy(buffer.data(), input.data, input.Size() * sizeof(float));
+					CHECK_EQ(0, MXPredSetInput(predictor, name.data(), buffer.data(), (mx_uint)buffer.size())) << MXGetLastError();
+				}
+			}
+			void GetLayerData(int handle, Tensor& data) final
+			{
+				CHECK(handle >= 0 && handle < (int)output_idx.size()) << "Invalid output handle " << handle;
 
 				mx_uint* shape;
 				mx_uint dims;
-				CHECK_EQ(0, MXPredGetOutputShape(predictor, output_idx[name], &shape, &dims)) << MXGetLastError();
+				CHECK_EQ(0, MXPredGetOutputShape(predictor, handle, &shape, &dims)) << MXGetLastError();
 
-				std::vector<int> size(dims);
-				for (mx_uint i = 0; i < dims; i++)
+				Shape output_shape(shape, dims);
+				if (bound_batch == batch || output_shape[0] != bound_batch)
+				{
+					Fit(data, output_shape);
+					CHECK_EQ(0, MXPredGetOutput(predictor, handle, (float*)data.data, (mx_uint)data.Size())) << MXGetLastError();
+				}
+				else
 				{
-					size[i] = shape[i];
+					// Outputs of a bucket are cut back to the samples set
+					output_shape[0] = batch;
+					Fit(data, output_shape);
+					buffer.resize(data.Size() / batch * bound_batch);
+					CHECK_EQ(0, MXPredGetOutput(predictor, handle, buffer.data(), (mx_uint)buffer.size())) << MXGetLastError();
+					memcpy(data.data, buffer.data(), data.Size() * sizeof(float));
 				}
-				data = Tensor(size, F32);
 
-				CHECK_EQ(0, MXPredGetOutput(predictor, output_idx[name], (float*)data.data, (mx_uint)data.Size())) << MXGetLastError();
+				// MXPredForward only pushes the operators to the engine, the forward is done once its first output is got
+				if (forward_pending)
+				{
+					latency.Add(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - forward_start).count());
+					forward_pending = false;
+				}
 			}
 
 			void Reshape(const std::vector<DataLayer>& new_inputs) final
@@ -103,29 +190,255 @@ namespace chaos
 					CHECK_NE(shapes.end(), shapes.find(layer.name));
 					shapes[layer.name] = layer.shape;
 				}
+				UpdateBound();
+
+				// The most recently used executor is at the front, and is the current one
+				const std::string key = Key(bound);
+				auto executor = std::find_if(executors.begin(), executors.end(), [&](const std::pair<std::string, PredictorHandle>& e) { return e.first == key; });
+				if (executor != executors.end())
+				{
+					executors.splice(executors.begin(), executors, executor);
+					cache_stats.hits++;
+				}
+				else
+				{
+					executors.push_front({ key, ReshapeFrom(predictor) });
+					cache_stats.misses++;
+					Trim();
+				}
+				predictor = executors.front().second;
+				ApplyTunedSettings(ToLayers(shapes));
+			}
+
+			Ptr<Net> Clone() final
+			{
+				CHECK(predictor) << "Bind the executor before clone";
+
+				return Ptr<Net>(new Predictor(*this, ReshapeFrom(predictor)));
+			}
+
+			void SetExecutorCache(int capacity, bool bucketing) final
+			{
+				CHECK_LT(0, capacity);
+
+				cache_capacity = capacity;
+				Trim();
+				if (this->bucketing != bucketing)
+				{
+					this->bucketing = bucketing;
+					if (predictor) Reshape({});
+				}
+			}
+
+			CacheStats GetCacheStats() const final
+			{
+				CacheStats stats = cache_stats;
+				stats.capacity = cache_capacity;
+				stats.bucketing = bucketing;
+				return stats;
+			}
+
+			void SetProfiling(bool enable) final
+			{
+				if (profiling == enable) return;
+				profiling = enable;
+				if (enable) layer_times.clear();
+
+				// The profiler of MxNet is shared by the process, it runs while any predictor is profiling
+				static std::mutex profiler_lock;
+				static int profiling_nets = 0;
+				std::lock_guard<std::mutex> guard(profiler_lock);
+				if (enable && profiling_nets++ == 0)
+				{
+					const char* keys[] = { "profile_symbolic", "aggregate_stats" };
+					const char* vals[] = { "true", "true" };
+					CHECK_EQ(0, MXSetProcessProfilerConfig(2, keys, vals, nullptr)) << MXGetLastError();
+					CHECK_EQ(0, MXSetProcessProfilerState(1, 0, nullptr)) << MXGetLastError();
+				}
+				if (!enable && --profiling_nets == 0)
+				{
+					CHECK_EQ(0, MXSetProcessProfilerState(0, 0, nullptr)) << MXGetLastError();
+				}
+			}
+			std::vector<LayerTime> GetLayerTimes() const final
+			{
+				return layer_times;
+			}
+			LatencyStats GetLatencyStats() const final
+			{
+				return latency.GetStats();
+			}
+
+			void SetForwardSettings(const ForwardSettings& settings) final
+			{
+				this->settings = settings;
+			}
+			ForwardSettings GetForwardSettings() const final
+			{
+				return settings;
+			}
+			std::vector<ForwardSettings> GetTuningSpace() const final
+			{
+				// The engine type and its workers are fixed once MxNet starts, only the OpenMP threads of the operators are left
+				std::vector<ForwardSettings> space = { ForwardSettings() };
+				if (dev_type != 1) return space;
+
+				const int max_threads = (int)std::max(1u, std::thread::hardware_concurrency());
+				std::vector<int> threads;
+				for (int n = 1; n < max_threads; n *= 2) threads.push_back(n);
+				threads.push_back(max_threads);
+				for (int n : threads)
+				{
+					space.push_back(ForwardSettings());
+					space.back().threads = n;
+				}
+				return space;
+			}
 
-				int size = (int)new_inputs.size();
+			dnn::Framework& GetFramework() final
+			{
+				return Registered::Have("MxNet");
+			}
+
+		private:
+			// Clone of other with its own executor
+			Predictor(const Predictor& other, PredictorHandle predictor)
+				: weight(other.weight), symbol(other.symbol), dev_type(other.dev_type), dev_id(other.dev_id),
+				output_idx(other.output_idx), predictor(predictor), shapes(other.shapes), input_names(other.input_names), input_shapes(other.input_shapes), bound(other.bound),
+				batch(other.batch), bound_batch(other.bound_batch), cache_capacity(other.cache_capacity), bucketing(other.bucketing)
+			{
+				executors.push_front({ Key(bound), predictor });
+				tuned_settings = other.tuned_settings;
+				settings = other.settings;
+			}
+
+			// A new executor for the bound shapes, which shares the parameters with from
+			PredictorHandle ReshapeFrom(PredictorHandle from)
+			{
+				std::vector<DataLayer> inputs = ToLayers(bound);
 
 				std::vector<const char*> input_keys;
 				std::vector<mx_uint> indptr;
 				std::vector<mx_uint> shape_data;
 
-				GetInputsInfo(new_inputs, input_keys, indptr, shape_data);
+				GetInputsInfo(inputs, input_keys, indptr, shape_data);
 
 				PredictorHandle new_predictor;
-				CHECK_EQ(0, MXPredReshape(size, input_keys.data(),
-					indptr.data(), shape_data.data(), predictor, &new_predictor)) << MXGetLastError();
+				CHECK_EQ(0, MXPredReshape((mx_uint)inputs.size(), input_keys.data(),
+					indptr.data(), shape_data.data(), from, &new_predictor)) << MXGetLastError();
+				return new_predictor;
+			}
+
+			// Keep data if the output fits in and data owns its buffer alone, otherwise create it by data.allocator,
+			// so that callers decide where the output lives and no copy or parent of data is written over
+			static void Fit(Tensor& data, const Shape& shape)
+			{
+				if (data.ref_cnt && *data.ref_cnt == 1 && data.data == data.buffer &&
+					data.shape == shape && data.depth == F32 && data.layout == NCHW && data.IsContinue()) return;
+				AllocationTag tag("MxNet output", /*fallback=*/true);
+				data = Tensor(shape, F32, false, data.allocator);
+			}
+
+			// Shapes of the executor, the batch size rounded up to 1, 2, 4, 8, 16, 32 or a multiple of 32 with bucketing
+			void UpdateBound()
+			{
+				// Input handles are the indices in the order of the names
+				input_names.clear();
+				input_shapes.clear();
+				for (const auto& shape : shapes)
+				{
+					input_names.push_back(shape.first);
+					input_shapes.push_back(shape.second);
+				}
+
+				bound = shapes;
+				batch = bound_batch = shapes.empty() || shapes.begin()->second.Size() == 0 ? 1 : shapes.begin()->second[0];
+				if (!bucketing) return;
+
+				// The samples of a bucket are padded and cut back by the batch size, skip empty inputs before
+				CHECK_LT(0, batch) << "Bucketed inputs need a batch size";
+				bound_batch = 1;
+				while (bound_batch < batch && bound_batch < 32) bound_batch *= 2;
+				if (bound_batch < batch) bound_batch = (batch + 31) / 32 * 32;
 
-				CHECK_EQ(0, MXPredFree(predictor)) << MXGetLastError();
-				predictor = new_predictor;
+				for (auto& shape : bound)
+				{
+					CHECK_EQ(batch, shape.second[0]) << "Inputs of different batch sizes can not be bucketed";
+					shape.second[0] = bound_batch;
+				}
 			}
 
-			dnn::Framework& GetFramework() final
+			// Free the least recently used executors over the capacity
+			void Trim()
 			{
-				return Registered::Have("MxNet");
+				while ((int)executors.size() > cache_capacity)
+				{
+					CHECK_EQ(0, MXPredFree(executors.back().second)) << MXGetLastError();
+					executors.pop_back();
+					cache_stats.evictions++;
+				}
+			}
+
+			static std::string Key(const std::map<std::string, Shape>& shapes)
+			{
+				std::string key;
+				for (const auto& shape : shapes)
+				{
+					key += shape.first + shape.second.ToString() + ";";
+				}
+				return key;
+			}
+
+			static std::vector<DataLayer> ToLayers(const std::map<std::string, Shape>& shapes)
+			{
+				std::vector<DataLayer> layers;
+				for (const auto& shape : shapes)
+				{
+					layers.push_back(DataLayer(shape.first, shape.second));
+				}
+				return layers;
+			}
+
+			// Total times of the "operator" table of the aggregate stats of the profiler, whose rows are
+			// Name, Total Count, Time (ms), Min Time (ms), Max Time (ms) and Avg Time (ms) after the "----" line
+			static std::vector<LayerTime> ParseOperatorTimes(const std::string& stats)
+			{
+				std::vector<LayerTime> times;
+				std::stringstream ss(stats);
+				std::string line, section;
+				bool rows = false;
+				while (std::getline(ss, line))
+				{
+					if (line.compare(0, 3, "===") == 0) continue;
+					if (line.compare(0, 4, "----") == 0)
+					{
+						rows = true;
+						continue;
+					}
+					if (line.find_first_not_of(" \t\r") == std::string::npos)
+					{
+						rows = false;
+						continue;
+					}
+					if (!rows)
+					{
+						if (line.compare(0, 4, "Name") != 0) section = line;
+						continue;
+					}
+					if (section != "operator") continue;
+
+					std::stringstream row(line);
+					LayerTime time;
+					size_t count;
+					if (row >> time.name >> count >> time.ms)
+					{
+						time.op = time.name;
+						times.push_back(time);
+					}
+				}
+				return times;
 			}
 
-		private:
 			void LoadWeight(const std::string& file)
 			{
 				std::fstream fs(file, std::ios::in | std::ios::binary);
@@ -135,9 +448,9 @@ namespace chaos
 				size_t size = fs.tellg();
 				fs.seekg(0, std::ios::beg);
 
-				weight.resize(size);
+				weight = std::make_shared<std::string>(size, '\0');
 
-				fs.read((char*)weight.data(), size);
+				fs.read((char*)weight->data(), size);
 				fs.close();
 			}
 
@@ -196,7 +509,7 @@ namespace chaos
 				}
 			}
 
-			std::string weight;
+			Ptr<std::string> weight; // shared by the clones
 			std::string symbol;
 
 			int dev_type;
@@ -207,6 +520,26 @@ namespace chaos
 			PredictorHandle predictor = nullptr;
 
 			std::map<std::string, Shape> shapes; // Inputs shapes
+			std::vector<std::string> input_names; // by input handle
+			std::vector<Shape> input_shapes; // by input handle
+			std::map<std::string, Shape> bound; // Inputs shapes of the executor, bucketed
+			int batch = 1;
+			int bound_batch = 1;
+			std::vector<float> buffer; // padded inputs and outputs of a bucket
+
+			// Bound executors by the key of their shapes, most recently used first
+			std::list<std::pair<std::string, PredictorHandle>> executors;
+			int cache_capacity = 1;
+			bool bucketing = false;
+			CacheStats cache_stats;
+
+			ForwardSettings settings;
+
+			bool profiling = false;
+			std::vector<LayerTime> layer_times;
+			LatencyWindow latency;
+			std::chrono::steady_clock::time_point forward_start;
+			bool forward_pending = false;
 		};
 
 		Ptr<Net> LoadMxNet(const Model& model, const Context& ctx)
@@ -2,6 +2,15 @@
 
 #include <random>
 #include <chrono>
+#include <atomic>
+#include <new>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 DEFINE_STRING(data, "", "", "Data folder");
 DEFINE_STRING(database, "", "", "Database for testing");
@@ -21,6 +30,18 @@ DEFINE_INT(height, 112, "Face", "Input height for face model");
 DEFINE_INT(width, 112, "Face", "Input width for face model");
 DEFINE_FLOAT(pad, 0, "Face", "Padding for aligner");
 
+DEFINE_INT(threads, 8, "Benchmark", "Max number of threads for micro benchmarks");
+DEFINE_INT(iterations, 100000, "Benchmark", "Iterations per thread for micro benchmarks");
+DEFINE_INT(live_blocks, 256, "Benchmark", "Live blocks per thread in allocator benchmark");
+DEFINE_INT(gallery_size, 262144, "Benchmark", "Number of features in large page benchmark");
+DEFINE_INT(numa_node, -1, "Benchmark", "NUMA node to bind the gallery to in large page benchmark");
+DEFINE_INT(requests, 1000, "Benchmark", "Requests per thread in batching benchmark, batches in async benchmark");
+DEFINE_INT(max_batch, 16, "Benchmark", "Max batch size in batching benchmark, batch size in async benchmark");
+DEFINE_FLOAT(max_delay, 2, "Benchmark", "Max delay in ms of the oldest request in batching benchmark");
+DEFINE_INT(top_layers, 0, "Benchmark", "Print the N most expensive layers of each net in native benchmark, 0 for none");
+DEFINE_STRING(profile, "", "Benchmark", "Folder to dump the profile JSON of each net in native benchmark");
+DEFINE_BOOL(tune, "Benchmark", "Tune the forward settings of each net in native benchmark, cached in the tune file next to the weight");
+
 
 using namespace chaos;
 using namespace chaos::face;
@@ -145,6 +166,8 @@ void Detect()
 		ProgressBar::Update();
 	}
 	ProgressBar::Halt();
+
+	LOG(INFO) << std::endl << detector->Report();
 }
 REGISTERFUNC(Detect);
 
@@ -158,14 +181,14 @@ void Test()
 	engine->Gallery = DataLoader::Load(flag_gallery);
 	engine->Genuine = DataLoader::Load(flag_genuine);
 
+	const int input = net->GetInputHandle("data");
+	const int output = net->GetOutputHandle(flag_layer_name);
 	engine->Forward = [=](const Mat& image)->Tensor {
-		Mat data;
-		image.convertTo(data, CV_32F);
-
+		// A new feat each time, the engine may hold several of them
 		Tensor feat;
-		net->SetLayerData("data", Tensor::Unroll({ data }, true));
+		net->SetLayerData(input, ImagesToTensor({ image }, Scalar(), Scalar::all(1), /*swap_rb=*/true));
 		net->Forward();
-		net->GetLayerData(flag_layer_name, feat);
+		net->GetLayerData(output, feat);
 
 		return feat;
 	};
@@ -176,7 +199,599 @@ void Test()
 	engine->Close();
 }
 REGISTERFUNC(Test);
+
+void BenchAllocator()
+{
+	// Each thread keeps live_blocks blocks alive and replaces a random one per iteration,
+	// which is close to what the tensors of one MTCNN frame do to the allocator
+	auto Run = [](const std::function<Allocator*(int)>& get, int num_threads, size_t min_size, size_t max_size) {
+		std::vector<std::thread> workers;
+		int64 start = cv::getTickCount();
+		for (int t = 0; t < num_threads; t++)
+		{
+			workers.push_back(std::thread([=]() {
+				Allocator* allocator = get(t);
+				std::mt19937 rng(t);
+				std::uniform_int_distribution<size_t> sizes(min_size, max_size);
+				std::vector<void*> live(flag_live_blocks, nullptr);
+				for (int i = 0; i < flag_iterations; i++)
+				{
+					void*& ptr = live[rng() % live.size()];
+					if (ptr) allocator->FastFree(ptr);
+					ptr = allocator->FastMalloc(sizes(rng));
+				}
+				for (auto ptr : live)
+				{
+					if (ptr) allocator->FastFree(ptr);
+				}
+			}));
+		}
+		for (auto& worker : workers) worker.join();
+		double during = (cv::getTickCount() - start) / cv::getTickFrequency();
+		return (double)flag_iterations * num_threads / during / 1e6; // M ops/s
+	};
+
+	std::vector<std::pair<size_t, size_t>> ranges = { {64, 4096}, {4096, 256 * 1024}, {256 * 1024, 4 * 1024 * 1024} };
+
+	std::stringstream table;
+	table << "  |Threads|Size Range|PoolAllocator|UnlockedPoolAllocator*|SizeClassPoolAllocator|CachedAllocator|" << std::endl;
+	table << "  |:---:|:---:|:---:|:---:|:---:|:---:|" << std::endl;
+	for (int num_threads = 1; num_threads <= flag_threads; num_threads *= 2)
+	{
+		for (auto range : ranges)
+		{
+			PoolAllocator pool;
+			double pool_ops = Run([&](int) { return &pool; }, num_threads, range.first, range.second);
+
+			// UnlockedPoolAllocator is not thread safe, so every thread has its own one
+			std::vector<UnlockedPoolAllocator> unlocked(num_threads);
+			double unlocked_ops = Run([&](int t) { return &unlocked[t]; }, num_threads, range.first, range.second);
+
+			SizeClassPoolAllocator size_class;
+			double size_class_ops = Run([&](int) { return &size_class; }, num_threads, range.first, range.second);
+
+			CachedAllocator cached;
+			double cached_ops = Run([&](int) { return &cached; }, num_threads, range.first, range.second);
+
+			table << "  |" << num_threads << "|" << range.first << "~" << range.second
+				<< "|" << std::fixed << std::setprecision(3) << pool_ops
+				<< "|" << unlocked_ops
+				<< "|" << size_class_ops
+				<< "|" << cached_ops << "|" << std::endl;
+		}
+	}
+
+	LOG(INFO) << std::endl
+		<< "Allocator throughput in M ops/s (malloc + free), " << flag_live_blocks << " live blocks per thread" << std::endl
+		<< "* one allocator per thread" << std::endl
+		<< table.str();
+}
+REGISTERFUNC(BenchAllocator);
+
+// Counts the data TLB misses of the calling thread, only available on Linux
+class TLBCounter
+{
+public:
+	TLBCounter()
+	{
+#ifdef __linux__
+		perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = PERF_TYPE_HW_CACHE;
+		attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+	}
+	~TLBCounter()
+	{
+#ifdef __linux__
+		if (fd >= 0) close(fd);
+#endif
+	}
+
+	void Start()
+	{
+#ifdef __linux__
+		if (fd < 0) return;
+		ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+		ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+	}
+
+	/// <summary>Returns -1 if not available</summary>
+	int64 Stop()
+	{
+		int64 count = -1;
+#ifdef __linux__
+		if (fd < 0 || ioctl(fd, PERF_EVENT_IOC_DISABLE, 0) != 0 || read(fd, &count, sizeof(count)) != sizeof(count)) return -1;
+#endif
+		return count;
+	}
+
+private:
+	int fd = -1;
+};
+
+void BenchLargePage()
+{
+	const int dims = 512;
+	const int num_queries = 256;
+	const int k = 10;
+
+	std::mt19937 rng(0);
+	std::normal_distribution<float> normal;
+	Tensor gallery({ flag_gallery_size, dims }, F32);
+	for (size_t i = 0; i < gallery.Size(); i++) ((float*)gallery.data)[i] = normal(rng);
+	Tensor queries({ num_queries, dims }, F32);
+	for (size_t i = 0; i < queries.Size(); i++) ((float*)queries.data)[i] = normal(rng);
+
+	auto Run = [&](Allocator* allocator, std::stringstream& table) {
+		TLBCounter tlb;
+
+		// Random row reads are where the TLB misses come from
+		int64 gather_size = (int64)gallery.Size();
+		Tensor copy({ flag_gallery_size, dims }, F32, false, allocator);
+		memcpy(copy.data, gallery.data, gather_size * sizeof(float));
+		std::vector<int> rows(1 << 20);
+		for (auto& row : rows) row = rng() % flag_gallery_size;
+
+		tlb.Start();
+		int64 start = cv::getTickCount();
+		volatile float sum = 0; // keep the reads
+		for (auto row : rows) sum = sum + ((float*)copy.data)[(int64)row * dims + (row & (dims - 1))];
+		double gather_during = (cv::getTickCount() - start) / cv::getTickFrequency();
+		int64 gather_misses = tlb.Stop();
+
+		Ptr<FastSearcher> searcher = allocator ? FastSearcher::CreateFlat(dims, allocator, FastSearcher::IP) : FastSearcher::CreateFlat(dims, FastSearcher::IP);
+		searcher->Add(gallery);
+
+		Tensor distances, labels;
+		searcher->Search(queries, k, distances, labels); // warm up
+
+		tlb.Start();
+		start = cv::getTickCount();
+		searcher->Search(queries, k, distances, labels);
+		double search_during = (cv::getTickCount() - start) / cv::getTickFrequency();
+		int64 search_misses = tlb.Stop();
+
+		auto Misses = [](int64 misses) { return misses < 0 ? std::string("n/a") : std::to_string(misses); };
+		table << "|" << std::fixed << std::setprecision(2) << rows.size() / gather_during / 1e6
+			<< "|" << Misses(gather_misses)
+			<< "|" << num_queries / search_during
+			<< "|" << Misses(search_misses) << "|" << std::endl;
+	};
+
+	std::stringstream table;
+	table << "  |Allocator|Random Gather (M reads/s)|Gather dTLB Misses|Search (queries/s)|Search dTLB Misses|" << std::endl;
+	table << "  |:---:|:---:|:---:|:---:|:---:|" << std::endl;
+
+	table << "  |FastMalloc";
+	Run(nullptr, table);
+
+	LargePageAllocator large_pages(flag_numa_node);
+	table << "  |LargePageAllocator";
+	Run(&large_pages, table);
+
+	LOG(INFO) << std::endl
+		<< "Flat search over " << flag_gallery_size << " x " << dims << " features, " << num_queries << " queries, top " << k << std::endl
+		<< "FastMalloc uses the faiss IndexFlat, LargePageAllocator keeps the gallery in huge pages"
+		<< (flag_numa_node >= 0 ? " on NUMA node " + std::to_string(flag_numa_node) : "") << std::endl
+		<< table.str();
+}
+REGISTERFUNC(BenchLargePage);
+
+void BenchBatching()
+{
+	Context ctx = Context(flag_use_gpu ? GPU : CPU, flag_device_id);
+	auto net = Net::Load({ flag_symbol, flag_weight }, ctx);
+	net->BindExecutor({ {"data", {1, 3, flag_height, flag_width}} });
+
+	std::mt19937 rng(0);
+	std::uniform_real_distribution<float> uniform(0, 255);
+	Tensor sample({ 3, flag_height, flag_width }, F32);
+	for (size_t i = 0; i < sample.Size(); i++) ((float*)sample.data)[i] = uniform(rng);
+
+	// Every client sends requests one after another, as the service threads do
+	auto Run = [&](const std::function<void()>& request, int num_threads, std::stringstream& table) {
+		std::vector<std::vector<double>> latencies(num_threads);
+		std::vector<std::thread> clients;
+		int64 start = cv::getTickCount();
+		for (int t = 0; t < num_threads; t++)
+		{
+			clients.push_back(std::thread([&, t]() {
+				for (int i = 0; i < flag_requests; i++)
+				{
+					int64 begin = cv::getTickCount();
+					request();
+					latencies[t].push_back((cv::getTickCount() - begin) * 1000. / cv::getTickFrequency());
+				}
+			}));
+		}
+		for (auto& client : clients) client.join();
+		double during = (cv::getTickCount() - start) / cv::getTickFrequency();
+
+		std::vector<double> all;
+		for (const auto& l : latencies) all.insert(all.end(), l.begin(), l.end());
+		std::sort(all.begin(), all.end());
+		table << "|" << std::fixed << std::setprecision(2) << all.size() / during
+			<< "|" << all[all.size() / 2]
+			<< "|" << all[std::min(all.size() - 1, all.size() * 99 / 100)] << "|";
+	};
+
+	std::stringstream table;
+	table << "  |Clients|Single (samples/s)|Single p50 (ms)|Single p99 (ms)|Batching (samples/s)|Batching p50 (ms)|Batching p99 (ms)|Mean Batch|" << std::endl;
+	table << "  |:---:|:---:|:---:|:---:|:---:|:---:|:---:|:---:|" << std::endl;
+	for (int num_threads = 1; num_threads <= flag_threads; num_threads *= 2)
+	{
+		table << "  |" << num_threads;
+
+		// One sample per Forward, the clients take turns on the net and the output is reused
+		std::mutex net_lock;
+		const int input = net->GetInputHandle("data");
+		const int output = net->GetOutputHandle(flag_layer_name);
+		Tensor feat;
+		Run([&]() {
+			std::lock_guard<std::mutex> lock(net_lock);
+			net->SetLayerData(input, sample.Reshape({ 1, 3, flag_height, flag_width }));
+			net->Forward();
+			net->GetLayerData(output, feat);
+		}, num_threads, table);
+
+		{
+			BatchingNet batching(net, "data", { flag_layer_name }, flag_max_batch, flag_max_delay);
+			Run([&]() { batching.Forward(sample).get(); }, num_threads, table);
+			table << std::setprecision(2) << (double)batching.NumRequests / batching.NumBatches << "|" << std::endl;
+		}
+
+		// BatchingNet leaves the net reshaped to its last batch
+		net->Reshape({ {"data", {1, 3, flag_height, flag_width}} });
+	}
+
+	LOG(INFO) << std::endl
+		<< "Forward " << flag_layer_name << " of " << flag_height << " x " << flag_width << " samples, " << flag_requests << " requests per client" << std::endl
+		<< "Batching groups up to " << flag_max_batch << " samples or waits " << flag_max_delay << " ms" << std::endl
+		<< table.str();
+}
+REGISTERFUNC(BenchBatching);
+
+void BenchAsync()
+{
+	Context ctx = Context(flag_use_gpu ? GPU : CPU, flag_device_id);
+	auto net = Net::Load({ flag_symbol, flag_weight }, ctx);
+	net->BindExecutor({ {"data", {flag_max_batch, 3, flag_height, flag_width}} });
+
+	// Camera sized frames, resized and normalized to a batch as the service does
+	std::vector<Mat> frames(flag_max_batch);
+	for (auto& frame : frames)
+	{
+		frame = Mat(480, 640, CV_8UC3);
+		cv::randu(frame, Scalar::all(0), Scalar::all(255));
+	}
+	auto Prepare = [&]() {
+		std::vector<Mat> faces(frames.size());
+		for (size_t i = 0; i < frames.size(); i++) cv::resize(frames[i], faces[i], Size(flag_width, flag_height));
+		return ImagesToTensor(faces, Scalar(), Scalar::all(1), /*swap_rb=*/true);
+	};
+
+	const int input = net->GetInputHandle("data");
+	const int output = net->GetOutputHandle(flag_layer_name);
+
+	// Costs of each stage on its own
+	double prepare = 0, forward = 0;
+	int64 start = cv::getTickCount();
+	Tensor feat;
+	for (int i = 0; i < flag_requests; i++)
+	{
+		int64 tick = cv::getTickCount();
+		Tensor data = Prepare();
+		prepare += cv::getTickCount() - tick;
+
+		tick = cv::getTickCount();
+		net->SetLayerData(input, data);
+		net->Forward();
+		net->GetLayerData(output, feat);
+		forward += cv::getTickCount() - tick;
+	}
+	double sync = (cv::getTickCount() - start) / cv::getTickFrequency();
+	prepare /= cv::getTickFrequency();
+	forward /= cv::getTickFrequency();
+
+	// Batch k + 1 is prepared while batch k is forwarded
+	double pipelined;
+	{
+		AsyncNet async_net(net, { "data" }, { flag_layer_name });
+		start = cv::getTickCount();
+		std::future<std::vector<Tensor>> last;
+		for (int i = 0; i < flag_requests; i++)
+		{
+			Tensor data = Prepare();
+			if (last.valid()) last.get();
+			last = async_net.ForwardAsync({ data });
+		}
+		last.get();
+		pipelined = (cv::getTickCount() - start) / cv::getTickFrequency();
+	}
+
+	// The best pipelining hides all of the shorter stage
+	double hidden = (sync - pipelined) / std::min(prepare, forward);
+
+	LOG(INFO) << std::endl
+		<< "Forward " << flag_requests << " batches of " << flag_max_batch << " x " << flag_height << " x " << flag_width << std::endl
+		<< "  |Prepare (s)|Forward (s)|Sync (s)|Async (s)|Hidden|" << std::endl
+		<< "  |:---:|:---:|:---:|:---:|:---:|" << std::endl
+		<< "  |" << std::fixed << std::setprecision(3) << prepare << "|" << forward << "|" << sync << "|" << pipelined
+		<< "|" << std::setprecision(1) << hidden * 100 << "% of " << (prepare < forward ? "preparing" : "forwarding") << "|" << std::endl;
+}
+REGISTERFUNC(BenchAsync);
+
+// The most expensive layers of the net, by the mean of their times over the forwards
+static std::string TopLayers(Ptr<Net>& net, const std::function<void()>& forward, int forwards, int top)
+{
+	std::map<std::string, std::pair<std::string, double>> layers; // name to op and total ms
+	double total = 0.;
+	net->SetProfiling(true);
+	for (int i = 0; i < forwards; i++)
+	{
+		forward();
+		for (const auto& time : net->GetLayerTimes())
+		{
+			layers[time.name].first = time.op;
+			layers[time.name].second += time.ms;
+			total += time.ms;
+		}
+	}
+	net->SetProfiling(false);
+
+	std::vector<std::pair<std::string, std::pair<std::string, double>>> sorted(layers.begin(), layers.end());
+	std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) { return a.second.second > b.second.second; });
+
+	std::stringstream table;
+	table << "  |Layer|Op|Time (ms)|Share|" << std::endl;
+	table << "  |:---:|:---:|:---:|:---:|" << std::endl;
+	for (size_t i = 0; i < sorted.size() && i < (size_t)top; i++)
+	{
+		table << "  |" << sorted[i].first << "|" << sorted[i].second.first << "|" << std::fixed << std::setprecision(3) << sorted[i].second.second / forwards
+			<< "|" << std::setprecision(1) << sorted[i].second.second * 100 / total << "%|" << std::endl;
+	}
+	return table.str();
+}
+
+void BenchNative()
+{
+	// The face feature model and the MTCNN nets at the input sizes the detector forwards, the largest pyramid level for PNet
+	struct Target { std::string name, symbol, weight; Shape shape; std::string output; };
+	std::vector<Target> targets;
+	if (!flag_symbol.empty()) targets.push_back({ "Feature", flag_symbol, flag_weight, { 1, 3, flag_height, flag_width }, flag_layer_name });
+	if (!flag_mtcnn.empty())
+	{
+		targets.push_back({ "PNet", flag_mtcnn + "\\PNet.json", flag_mtcnn + "\\PNet.params", { 1, 3, 12, 12 }, "conv4_1_output" });
+		targets.push_back({ "PNet pyramid", flag_mtcnn + "\\PNet.json", flag_mtcnn + "\\PNet.params", { 1, 3, 320, 240 }, "conv4_1_output" });
+		targets.push_back({ "RNet", flag_mtcnn + "\\RNet.json", flag_mtcnn + "\\RNet.params", { 1, 3, 24, 24 }, "conv5_1_output" });
+		targets.push_back({ "ONet", flag_mtcnn + "\\ONet.json", flag_mtcnn + "\\ONet.params", { 1, 3, 48, 48 }, "conv6_1_output" });
+	}
+	CHECK(!targets.empty()) << "Set symbol and weight, or mtcnn";
+
+	std::mt19937 rng(0);
+	std::uniform_real_distribution<float> uniform(-1, 1);
+
+	// Mean latency of Forward with the input set and the output got, as the detectors do
+	auto Time = [&](Ptr<Net>& net, const Tensor& data, const std::string& output, Tensor& result) {
+		const int input = net->GetInputHandle("data");
+		const int handle = net->GetOutputHandle(output);
+		auto Run = [&]() {
+			net->SetLayerData(input, data);
+			net->Forward();
+			net->GetLayerData(handle, result);
+		};
+		int64 start = cv::getTickCount();
+		for (int i = 0; i < flag_requests; i++) Run();
+		return (cv::getTickCount() - start) * 1000. / cv::getTickFrequency() / flag_requests;
+	};
+
+	std::stringstream table, latencies, layers;
+	table << "  |Net|Input|MxNet (ms)|Native (ms)|Speedup|Max Abs Diff|" << std::endl;
+	table << "  |:---:|:---:|:---:|:---:|:---:|:---:|" << std::endl;
+	latencies << "  |Net|Framework|p50 (ms)|p95 (ms)|p99 (ms)|Max (ms)|" << std::endl;
+	latencies << "  |:---:|:---:|:---:|:---:|:---:|:---:|" << std::endl;
+	for (const auto& target : targets)
+	{
+		Tensor data(target.shape, F32);
+		for (size_t i = 0; i < data.Size(); i++) ((float*)data.data)[i] = uniform(rng);
+
+		auto mxnet = Net::Load({ target.symbol, target.weight }, Context(flag_use_gpu ? GPU : CPU, flag_device_id, "MxNet"));
+		auto native = Net::Load({ target.symbol, target.weight }, Context(CPU, 0, "Native"));
+		// Warmed up, and tuned once per model and shape, so that the first forwards are not timed cold
+		BindOptions options;
+		options.warmup = 10;
+		options.tune_file = flag_tune ? Net::TuneFile({ target.symbol, target.weight }) : "";
+		mxnet->BindExecutor({ {"data", target.shape} }, options);
+		native->BindExecutor({ {"data", target.shape} }, options);
+
+		Tensor expected, result;
+		double mxnet_ms = Time(mxnet, data, target.output, expected);
+		double native_ms = Time(native, data, target.output, result);
+
+		CHECK(expected.shape == result.shape) << "Outputs of " << target.name << " mismatch, " << expected.shape << " vs " << result.shape;
+		float diff = 0.f;
+		for (size_t i = 0; i < result.Size(); i++) diff = std::max(diff, std::abs(((float*)expected.data)[i] - ((float*)result.data)[i]));
+
+		table << "  |" << target.name << "|" << target.shape << "|" << std::fixed << std::setprecision(3) << mxnet_ms << "|" << native_ms
+			<< "|" << std::setprecision(2) << mxnet_ms / native_ms << "x|" << std::scientific << diff << std::defaultfloat << "|" << std::endl;
+
+		for (auto net : { mxnet, native })
+		{
+			const LatencyStats stats = net->GetLatencyStats();
+			latencies << "  |" << target.name << "|" << net->GetFramework().name << "|" << std::fixed << std::setprecision(3)
+				<< stats.p50 << "|" << stats.p95 << "|" << stats.p99 << "|" << stats.max << "|" << std::defaultfloat << std::endl;
+
+			if (flag_top_layers > 0)
+			{
+				layers << target.name << " by " << net->GetFramework().name << std::endl
+					<< TopLayers(net, [&]() {
+						Tensor output;
+						net->SetLayerData("data", data);
+						net->Forward();
+						net->GetLayerData(target.output, output);
+					}, std::min(flag_requests, 100), flag_top_layers);
+			}
+			if (!flag_profile.empty())
+			{
+				net->DumpProfile(flag_profile + "\\" + target.name + "." + net->GetFramework().name + ".json");
+			}
+		}
+	}
+
+	LOG(INFO) << std::endl
+		<< "Forward of the MxNet predictor and the native net, " << flag_requests << " forwards per net on " << cv::getNumThreads() << " threads" << std::endl
+		<< table.str() << std::endl
+		<< "Latencies over the last forwards of each net, the warm up included" << std::endl
+		<< latencies.str()
+		<< (flag_top_layers > 0 ? "\nTop " + std::to_string(flag_top_layers) + " layers, MxNet times its operators\n" + layers.str() : "");
+}
+REGISTERFUNC(BenchNative);
  
+void BenchPyramid()
+{
+	Context ctx = Context(flag_use_gpu ? GPU : CPU, flag_device_id);
+	auto detector = Detector::LoadMTCNN(flag_mtcnn, ctx);
+
+	// Images of data, or a 1080p frame of noise
+	std::vector<Mat> images;
+	if (!flag_data.empty())
+	{
+		FileList list;
+		GetFileList(flag_data, list, "jpg|jpeg|bmp|png|JPG|JPEG|PNG|BMP");
+		for (auto file : list) images.push_back(cv::imread(file));
+	}
+	if (images.empty())
+	{
+		images.push_back(Mat(1080, 1920, CV_8UC3));
+		cv::randu(images[0], Scalar::all(0), Scalar::all(255));
+	}
+
+	// Enough workers of cv::parallel_for_ for the most executors
+	const int workers = cv::getNumThreads();
+	cv::setNumThreads(std::max(workers, flag_threads));
+
+	std::vector<std::vector<FaceInfo>> serial;
+	std::stringstream table;
+	table << "  |Threads|Detect (ms)|Speedup|Same as serial|" << std::endl;
+	table << "  |:---:|:---:|:---:|:---:|" << std::endl;
+	double base = 0;
+	for (int threads = 1; threads <= flag_threads; threads *= 2)
+	{
+		detector->Set("PNetThreads", threads);
+		for (const auto& image : images) detector->Detect(image); // warm up the executors of each level
+
+		std::vector<std::vector<FaceInfo>> results(images.size());
+		int64 start = cv::getTickCount();
+		for (int i = 0; i < flag_requests; i++)
+		{
+			for (size_t j = 0; j < images.size(); j++) results[j] = detector->Detect(images[j]);
+		}
+		double ms = (cv::getTickCount() - start) * 1000. / cv::getTickFrequency() / ((double)flag_requests * images.size());
+
+		// The merged candidates must be the same as the serial ones, so are the faces
+		bool same = true;
+		if (threads == 1)
+		{
+			serial = results;
+			base = ms;
+		}
+		for (size_t j = 0; j < images.size(); j++)
+		{
+			same &= results[j].size() == serial[j].size();
+			for (size_t k = 0; same && k < results[j].size(); k++)
+			{
+				same &= results[j][k].rect == serial[j][k].rect && results[j][k].score == serial[j][k].score && results[j][k].points == serial[j][k].points;
+			}
+		}
+
+		table << "  |" << threads << "|" << std::fixed << std::setprecision(2) << ms << "|" << base / ms << "x|" << (same ? "Yes" : "No") << "|" << std::endl;
+	}
+	cv::setNumThreads(workers);
+
+	LOG(INFO) << std::endl
+		<< "Detect " << images.size() << " image(s) " << flag_requests << " times with the pyramid levels of PNet on 1 to " << flag_threads << " threads" << std::endl
+		<< table.str();
+}
+REGISTERFUNC(BenchPyramid);
+
+// Heap allocations by operator new while counting. Linux counts those of the whole process, Windows only those of FaceBench,
+// as each DLL has its own operator new there, so the numbers of Windows leave out ChaosCV
+static std::atomic<bool> counting_news(false);
+static std::atomic<size_t> num_news(0);
+static std::atomic<size_t> new_bytes(0);
+
+void* operator new(size_t size)
+{
+	if (counting_news.load(std::memory_order_relaxed))
+	{
+		num_news++;
+		new_bytes += size;
+	}
+	void* ptr = malloc(size ? size : 1);
+	if (!ptr) throw std::bad_alloc();
+	return ptr;
+}
+
+void operator delete(void* ptr) noexcept
+{
+	free(ptr);
+}
+
+void BenchDetectAlloc()
+{
+	Context ctx = Context(flag_use_gpu ? GPU : CPU, flag_device_id);
+	auto detector = Detector::LoadMTCNN(flag_mtcnn, ctx);
+
+	// Images of data, or a 1080p frame of noise
+	std::vector<Mat> images;
+	if (!flag_data.empty())
+	{
+		FileList list;
+		GetFileList(flag_data, list, "jpg|jpeg|bmp|png|JPG|JPEG|PNG|BMP");
+		for (auto file : list) images.push_back(cv::imread(file));
+	}
+	if (images.empty())
+	{
+		images.push_back(Mat(1080, 1920, CV_8UC3));
+		cv::randu(images[0], Scalar::all(0), Scalar::all(255));
+	}
+
+	// The first frames grow the executors, arenas and buffers to the images, the frames after them are counted
+	for (int i = 0; i < 3; i++)
+	{
+		for (const auto& image : images) detector->Detect(image);
+	}
+
+	size_t faces = 0;
+	num_news = 0;
+	new_bytes = 0;
+	counting_news = true;
+	int64 start = cv::getTickCount();
+	for (int i = 0; i < flag_requests; i++)
+	{
+		for (const auto& image : images) faces += detector->Detect(image).size();
+	}
+	double ms = (cv::getTickCount() - start) * 1000. / cv::getTickFrequency();
+	counting_news = false;
+
+	// The faces returned are allocations of the caller, one vector per frame and one landmark per face
+	const double frames = (double)flag_requests * images.size();
+	LOG(INFO) << std::endl
+		<< "Detect " << images.size() << " image(s) " << flag_requests << " times after 3 warm up rounds" << std::endl
+		<< "  |Allocations / frame|Bytes / frame|Faces / frame|Detect (ms)|" << std::endl
+		<< "  |:---:|:---:|:---:|:---:|" << std::endl
+		<< "  |" << std::fixed << std::setprecision(1) << num_news / frames << "|" << new_bytes / frames << "|" << faces / frames << "|"
+		<< std::setprecision(2) << ms / frames << "|" << std::endl
+		<< detector->Report();
+}
+REGISTERFUNC(BenchDetectAlloc);
+
 int main(int argc, char** argv)
 {
 	SetUsageMessage(
@@ -188,7 +803,22 @@ int main(int argc, char** argv)
 		"    Detect        To detect the face\n"
 		"                  Use MTCNN to detect face\n"
 		"    CreateDB      To create database\n"
-		"                  This is just an example"
+		"                  This is just an example\n"
+		"    BenchAllocator  To benchmark the pool allocators\n"
+		"                  Use threads, iterations and live_blocks to set the workload\n"
+		"    BenchLargePage  To benchmark huge page backed galleries\n"
+		"                  Use gallery_size and numa_node to set the workload\n"
+		"    BenchBatching  To benchmark the dynamic batching of the face feature model\n"
+		"                  Use threads, requests, max_batch and max_delay to set the workload\n"
+		"    BenchAsync    To benchmark how much preprocessing the async forward hides\n"
+		"                  Use requests and max_batch to set the workload\n"
+		"    BenchNative   To compare the native net with the MxNet predictor\n"
+		"                  Use symbol and weight, or mtcnn, and requests to set the workload\n"
+		"                  Use top_layers to print the most expensive layers, profile to dump them, tune to auto tune\n"
+		"    BenchPyramid  To benchmark the pyramid levels of MTCNN evaluated by 1 to threads PNet executors\n"
+		"                  Use mtcnn, data and requests to set the workload, threads=16 to scale up to 16\n"
+		"    BenchDetectAlloc  To count the heap allocations per frame of MTCNN after warming up\n"
+		"                  Use mtcnn, data and requests to set the workload, Linux counts the whole process"
 	);
 
 	ParseCommondLineFlags(&argc, &argv);